@@ -0,0 +1,294 @@
+/// @file check/track_index.cc
+/// @brief Program checking TrackIndex against a scan of every segment.
+///
+/// Builds an index over random tracks, with one and with several threads, and
+/// compares the results of range() and nearest() for random queries with the
+/// ones found by testing every segment of every track. Also checks that a
+/// build with more ids than tracks fails and leaves the index empty. Exits
+/// with a non-zero status on the first mismatch.
+///
+/// Example usage:
+///   ./check_index
+///   ./check_index -k 2000 -q 5000 -s 3
+///
+//===----------------------------------------------------------------------===//
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "pathest/location.h"
+#include "pathest/path_view.h"
+#include "pathest/track_index.h"
+
+using pathest::Location;
+using pathest::PathView;
+using pathest::TrackIndex;
+
+// Default check parameters.
+const size_t default_tracks = 500;
+const size_t default_queries = 500;
+const unsigned default_seed = 1;
+
+// Threads of the index compared with the single-threaded one.
+const unsigned check_threads = 4;
+
+// Relative tolerance of distances, which are computed in another order.
+const double distance_tolerance = 1e-9;
+
+void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-k TRACKS] [-q QUERIES] [-s SEED]\n", name);
+}
+
+// Number of segments of a track, the same as in the index.
+size_t num_segments(PathView track) {
+  return track.size() > 1 ? track.size() - 1 : track.size();
+}
+
+// Get the part of the segment from a to b within a time window, false if none.
+bool clip_time(const Location &a, const Location &b, const double min_t,
+               const double max_t, double *x1, double *y1, double *x2,
+               double *y2) {
+  if (b.t() < min_t || a.t() > max_t) return false;
+  double s0 = 0;
+  double s1 = 1;
+  double dt = b.t() - a.t();
+  if (dt > 0) {
+    if (min_t > a.t()) s0 = (min_t - a.t()) / dt;
+    if (max_t < b.t()) s1 = (max_t - a.t()) / dt;
+  }
+  *x1 = a.x() + s0 * (b.x() - a.x());
+  *y1 = a.y() + s0 * (b.y() - a.y());
+  *x2 = a.x() + s1 * (b.x() - a.x());
+  *y2 = a.y() + s1 * (b.y() - a.y());
+  return true;
+}
+
+// Sign of the turn from (ax, ay) to (bx, by) to (cx, cy).
+int orientation(const double ax, const double ay, const double bx,
+                const double by, const double cx, const double cy) {
+  double v = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+  return (v > 0) - (v < 0);
+}
+
+// Whether the segments from p1 to p2 and from q1 to q2 intersect.
+bool intersect(const double p1x, const double p1y, const double p2x,
+               const double p2y, const double q1x, const double q1y,
+               const double q2x, const double q2y) {
+  return orientation(p1x, p1y, p2x, p2y, q1x, q1y) *
+    orientation(p1x, p1y, p2x, p2y, q2x, q2y) <= 0 &&
+    orientation(q1x, q1y, q2x, q2y, p1x, p1y) *
+    orientation(q1x, q1y, q2x, q2y, p2x, p2y) <= 0;
+}
+
+// Whether a segment crosses a region, by testing its ends and the edges of the
+// region rather than by clipping as the index does.
+bool crosses(const double x1, const double y1, const double x2,
+             const double y2, const TrackIndex::Region &r) {
+  if ((x1 >= r.min_x && x1 <= r.max_x && y1 >= r.min_y && y1 <= r.max_y) ||
+      (x2 >= r.min_x && x2 <= r.max_x && y2 >= r.min_y && y2 <= r.max_y)) {
+    return true;
+  }
+  return intersect(x1, y1, x2, y2, r.min_x, r.min_y, r.max_x, r.min_y) ||
+    intersect(x1, y1, x2, y2, r.max_x, r.min_y, r.max_x, r.max_y) ||
+    intersect(x1, y1, x2, y2, r.max_x, r.max_y, r.min_x, r.max_y) ||
+    intersect(x1, y1, x2, y2, r.min_x, r.max_y, r.min_x, r.min_y);
+}
+
+// Distance from a point to the segment from (x1, y1) to (x2, y2).
+double distance(const double x, const double y, const double x1,
+                const double y1, const double x2, const double y2) {
+  double dx = x2 - x1;
+  double dy = y2 - y1;
+  double len2 = dx * dx + dy * dy;
+  double s = len2 > 0 ? ((x - x1) * dx + (y - y1) * dy) / len2 : 0;
+  s = std::max(0.0, std::min(1.0, s));
+  return hypot(x - (x1 + s * dx), y - (y1 + s * dy));
+}
+
+// Find the tracks through a region by scanning every segment.
+void scan_range(const std::vector<uint64_t> &ids,
+                const std::vector<PathView> &tracks,
+                const TrackIndex::Region &region, std::vector<uint64_t> *out) {
+  out->clear();
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    PathView track = tracks[i];
+    for (size_t s = 0; s < num_segments(track); ++s) {
+      const Location &b = track[s + 1 < track.size() ? s + 1 : s];
+      double x1, y1, x2, y2;
+      if (clip_time(track[s], b, region.min_t, region.max_t,
+                    &x1, &y1, &x2, &y2) &&
+          crosses(x1, y1, x2, y2, region)) {
+        out->push_back(ids[i]);
+        break;
+      }
+    }
+  }
+  std::sort(out->begin(), out->end());
+}
+
+// Find the distance of every track within a time window by scanning every
+// segment, nearest first with ties by id.
+void scan_nearest(const std::vector<uint64_t> &ids,
+                  const std::vector<PathView> &tracks, const double x,
+                  const double y, const double min_t, const double max_t,
+                  std::vector<TrackIndex::Neighbor> *out) {
+  out->clear();
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    PathView track = tracks[i];
+    double best = HUGE_VAL;
+    for (size_t s = 0; s < num_segments(track); ++s) {
+      const Location &b = track[s + 1 < track.size() ? s + 1 : s];
+      double x1, y1, x2, y2;
+      if (clip_time(track[s], b, min_t, max_t, &x1, &y1, &x2, &y2)) {
+        best = std::min(best, distance(x, y, x1, y1, x2, y2));
+      }
+    }
+    if (best < HUGE_VAL) {
+      TrackIndex::Neighbor neighbor = {ids[i], best};
+      out->push_back(neighbor);
+    }
+  }
+  std::sort(out->begin(), out->end(),
+            [](const TrackIndex::Neighbor &n1, const TrackIndex::Neighbor &n2) {
+    return n1.distance < n2.distance ||
+      (n1.distance == n2.distance && n1.id < n2.id);
+  });
+}
+
+// Whether nearest() found the k nearest distances of a scan. Ids are only
+// compared where the distances are clearly apart, since the order of
+// near-ties depends on rounding.
+bool same_nearest(const std::vector<TrackIndex::Neighbor> &found,
+                  const std::vector<TrackIndex::Neighbor> &scan,
+                  const size_t k) {
+  if (found.size() != std::min(k, scan.size())) return false;
+  for (size_t i = 0; i < found.size(); ++i) {
+    double tolerance = distance_tolerance * std::max(1.0, scan[i].distance);
+    if (fabs(found[i].distance - scan[i].distance) > tolerance) return false;
+    bool tied =
+      (i > 0 && scan[i].distance - scan[i - 1].distance <= tolerance) ||
+      (i + 1 < scan.size() &&
+       scan[i + 1].distance - scan[i].distance <= tolerance);
+    if (!tied && found[i].id != scan[i].id) return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  size_t num_tracks = default_tracks;
+  size_t num_queries = default_queries;
+  unsigned seed = default_seed;
+  int opt;
+  while ((opt = getopt(argc, argv, "k:q:s:h")) != -1) {
+    switch (opt) {
+      case 'k': num_tracks = strtoull(optarg, NULL, 10); break;
+      case 'q': num_queries = strtoull(optarg, NULL, 10); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind != argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Random walks of various lengths and speeds within a shared area and time
+  // span, including single locations and locations that stand still. Steps
+  // are long for the area, so that the grid also divides time into slabs.
+  const double area = 1000;
+  const double span = 10000;
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::vector<std::vector<Location> > locations(num_tracks);
+  std::vector<uint64_t> ids(num_tracks);
+  std::vector<PathView> tracks(num_tracks);
+  for (size_t i = 0; i < num_tracks; ++i) {
+    size_t len = i % 17 ? 1 + rng() % 200 : 1;
+    double step = area * 0.2 * unit(rng);
+    double x = area * unit(rng);
+    double y = area * unit(rng);
+    double t = span * unit(rng);
+    for (size_t j = 0; j < len; ++j) {
+      locations[i].push_back(Location(x, y, t));
+      if (j % 11 != 3) {
+        x = std::max(0.0, std::min(area, x + step * (unit(rng) - 0.5)));
+        y = std::max(0.0, std::min(area, y + step * (unit(rng) - 0.5)));
+      }
+      t += j % 13 == 5 ? 0 : 10 * unit(rng);
+    }
+    ids[i] = 1000 + 7 * (num_tracks - i);  // Not in track order.
+    tracks[i] = PathView(locations[i].data(), locations[i].size());
+  }
+
+  TrackIndex index;
+  TrackIndex threaded;
+  if (!index.build(ids, tracks, 1) ||
+      !threaded.build(ids, tracks, check_threads)) {
+    fprintf(stderr, "Failed to build the index\n");
+    return 1;
+  }
+  printf("Indexed %zu tracks, %zu segments in %zu cells and %zu slabs\n",
+         index.size(), index.segments(), index.cells(), index.slabs());
+
+  std::vector<uint64_t> found;
+  std::vector<uint64_t> found_threaded;
+  std::vector<uint64_t> scan;
+  std::vector<TrackIndex::Neighbor> near;
+  std::vector<TrackIndex::Neighbor> near_threaded;
+  std::vector<TrackIndex::Neighbor> near_scan;
+  for (size_t q = 0; q < num_queries; ++q) {
+    double x = area * (1.2 * unit(rng) - 0.1);
+    double y = area * (1.2 * unit(rng) - 0.1);
+    double w = area * 0.05 * unit(rng);
+    double h = area * 0.05 * unit(rng);
+    double t = span * unit(rng);
+    double d = span * 0.1 * unit(rng);
+    // Every fourth query has no time window.
+    TrackIndex::Region region = {x - w, y - h, x + w, y + h,
+                                 q % 4 ? t - d : -HUGE_VAL,
+                                 q % 4 ? t + d : HUGE_VAL};
+    index.range(region, &found);
+    threaded.range(region, &found_threaded);
+    scan_range(ids, tracks, region, &scan);
+    if (found != scan || found_threaded != scan) {
+      fprintf(stderr, "Query %zu: range found %zu and %zu tracks, scan %zu\n",
+              q, found.size(), found_threaded.size(), scan.size());
+      return 1;
+    }
+
+    size_t k = 1 + q % 10;
+    index.nearest(x, y, k, &near, region.min_t, region.max_t);
+    threaded.nearest(x, y, k, &near_threaded, region.min_t, region.max_t);
+    scan_nearest(ids, tracks, x, y, region.min_t, region.max_t, &near_scan);
+    if (!same_nearest(near, near_scan, k) ||
+        !same_nearest(near_threaded, near_scan, k)) {
+      fprintf(stderr, "Query %zu: nearest %zu differ from the scan\n", q, k);
+      return 1;
+    }
+  }
+
+  // A mismatch of ids and tracks leaves the index empty.
+  ids.push_back(1);
+  if (index.build(ids, tracks, 1) || !index.empty() || index.segments()) {
+    fprintf(stderr, "Built an index with more ids than tracks\n");
+    return 1;
+  }
+  index.range(TrackIndex::Region{-HUGE_VAL, -HUGE_VAL, HUGE_VAL, HUGE_VAL,
+                                 -HUGE_VAL, HUGE_VAL}, &found);
+  if (!found.empty()) {
+    fprintf(stderr, "Found tracks in an index that failed to build\n");
+    return 1;
+  }
+
+  printf("Checked %zu queries\n", num_queries);
+  return 0;
+}
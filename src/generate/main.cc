@@ -0,0 +1,209 @@
+/// @file generate/main.cc
+/// @brief Main program for generating synthetic test data.
+///
+/// Native replacement for test/generate.py that can produce large data sets.
+/// Tracks are generated on multiple threads and each one is written straight
+/// to its own pair of files, in the JSON report format (input-N.txt and
+/// input-N.ref) or in the binary track format (input-N.bin and
+/// input-N.ref.bin). With -a, all tracks instead go to one pair of track
+/// archives, input.arc and input.ref.arc, with the track number as the id.
+///
+/// Example usage:
+///   ./generate -f "50 * math.sin(x / 20)"
+///   ./generate -k 10000 -n 1000 -s 7 -b -o /tmp/soak
+///   ./generate -k 10000 -n 1000 -a -o /tmp/day
+///
+//===----------------------------------------------------------------------===//
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "pathest/expression.h"
+#include "pathest/generator.h"
+#include "pathest/parallel.h"
+#include "pathest/path.h"
+#include "pathest/track_archive.h"
+#include "pathest/track_io.h"
+
+// Default generator parameters, the same as test/generate.py.
+const char *default_expr = "x";
+const double default_start = 0;
+const size_t default_num = 100;
+
+// Output file name templates.
+const char *json_name = "%s/input-%llu.txt";
+const char *json_ref_name = "%s/input-%llu.ref";
+const char *binary_name = "%s/input-%llu.bin";
+const char *binary_ref_name = "%s/input-%llu.ref.bin";
+const char *archive_name = "%s/input.arc";
+const char *archive_ref_name = "%s/input.ref.arc";
+
+// Tracks generated at once before being appended to an archive in order.
+const size_t archive_batch = 64;
+
+// Write one path to a new file named from a template and track number.
+bool write_track(const char *fmt, const char *dir, const uint64_t track,
+                 const bool binary, const pathest::Path &path);
+
+// Generate all tracks into a pair of archives named from templates.
+bool write_archives(const pathest::Generator &gen, const char *dir,
+                    const size_t tracks, const unsigned threads);
+
+void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-f function of x] [-m minimum x]"
+          " [-n points per track] [-k tracks] [-s seed] [-j threads]"
+          " [-o output directory] [-b | -a]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+  const char *expr = default_expr;
+  const char *out_dir = ".";
+  double start = default_start;
+  size_t num = default_num;
+  size_t tracks = 1;
+  uint64_t seed = 0;
+  unsigned threads = 0;
+  bool binary = false;
+  bool archive = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:m:n:k:s:j:o:ba")) != -1) {
+    switch (opt) {
+      case 'f': expr = optarg; break;
+      case 'm': start = strtod(optarg, NULL); break;
+      case 'n': num = strtoull(optarg, NULL, 10); break;
+      case 'k': tracks = strtoull(optarg, NULL, 10); break;
+      case 's': seed = strtoull(optarg, NULL, 10); break;
+      case 'j': threads = strtoul(optarg, NULL, 10); break;
+      case 'o': out_dir = optarg; break;
+      case 'b': binary = true; break;
+      case 'a': archive = true; break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (optind != argc || (binary && archive)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  pathest::Expression curve;
+  if (!curve.parse(expr)) {
+    fprintf(stderr, "Invalid function of x: %s\n", expr);
+    return -1;
+  }
+
+  struct stat st;
+  if (stat(out_dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "No such directory: %s\n", out_dir);
+    return -1;
+  }
+
+  pathest::Generator gen(curve, start, num, seed);
+  std::atomic<bool> ok(true);
+  std::chrono::steady_clock::time_point begin =
+    std::chrono::steady_clock::now();
+  if (archive) {
+    ok = write_archives(gen, out_dir, tracks, threads);
+  } else {
+    pathest::parallel_for(tracks, threads,
+                          [&](size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last && ok; ++i) {
+        pathest::Path ref;
+        pathest::Path input;
+        gen.generate(i, &ref, &input);
+        if (!write_track(binary ? binary_ref_name : json_ref_name, out_dir, i,
+                         binary, ref) ||
+            !write_track(binary ? binary_name : json_name, out_dir, i,
+                         binary, input)) {
+          ok = false;
+        }
+      }
+    });
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - begin;
+  if (!ok) return -1;
+
+  double points = static_cast<double>(tracks) * num;
+  fprintf(stdout, "Generated %zu track(s) with %zu point(s) each in %.3f s"
+          " (%.0f points/s)\n", tracks, num, elapsed.count(),
+          elapsed.count() > 0 ? points / elapsed.count() : 0);
+  return 0;
+}
+
+bool write_track(const char *fmt, const char *dir, const uint64_t track,
+                 const bool binary, const pathest::Path &path) {
+  size_t name_len = strlen(fmt) + strlen(dir) + 21;
+  std::vector<char> name(name_len);
+  snprintf(&name[0], name_len, fmt, dir,
+           static_cast<unsigned long long>(track));
+  FILE *fp = fopen(&name[0], binary ? "wb" : "w");
+  if (!fp) {
+    fprintf(stderr, "Unable to open file: %s\n", &name[0]);
+    return false;
+  }
+  bool ok = binary ? pathest::write_binary(fp, path)
+    : pathest::write_json(fp, path);
+  if (fclose(fp) != 0) ok = false;
+  if (!ok) fprintf(stderr, "Unable to write file: %s\n", &name[0]);
+  return ok;
+}
+
+bool write_archives(const pathest::Generator &gen, const char *dir,
+                    const size_t tracks, const unsigned threads) {
+  size_t name_len = strlen(archive_ref_name) + strlen(dir) + 1;
+  std::vector<char> name(name_len);
+  std::vector<char> ref_name(name_len);
+  snprintf(&name[0], name_len, archive_name, dir);
+  snprintf(&ref_name[0], name_len, archive_ref_name, dir);
+  pathest::ArchiveWriter writer;
+  pathest::ArchiveWriter ref_writer;
+  if (!writer.open(&name[0], tracks)) {
+    fprintf(stderr, "Unable to open file: %s\n", &name[0]);
+    return false;
+  }
+  if (!ref_writer.open(&ref_name[0], tracks)) {
+    fprintf(stderr, "Unable to open file: %s\n", &ref_name[0]);
+    return false;
+  }
+
+  // Generate a batch in parallel, then append it in track order, so that the
+  // archives are the same for any number of threads.
+  std::vector<pathest::Path> refs(archive_batch);
+  std::vector<pathest::Path> inputs(archive_batch);
+  bool ok = true;
+  for (size_t base = 0; base < tracks && ok; base += archive_batch) {
+    size_t len = tracks - base < archive_batch ? tracks - base : archive_batch;
+    pathest::parallel_for(len, threads,
+                          [&](size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        refs[i].clear();
+        inputs[i].clear();
+        gen.generate(base + i, &refs[i], &inputs[i]);
+      }
+    });
+    for (size_t i = 0; i < len && ok; ++i) {
+      ok = writer.add(base + i, inputs[i]) &&
+        ref_writer.add(base + i, refs[i]);
+    }
+  }
+  if (!writer.close() || !ok) {
+    fprintf(stderr, "Unable to write file: %s\n", &name[0]);
+    ok = false;
+  }
+  if (!ref_writer.close()) {
+    fprintf(stderr, "Unable to write file: %s\n", &ref_name[0]);
+    ok = false;
+  }
+  return ok;
+}
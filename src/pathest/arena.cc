@@ -0,0 +1,118 @@
+/// @file pathest/arena.cc
+/// @brief Class for reusable monotonic allocation.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/arena.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory_resource>
+#include <vector>
+
+namespace pathest {
+
+namespace {
+
+// Alignment of every block, enough for any fundamental type.
+const size_t block_alignment = alignof(max_align_t);
+
+size_t align_up(const size_t value, const size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Offset of the first suitably aligned address at or after an offset.
+size_t align_offset(const char *base, const size_t offset,
+                    const size_t alignment) {
+  uintptr_t addr = reinterpret_cast<uintptr_t>(base);
+  return align_up(addr + offset, alignment) - addr;
+}
+
+}  // namespace
+
+Arena::Arena(const size_t block_size, std::pmr::memory_resource *upstream) :
+  blocks_(std::vector<Block>()),
+  current_(0),
+  offset_(0),
+  used_(0),
+  block_size_(block_size ? block_size : kDefaultBlockSize),
+  upstream_(upstream) {}
+
+Arena::~Arena() { this->release(); }
+
+void Arena::release() {
+  for (std::vector<Block>::const_iterator it = this->blocks_.begin();
+       it != this->blocks_.end(); ++it) {
+    this->upstream_->deallocate(it->data, it->size, block_alignment);
+  }
+  this->blocks_.clear();
+}
+
+void Arena::reset() {
+  if (this->blocks_.size() > 1) {
+    size_t total = this->capacity();
+    this->release();
+    Block block = {
+      static_cast<char *>(this->upstream_->allocate(total, block_alignment)),
+      total
+    };
+    this->blocks_.push_back(block);
+  }
+  this->current_ = 0;
+  this->offset_ = 0;
+  this->used_ = 0;
+}
+
+size_t Arena::capacity() const {
+  size_t total = 0;
+  for (std::vector<Block>::const_iterator it = this->blocks_.begin();
+       it != this->blocks_.end(); ++it) {
+    total += it->size;
+  }
+  return total;
+}
+
+size_t Arena::used() const { return this->used_; }
+
+void *Arena::do_allocate(size_t bytes, size_t alignment) {
+#ifdef DEBUG
+  assert(alignment && !(alignment & (alignment - 1)));  // Power of two.
+#endif
+  // Use the first remaining block with enough space.
+  while (this->current_ < this->blocks_.size()) {
+    Block &block = this->blocks_[this->current_];
+    size_t start = align_offset(block.data, this->offset_, alignment);
+    if (start + bytes <= block.size) {
+      this->offset_ = start + bytes;
+      this->used_ += bytes;
+      return block.data + start;
+    }
+    ++this->current_;
+    this->offset_ = 0;
+  }
+
+  // Grow geometrically so that the number of blocks stays small.
+  size_t size = this->blocks_.empty() ? this->block_size_
+    : 2 * this->blocks_.back().size;
+  size_t needed = align_up(bytes + alignment, block_alignment);
+  if (size < needed) size = needed;
+  Block block = {
+    static_cast<char *>(this->upstream_->allocate(size, block_alignment)),
+    size
+  };
+  this->blocks_.push_back(block);
+  this->current_ = this->blocks_.size() - 1;
+  size_t start = align_offset(block.data, 0, alignment);
+  this->offset_ = start + bytes;
+  this->used_ += bytes;
+  return block.data + start;
+}
+
+void Arena::do_deallocate(void *, size_t, size_t) {}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource &other) const
+  noexcept {
+  return this == &other;
+}
+
+}  // namespace pathest
@@ -0,0 +1,74 @@
+/// @file pathest/arena.h
+/// @brief Class for reusable monotonic allocation.
+///
+/// An arena hands out memory by bumping a pointer through large blocks, and
+/// releases everything at once when reset. Unlike
+/// std::pmr::monotonic_buffer_resource, resetting keeps the blocks, so a loop
+/// that resets the arena once per unit of work stops allocating from the
+/// upstream resource after the first few iterations. When a reset finds that
+/// more than one block was needed, the blocks are merged into one so that the
+/// next pass fits without spilling.
+///
+/// Individual deallocations are ignored. An arena is not safe to use from
+/// multiple threads at once.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_ARENA_H_
+#define PATHEST_ARENA_H_
+
+#include <stddef.h>
+#include <memory_resource>
+#include <vector>
+
+namespace pathest {
+
+class Arena : public std::pmr::memory_resource {
+ public:
+  /// @brief Create an arena.
+  ///
+  /// No memory is allocated until the first request.
+  ///
+  /// @param block_size Size in bytes of the first block.
+  /// @param upstream Resource to allocate blocks from.
+  explicit Arena(const size_t block_size = kDefaultBlockSize,
+                 std::pmr::memory_resource *upstream =
+                 std::pmr::get_default_resource());
+  ~Arena();
+
+  static const size_t kDefaultBlockSize = 64 * 1024;
+
+  /// @brief Release all allocations, keeping the memory for reuse.
+  ///
+  /// Everything allocated from the arena must be unused when this is called.
+  void reset();
+
+  size_t capacity() const;  //< Total size in bytes of all blocks.
+  size_t used() const;  //< Number of bytes handed out since the last reset.
+
+ private:
+  struct Block {
+    char *data;
+    size_t size;
+  };
+
+  std::vector<Block> blocks_;  //< Blocks in the order they are filled.
+  size_t current_;  //< Index of the block being filled.
+  size_t offset_;  //< Offset of the next free byte in the current block.
+  size_t used_;  //< Bytes handed out since the last reset.
+  const size_t block_size_;  //< Size of the first block.
+  std::pmr::memory_resource *upstream_;  //< Source of blocks.
+
+  Arena(const Arena &);
+  Arena &operator=(const Arena &);
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *ptr, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept
+    override;
+  void release();  //< Return all blocks to the upstream resource.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_ARENA_H_
@@ -0,0 +1,207 @@
+/// @file pathest/compact_path.cc
+/// @brief Classes for storing paths in less memory.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/compact_path.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "pathest/location.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+namespace {
+
+// Map signed integers to unsigned ones with small magnitudes first, so that
+// small negative differences also encode in few bytes.
+uint64_t zigzag(const int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+    static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(const uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Append an integer seven bits at a time, low bits first, with the high bit
+// of each byte set when more follow.
+void put_varint(std::pmr::vector<uint8_t> *stream, uint64_t value) {
+  while (value >= 0x80) {
+    stream->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  stream->push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t get_varint(const uint8_t **next) {
+  const uint8_t *p = *next;
+  uint64_t value = 0;
+  int shift = 0;
+  for (;; shift += 7) {
+    uint8_t byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) break;
+  }
+  *next = p;
+  return value;
+}
+
+int64_t quantize(const double value, const double resolution) {
+  return static_cast<int64_t>(llround(value / resolution));
+}
+
+}  // namespace
+
+Float32Path::Float32Path(PathView path, std::pmr::memory_resource *resource) :
+  origin_x_(path.empty() ? 0 : path.front().x()),
+  origin_y_(path.empty() ? 0 : path.front().y()),
+  data_(resource) {
+  this->data_.reserve(path.size());
+  for (PathView::const_iterator it = path.begin(); it != path.end(); ++it) {
+    Packed p = {
+      it->t(),
+      static_cast<float>(it->x() - this->origin_x_),
+      static_cast<float>(it->y() - this->origin_y_)
+    };
+    this->data_.push_back(p);
+  }
+}
+
+bool Float32Path::empty() const { return this->data_.empty(); }
+size_t Float32Path::size() const { return this->data_.size(); }
+
+size_t Float32Path::bytes() const {
+  return this->data_.size() * sizeof(Packed);
+}
+
+Path Float32Path::decode(std::pmr::memory_resource *resource) const {
+  Path::storage_type locations(resource);
+  locations.reserve(this->size());
+  for (size_t i = 0; i < this->size(); ++i) locations.push_back((*this)[i]);
+  return Path(std::move(locations));
+}
+
+DeltaPath::DeltaPath(PathView path, const double resolution,
+                     const double time_resolution,
+                     std::pmr::memory_resource *resource) :
+  resolution_(resolution),
+  time_resolution_(time_resolution),
+  size_(path.size()),
+  blocks_(resource),
+  stream_(resource) {
+  this->blocks_.reserve((path.size() + kBlockSize - 1) / kBlockSize);
+  for (size_t begin = 0; begin < path.size(); begin += kBlockSize) {
+    size_t end = std::min(begin + kBlockSize, path.size());
+    Block block;
+    block.offset = this->stream_.size();
+    block.count = end - begin;
+    int64_t x = quantize(path[begin].x(), resolution);
+    int64_t y = quantize(path[begin].y(), resolution);
+    int64_t t = quantize(path[begin].t(), time_resolution);
+    block.first_x = x;
+    block.first_y = y;
+    block.first_t = t;
+    int64_t min_x = x, max_x = x, min_y = y, max_y = y;
+    int64_t min_t = t, max_t = t;
+    for (size_t i = begin + 1; i < end; ++i) {
+      int64_t next_x = quantize(path[i].x(), resolution);
+      int64_t next_y = quantize(path[i].y(), resolution);
+      int64_t next_t = quantize(path[i].t(), time_resolution);
+      put_varint(&this->stream_, zigzag(next_x - x));
+      put_varint(&this->stream_, zigzag(next_y - y));
+      put_varint(&this->stream_, zigzag(next_t - t));
+      x = next_x;
+      y = next_y;
+      t = next_t;
+      min_x = std::min(min_x, x);
+      max_x = std::max(max_x, x);
+      min_y = std::min(min_y, y);
+      max_y = std::max(max_y, y);
+      min_t = std::min(min_t, t);
+      max_t = std::max(max_t, t);
+    }
+    block.min_x = min_x * resolution;
+    block.max_x = max_x * resolution;
+    block.min_y = min_y * resolution;
+    block.max_y = max_y * resolution;
+    block.min_t = min_t * time_resolution;
+    block.max_t = max_t * time_resolution;
+    this->blocks_.push_back(block);
+  }
+  this->stream_.shrink_to_fit();
+}
+
+bool DeltaPath::empty() const { return !this->size_; }
+size_t DeltaPath::size() const { return this->size_; }
+
+size_t DeltaPath::bytes() const {
+  return this->blocks_.size() * sizeof(Block) + this->stream_.size();
+}
+
+const std::pmr::vector<DeltaPath::Block> &DeltaPath::blocks() const {
+  return this->blocks_;
+}
+
+Path DeltaPath::decode(std::pmr::memory_resource *resource) const {
+  Path::storage_type locations(resource);
+  locations.reserve(this->size());
+  for (const_iterator it = this->begin(); it != this->end(); ++it) {
+    locations.push_back(*it);
+  }
+  return Path(std::move(locations));
+}
+
+DeltaPath::const_iterator DeltaPath::seek(const double time) const {
+  // The first block that reaches the time, then the location within it.
+  std::pmr::vector<Block>::const_iterator block = std::partition_point(
+      this->blocks_.begin(), this->blocks_.end(),
+      [time](const Block &b) { return b.max_t < time; });
+  const_iterator it(this, block - this->blocks_.begin());
+  const_iterator end = this->end();
+  while (it != end && (*it).t() < time) ++it;
+  return it;
+}
+
+DeltaPath::const_iterator::const_iterator(const DeltaPath *path,
+                                          const size_t block) :
+  path_(path), block_(block), i_(0), next_(NULL), x_(0), y_(0), t_(0) {
+  this->start_block();
+}
+
+void DeltaPath::const_iterator::start_block() {
+  if (this->block_ >= this->path_->blocks_.size()) return;
+  const Block &block = this->path_->blocks_[this->block_];
+  this->next_ = this->path_->stream_.data() + block.offset;
+  this->x_ = block.first_x;
+  this->y_ = block.first_y;
+  this->t_ = block.first_t;
+}
+
+Location DeltaPath::const_iterator::operator*() const {
+  return Location(this->x_ * this->path_->resolution_,
+                  this->y_ * this->path_->resolution_,
+                  this->t_ * this->path_->time_resolution_);
+}
+
+DeltaPath::const_iterator &DeltaPath::const_iterator::operator++() {
+  if (++this->i_ == this->path_->blocks_[this->block_].count) {
+    ++this->block_;
+    this->i_ = 0;
+    this->start_block();
+  } else {
+    this->x_ += unzigzag(get_varint(&this->next_));
+    this->y_ += unzigzag(get_varint(&this->next_));
+    this->t_ += unzigzag(get_varint(&this->next_));
+  }
+  return *this;
+}
+
+}  // namespace pathest
@@ -0,0 +1,305 @@
+/// @file pathest/compact_path.h
+/// @brief Classes for storing paths in less memory.
+///
+/// A Path stores each location as three doubles, 24 bytes. The compact paths
+/// here trade precision for size and are read back through iterators that
+/// decode one location at a time, so estimators can run over them directly
+/// (see Pipeline::run()) or decode them into a Path.
+///
+/// - Float32Path stores coordinates as floats relative to the first location
+///   and timestamps as doubles, 16 bytes per location. Coordinate precision is
+///   relative to the distance from the first location, about 1e-7 of it.
+///   Timestamps keep full precision, so closely spaced reports on tracks that
+///   span days still have distinct times.
+/// - DeltaPath rounds coordinates and timestamps to fixed resolutions and
+///   stores the differences between consecutive locations as variable-length
+///   integers, in blocks with their own bounds. Slow, regular movement takes a
+///   few bytes per location. Blocks decode independently, so a time can be
+///   found by binary search over the blocks.
+///
+/// Both are immutable once built, and are built from locations in time order.
+/// They are not storage backends of Path, which keeps its locations
+/// contiguous so that views, the distance index and the parallel estimators
+/// can read them in place. Instead they have the estimators and metrics of
+/// Path themselves (see CompactPlayback), computed from decoded locations.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_COMPACT_PATH_H_
+#define PATHEST_COMPACT_PATH_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <iterator>
+#include <memory_resource>
+#include <vector>
+
+#include "pathest/location.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+/// @brief Estimates and metrics of a compact path.
+///
+/// Each estimate decodes the locations once, into the memory of its result,
+/// and then runs the estimator of the Path function of the same name in
+/// place, so it gives the same result without an intermediate path. Metrics
+/// decode one location at a time and allocate nothing.
+///
+/// @tparam Compact The compact path class, which derives from this one and
+///   has begin(), end(), size() and decode().
+template <typename Compact>
+class CompactPlayback {
+ public:
+  /// @defgroup Playback
+  ///
+  /// Estimated paths, as from the Path functions of the same names. The
+  /// result is allocated from the given resource.
+  ///
+  /// @{
+  Path sma_path(const int samples, std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource()) const {
+    Path out = this->compact().decode(resource);
+    out.sma_in_place(samples);
+    return out;
+  }
+  Path tma_path(const double duration, std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource()) const {
+    Path out = this->compact().decode(resource);
+    out.tma_in_place(duration);
+    return out;
+  }
+  Path es_path(const double smoothing, std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource()) const {
+    Path out = this->compact().decode(resource);
+    out.es_in_place(smoothing);
+    return out;
+  }
+  Path kf_path(std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource()) const {
+    Path out = this->compact().decode(resource);
+    out.kf_in_place();
+    return out;
+  }
+  Path rts_path(std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource()) const {
+    Path out = this->compact().decode(resource);
+    out.rts_in_place();
+    return out;
+  }
+  /// @}
+
+  /// Calculate the length of the path, like Path::distance().
+  double distance() const {
+    typename Compact::const_iterator it = this->compact().begin();
+    const typename Compact::const_iterator end = this->compact().end();
+    if (it == end) return 0;
+    Location prev = *it;
+    double total = 0;
+    for (++it; it != end; ++it) {
+      Location curr = *it;
+      double dx = curr.x() - prev.x();
+      double dy = curr.y() - prev.y();
+      total += sqrt(dx * dx + dy * dy);
+      prev = curr;
+    }
+    return total;
+  }
+
+  /// Calculate the average speed from the first location, like
+  /// Path::avg_speed(). Returns zero for fewer than two locations.
+  double avg_speed() const {
+    typename Compact::const_iterator it = this->compact().begin();
+    const typename Compact::const_iterator end = this->compact().end();
+    if (it == end) return 0;
+    const Location first = *it;
+    double speed = 0;
+    double speeds = 0;
+    for (++it; it != end; ++it) {
+      Location curr = *it;
+      if (curr.t() == first.t()) continue;
+      double dx = curr.x() - first.x();
+      double dy = curr.y() - first.y();
+      speed += sqrt(dx * dx + dy * dy) / (curr.t() - first.t());
+      ++speeds;
+    }
+    return speeds ? speed / speeds : 0;
+  }
+
+ private:
+  const Compact &compact() const {
+    return static_cast<const Compact &>(*this);
+  }
+};
+
+class Float32Path : public CompactPlayback<Float32Path> {
+ public:
+  /// @brief Store coordinates as floats.
+  ///
+  /// @param path The locations, in chronological order.
+  /// @param resource The memory resource for the locations.
+  explicit Float32Path(PathView path, std::pmr::memory_resource *resource =
+                       std::pmr::get_default_resource());
+  ~Float32Path() {}
+
+  class const_iterator {
+   public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Location value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const Location *pointer;
+    typedef Location reference;
+
+    const_iterator(const Float32Path *path, const size_t i) :
+      path_(path), i_(i) {}
+
+    Location operator*() const { return (*this->path_)[this->i_]; }
+    const_iterator &operator++() {
+      ++this->i_;
+      return *this;
+    }
+    bool operator==(const const_iterator &other) const {
+      return this->i_ == other.i_;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return this->i_ != other.i_;
+    }
+
+   private:
+    const Float32Path *path_;
+    size_t i_;
+  };
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, this->size()); }
+
+  bool empty() const;
+  size_t size() const;
+  size_t bytes() const;  //< Memory used by the locations, in bytes.
+
+  /// Decode a location by index. Undefined behavior when out of range.
+  Location operator[](const size_t i) const {
+    const Packed &p = this->data_[i];
+    return Location(this->origin_x_ + p.x, this->origin_y_ + p.y, p.t);
+  }
+
+  /// Decode all locations into a path.
+  Path decode(std::pmr::memory_resource *resource =
+              std::pmr::get_default_resource()) const;
+
+ private:
+  struct Packed {
+    double t;
+    float x;
+    float y;
+  };
+
+  double origin_x_;  //< x coordinate of the first location.
+  double origin_y_;  //< y coordinate of the first location.
+  std::pmr::vector<Packed> data_;  //< Locations relative to the origin.
+};
+
+class DeltaPath : public CompactPlayback<DeltaPath> {
+ public:
+  /// @brief Store locations as compressed differences.
+  ///
+  /// Coordinates are rounded to the nearest multiple of resolution and
+  /// timestamps to the nearest multiple of time_resolution. Undefined
+  /// behavior when a rounded value does not fit in 63 bits.
+  ///
+  /// @param path The locations, in chronological order.
+  /// @param resolution The precision of coordinates.
+  /// @param time_resolution The precision of timestamps.
+  /// @param resource The memory resource for the blocks.
+  DeltaPath(PathView path, const double resolution,
+            const double time_resolution,
+            std::pmr::memory_resource *resource =
+            std::pmr::get_default_resource());
+  ~DeltaPath() {}
+
+  static const size_t kBlockSize = 256;  //< Locations per block.
+
+  // Bounds and position of a block of locations, after rounding.
+  struct Block {
+    size_t offset;  //< Offset of the first difference in the byte stream.
+    size_t count;  //< Number of locations.
+    // Rounded coordinates and timestamp of the first location.
+    int64_t first_x;
+    int64_t first_y;
+    int64_t first_t;
+    // Bounds of the decoded locations.
+    double min_x;
+    double max_x;
+    double min_y;
+    double max_y;
+    double min_t;
+    double max_t;
+  };
+
+  class const_iterator {
+   public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Location value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const Location *pointer;
+    typedef Location reference;
+
+    const_iterator(const DeltaPath *path, const size_t block);
+
+    Location operator*() const;
+    const_iterator &operator++();
+    bool operator==(const const_iterator &other) const {
+      return this->block_ == other.block_ && this->i_ == other.i_;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return !(*this == other);
+    }
+
+   private:
+    const DeltaPath *path_;
+    size_t block_;  //< Index of the current block.
+    size_t i_;  //< Index of the current location within the block.
+    const uint8_t *next_;  //< Next difference to decode.
+    // Rounded coordinates and timestamp of the current location.
+    int64_t x_;
+    int64_t y_;
+    int64_t t_;
+
+    void start_block();  //< Load the first location of the current block.
+  };
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const {
+    return const_iterator(this, this->blocks_.size());
+  }
+
+  /// @brief Find the first location at or after a time.
+  ///
+  /// Skips whole blocks by their bounds, then decodes within one block.
+  ///
+  /// @param time The time.
+  /// @returns an iterator to the location, or end() if there is none.
+  const_iterator seek(const double time) const;
+
+  bool empty() const;
+  size_t size() const;
+  size_t bytes() const;  //< Memory used by blocks and differences, in bytes.
+  const std::pmr::vector<Block> &blocks() const;
+
+  /// Decode all locations into a path.
+  Path decode(std::pmr::memory_resource *resource =
+              std::pmr::get_default_resource()) const;
+
+ private:
+  double resolution_;  //< Precision of coordinates.
+  double time_resolution_;  //< Precision of timestamps.
+  size_t size_;  //< Number of locations.
+  std::pmr::vector<Block> blocks_;  //< Blocks in time order.
+  std::pmr::vector<uint8_t> stream_;  //< Zigzag varint differences.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_COMPACT_PATH_H_
@@ -0,0 +1,75 @@
+/// @file pathest/estimator_state.cc
+/// @brief Saved estimator state, and a file of saved states by track id.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/estimator_state.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pathest/indexed_file.h"
+
+namespace pathest {
+
+namespace {
+
+// States are restored one track after another, in order of id, so readahead
+// helps.
+const IndexedFileFormat format = {{'P', 'S', 'T', 'M'}, 1, false};
+
+static_assert(sizeof(StateHeader) == 8, "state headers must be packed");
+static_assert(sizeof(StateEntry) == 24, "index entries must be packed");
+
+// Check whether a state fits in the rest of the file.
+bool state_fits(const StateEntry &entry, const uint64_t available) {
+  return entry.size <= available;
+}
+
+}  // namespace
+
+bool is_state_map(const void *buf, const size_t len) {
+  return has_indexed_file_magic(format, buf, len);
+}
+
+StateMapWriter::StateMapWriter() : file_(format), buffer_() {}
+
+bool StateMapWriter::open(const char *filename, const size_t num_states) {
+  return this->file_.open(filename, num_states);
+}
+
+bool StateMapWriter::add(const uint64_t id, const void *state,
+                         const size_t size) {
+  if (!this->file_.can_add() || (!state && size)) return false;
+  StateEntry entry;
+  entry.id = id;
+  entry.offset = this->file_.offset();
+  entry.size = size;
+  return this->file_.write(state, size) && this->file_.add(entry);
+}
+
+bool StateMapWriter::close() {
+  return this->file_.close();
+}
+
+StateMap::StateMap() : file_(format) {}
+
+bool StateMap::open(const char *filename) {
+  return this->file_.open(filename, state_fits);
+}
+
+void StateMap::close() {
+  this->file_.close();
+}
+
+bool StateMap::empty() const { return this->file_.empty(); }
+size_t StateMap::size() const { return this->file_.size(); }
+
+const StateEntry *StateMap::find(const uint64_t id) const {
+  return this->file_.find(id);
+}
+
+const void *StateMap::state(const StateEntry &entry) const {
+  return this->file_.record(entry);
+}
+
+}  // namespace pathest
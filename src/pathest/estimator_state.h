@@ -0,0 +1,190 @@
+/// @file pathest/estimator_state.h
+/// @brief Saved estimator state, and a file of saved states by track id.
+///
+/// SimpleMovingAverage, ExponentialSmoothing and KalmanFilter can save their
+/// state to a buffer and restore it later, so that a restarted service picks
+/// up every track where it left off instead of replaying its history. Each
+/// saved state starts with a StateHeader naming the estimator, followed by
+/// the fields of that estimator, all 8-byte aligned. A state only restores
+/// into an estimator of the same kind and parameters.
+///
+/// A state map holds the saved states of many tracks behind an index sorted by
+/// id, in the same way as a track archive (see pathest/track_archive.h). A
+/// reader maps the file and restores each track from its state in place, so
+/// opening the map costs one pass over the index and restoring a track touches
+/// only its own pages. A state map is an indexed file (see
+/// pathest/indexed_file.h) laid out as:
+///
+///   char     magic[4]    "PSTM"
+///   uint32_t version     1
+///   uint64_t count       Number of states.
+///   Entry    index[n]    One entry per track, in increasing order of id.
+///   char     data[...]   The states, each padded to a multiple of 8 bytes.
+///
+/// Each index entry is:
+///
+///   uint64_t id          Track id.
+///   uint64_t offset      Offset of the state from the start of the file.
+///   uint64_t size        Size of the state in bytes, before padding.
+///
+/// All fields use the byte order of the host that wrote the file.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_ESTIMATOR_STATE_H_
+#define PATHEST_ESTIMATOR_STATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "pathest/indexed_file.h"
+
+namespace pathest {
+
+/// Kinds of estimator with saved state.
+enum StateKind {
+  kSimpleMovingAverageState = 1,
+  kExponentialSmoothingState = 2,
+  kKalmanFilterState = 3
+};
+
+/// Header of every saved state.
+struct StateHeader {
+  uint32_t kind;  //< StateKind of the estimator.
+  uint32_t version;  //< Version of the estimator's layout.
+};
+
+/// Size in bytes of the state map header.
+const size_t kStateMapHeaderSize = kIndexedFileHeaderSize;
+
+/// @brief Check whether a buffer starts with a state map header.
+///
+/// @param buf The buffer.
+/// @param len The number of bytes in the buffer.
+bool is_state_map(const void *buf, const size_t len);
+
+/// Index entry of one state in a state map.
+struct StateEntry {
+  uint64_t id;  //< Track id.
+  uint64_t offset;  //< Offset of the state in the file, in bytes.
+  uint64_t size;  //< Size of the state in bytes.
+};
+
+/// @brief Writer of a state map.
+///
+/// States are appended in any order of id, and the index is written, sorted by
+/// id, when the map is closed. The number of states must be known when the map
+/// is opened, so that the states can follow the index directly. The map is
+/// written under a temporary name and only replaces an existing file once it
+/// is closed successfully, so a crash while saving keeps the previous map.
+class StateMapWriter {
+ public:
+  StateMapWriter();
+  ~StateMapWriter() {}  //< Closes the map if it is still open.
+
+  StateMapWriter(const StateMapWriter &) = delete;
+  StateMapWriter &operator=(const StateMapWriter &) = delete;
+
+  /// @brief Create a state map file.
+  ///
+  /// @param filename The file to create.
+  /// @param num_states The number of states that will be added.
+  /// @returns true if successful, false otherwise.
+  bool open(const char *filename, const size_t num_states);
+
+  /// @brief Append a saved state.
+  ///
+  /// @param id The track id, different from that of every other state.
+  /// @param state The saved state.
+  /// @param size The size of the state in bytes.
+  /// @returns true if successful, false otherwise, including when more states
+  ///   are added than were given to open().
+  bool add(const uint64_t id, const void *state, const size_t size);
+
+  /// @brief Save the state of an estimator and append it.
+  ///
+  /// @param id The track id, different from that of every other state.
+  /// @param estimator The estimator.
+  /// @returns true if successful, false otherwise.
+  template <typename Estimator>
+  bool add(const uint64_t id, const Estimator &estimator) {
+    this->buffer_.resize(estimator.state_size());
+    estimator.save_state(this->buffer_.data());
+    return this->add(id, this->buffer_.data(), this->buffer_.size());
+  }
+
+  /// @brief Write the index and close the file.
+  ///
+  /// @returns true if successful, false otherwise, including when fewer states
+  ///   were added than were given to open() or two states share an id.
+  bool close();
+
+ private:
+  IndexedFileWriter<StateEntry> file_;  //< Writer of the map file.
+  std::vector<unsigned char> buffer_;  //< Buffer for saving estimators.
+};
+
+/// @brief Reader of a state map.
+///
+/// The file is mapped read-only, and estimators are restored from the states
+/// in place. A state map is safe to read from multiple threads at once.
+class StateMap {
+ public:
+  StateMap();
+  ~StateMap() {}  //< Unmaps the file.
+
+  StateMap(const StateMap &) = delete;
+  StateMap &operator=(const StateMap &) = delete;
+
+  /// @brief Map a state map file.
+  ///
+  /// Checks the header and that the index is sorted and within the file.
+  ///
+  /// @param filename The file to map.
+  /// @returns true if successful, false otherwise.
+  bool open(const char *filename);
+
+  void close();  //< Unmap the file. Pointers to its states become invalid.
+
+  bool empty() const;
+  size_t size() const;  //< Number of states.
+
+  /// Get an index entry by position, in increasing order of id.
+  const StateEntry &operator[](const size_t i) const {
+    return this->file_[i];
+  }
+
+  /// @brief Find a state by id.
+  ///
+  /// @param id The track id.
+  /// @returns the index entry, or NULL if there is no such state.
+  const StateEntry *find(const uint64_t id) const;
+
+  /// @brief Get a saved state in place.
+  ///
+  /// @param entry An index entry of this map.
+  /// @returns the state, valid until the map is closed.
+  const void *state(const StateEntry &entry) const;
+
+  /// @brief Restore an estimator from the state of a track.
+  ///
+  /// @param id The track id.
+  /// @param estimator The estimator, constructed with the parameters of the
+  ///   one that was saved.
+  /// @returns true if successful, false if there is no such state or it does
+  ///   not match the estimator, which is then left unchanged.
+  template <typename Estimator>
+  bool restore(const uint64_t id, Estimator *estimator) const {
+    const StateEntry *entry = this->find(id);
+    return entry && estimator &&
+      estimator->restore_state(this->state(*entry), entry->size);
+  }
+
+ private:
+  IndexedFile<StateEntry> file_;  //< Mapped map file.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_ESTIMATOR_STATE_H_
@@ -6,40 +6,140 @@
 #include "pathest/exponential_smoothing.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
 #include <vector>
 
+#include "pathest/estimator_state.h"
 #include "pathest/location.h"
+#include "pathest/parallel.h"
 
 namespace pathest {
 
-double ExponentialSmoothing::smooth(const double meas, const double pred) {
-  return this->smoothing_ * meas + (1 - this->smoothing_) * pred;
-}
+namespace {
+
+const uint32_t state_version = 1;
+
+// Layout of a saved state.
+struct SavedState {
+  StateHeader header;
+  uint64_t first;
+  double smoothing;
+  double pred_x;
+  double pred_y;
+};
+
+}  // namespace
 
 ExponentialSmoothing::ExponentialSmoothing(const double smoothing) :
-  first_(true),
-  pred_x_(0),
-  pred_y_(0),
+  pred_(),
   smoothing_(smoothing) {}
 
 Location ExponentialSmoothing::predict(const Location &loc) {
   if ((this->smoothing_ <= 0) || (this->smoothing_ >= 1.0)) return loc;
+  return this->pred_.add(loc, this->smoothing_);
+}
+
+size_t ExponentialSmoothing::state_size() const {
+  return sizeof(SavedState);
+}
+
+void ExponentialSmoothing::save_state(void *buf) const {
+  SavedState state;
+  state.header.kind = kExponentialSmoothingState;
+  state.header.version = state_version;
+  state.first = this->pred_.first;
+  state.smoothing = this->smoothing_;
+  state.pred_x = this->pred_.pred_x;
+  state.pred_y = this->pred_.pred_y;
+  memcpy(buf, &state, sizeof(state));
+}
+
+bool ExponentialSmoothing::restore_state(const void *buf, const size_t len) {
+  if (!buf || len != sizeof(SavedState)) return false;
+  SavedState state;
+  memcpy(&state, buf, sizeof(state));
+  if (state.header.kind != kExponentialSmoothingState ||
+      state.header.version != state_version ||
+      state.smoothing != this->smoothing_ || state.first > 1) {
+    return false;
+  }
+  this->pred_.first = state.first;
+  this->pred_.pred_x = state.pred_x;
+  this->pred_.pred_y = state.pred_y;
+  return true;
+}
+
+void ExponentialSmoothing::smooth_in_place(const double smoothing,
+                                           Location *locations,
+                                           const size_t n, unsigned threads) {
+  if ((smoothing <= 0) || (smoothing >= 1.0)) return;
+  if (!threads) threads = default_threads();
+  if (threads > n / kMinChunk) threads = n / kMinChunk;
+  if (threads < 2) {
+    ExponentialSmoothing es(smoothing);
+    for (size_t i = 0; i < n; ++i) locations[i] = es.predict(locations[i]);
+    return;
+  }
+
+  // With b = 1 - smoothing, a chunk starting at k has the exact values
+  // s(i) = l(i) + b^(i - k + 1) s(k - 1), where l is smoothed from zero.
+  const double decay = 1 - smoothing;
+  struct Carry {
+    double x;  //< Last smoothed x coordinate of the chunk.
+    double y;  //< Last smoothed y coordinate of the chunk.
+    double decay;  //< Decay across the whole chunk.
+  };
+  std::vector<Carry> carries(threads);
+  size_t chunks = parallel_for(n, threads,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    size_t i = begin;
+    double pred_x = 0;
+    double pred_y = 0;
+    if (!chunk) {
+      pred_x = locations[0].x();
+      pred_y = locations[0].y();
+      ++i;
+    }
+    // Not a running product, which would slow down once it became subnormal.
+    double chunk_decay = pow(decay, static_cast<double>(end - i));
+    for (; i < end; ++i) {
+      pred_x = exponential_smooth(smoothing, locations[i].x(), pred_x);
+      pred_y = exponential_smooth(smoothing, locations[i].y(), pred_y);
+      locations[i] = Location(pred_x, pred_y, locations[i].t());
+    }
+    Carry carry = { pred_x, pred_y, chunk_decay };
+    carries[chunk] = carry;
+  });
 
-  double x = loc.x();
-  double y = loc.y();
-  if (this->first_) {
-    this->first_ = false;
-    this->pred_x_ = x;
-    this->pred_y_ = y;
-  } else {
-    this->pred_x_ = this->smooth(x, this->pred_x_);
-    this->pred_y_ = this->smooth(y, this->pred_y_);
+  // Turn the local end values into exact ones, in chunk order.
+  for (size_t c = 1; c < chunks; ++c) {
+    carries[c].x += carries[c].decay * carries[c - 1].x;
+    carries[c].y += carries[c].decay * carries[c - 1].y;
   }
 
-  double pred_x = this->pred_x_;
-  double pred_y = this->pred_y_;
-  return Location(pred_x, pred_y, loc.t());
+  parallel_for(n, threads,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    if (!chunk) return;
+    const Carry &carry = carries[chunk - 1];
+    double weight = decay;
+    for (size_t i = begin; i < end && weight >= DBL_MIN; ++i) {
+      double dx = weight * carry.x;
+      double dy = weight * carry.y;
+      // Stop once the correction is within rounding of the values. It only
+      // shrinks from here, so the rest of the chunk would barely change.
+      if (fabs(dx) <= DBL_EPSILON * fabs(locations[i].x()) &&
+          fabs(dy) <= DBL_EPSILON * fabs(locations[i].y())) {
+        break;
+      }
+      locations[i] = Location(locations[i].x() + dx, locations[i].y() + dy,
+                              locations[i].t());
+      weight *= decay;
+    }
+  });
 }
 
 }  // namespace pathest
@@ -5,10 +5,51 @@
 #ifndef PATHEST_EXPONENTIAL_SMOOTHING_H_
 #define PATHEST_EXPONENTIAL_SMOOTHING_H_
 
+#include <stddef.h>
+
 #include "pathest/location.h"
 
 namespace pathest {
 
+/// @brief Smooth one coordinate.
+///
+/// @param smoothing The smoothing factor, the weight of the measurement.
+/// @param meas The measured value.
+/// @param pred The last smoothed value.
+inline double exponential_smooth(const double smoothing, const double meas,
+                                 const double pred) {
+  return smoothing * meas + (1 - smoothing) * pred;
+}
+
+/// @brief Last prediction of exponential smoothing.
+///
+/// Holds the update rule shared by ExponentialSmoothing and
+/// InlineExponentialSmoothing (see pathest/pipeline.h). Defined inline so that
+/// pipeline stages inline it.
+struct SmoothedPrediction {
+  SmoothedPrediction() : first(true), pred_x(0), pred_y(0) {}
+
+  /// @brief Smooth the next location.
+  ///
+  /// @param loc The location, in chronological order.
+  /// @param smoothing The smoothing factor, in (0, 1).
+  Location add(const Location &loc, const double smoothing) {
+    if (this->first) {
+      this->first = false;
+      this->pred_x = loc.x();
+      this->pred_y = loc.y();
+    } else {
+      this->pred_x = exponential_smooth(smoothing, loc.x(), this->pred_x);
+      this->pred_y = exponential_smooth(smoothing, loc.y(), this->pred_y);
+    }
+    return Location(this->pred_x, this->pred_y, loc.t());
+  }
+
+  bool first;  //< Whether or not the first data point has been processed yet.
+  double pred_x;  //< Last-predicted x coordinate.
+  double pred_y;  //< Last-predicted y coordinate.
+};
+
 class ExponentialSmoothing {
  public:
   explicit ExponentialSmoothing(const double smoothing);
@@ -17,12 +58,43 @@ class ExponentialSmoothing {
   /// Predict the next location in chronological order.
   Location predict(const Location &loc);
 
+  /// Size in bytes of the saved state.
+  size_t state_size() const;
+
+  /// @brief Save the state, as described in pathest/estimator_state.h.
+  ///
+  /// @param buf The buffer, of at least state_size() bytes.
+  void save_state(void *buf) const;
+
+  /// @brief Restore a state saved by an estimator with the same smoothing factor.
+  ///
+  /// @param buf The saved state.
+  /// @param len The size of the saved state in bytes.
+  /// @returns true if successful, false if the state is not valid for this
+  ///   estimator, which is then left unchanged.
+  bool restore_state(const void *buf, const size_t len);
+
+  /// @brief Smooth a sequence of locations in place.
+  ///
+  /// Gives the same result as calling predict() on each location in order,
+  /// up to rounding. Smoothing is an affine recurrence, so long sequences are
+  /// split into chunks that are smoothed in parallel from a zero start, after
+  /// which each chunk is corrected by the decayed end value of the one before.
+  /// Sequences shorter than two chunks of kMinChunk locations are smoothed on
+  /// the calling thread alone.
+  ///
+  /// @param smoothing The smoothing factor.
+  /// @param locations The locations, in chronological order.
+  /// @param n The number of locations.
+  /// @param threads The number of threads, or zero for the default.
+  static void smooth_in_place(const double smoothing, Location *locations,
+                              const size_t n, unsigned threads);
+
+  static const size_t kMinChunk = 64 * 1024;  //< Locations per thread.
+
  private:
-  bool first_;  //< Whether or not the first data point has been processed yet.
-  double pred_x_;  //< Last-predicted x coordinate.
-  double pred_y_;  //< Last-predicted y coordinate.
+  SmoothedPrediction pred_;  //< Last prediction.
   double smoothing_;  //< Smoothing factor.
-  double smooth(const double meas, const double pred);  //< Apply smoothing.
 };
 
 }  // namespace pathest
@@ -0,0 +1,269 @@
+/// @file pathest/expression.cc
+/// @brief Class for evaluating a mathematical function of x.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/expression.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace pathest {
+
+namespace {
+
+struct Function1 {
+  const char *name;
+  double (*fn)(double);
+};
+
+struct Function2 {
+  const char *name;
+  double (*fn)(double, double);
+};
+
+struct Constant {
+  const char *name;
+  double value;
+};
+
+// Wrappers so that overloaded library functions have a single address.
+double fn_sin(double v) { return sin(v); }
+double fn_cos(double v) { return cos(v); }
+double fn_tan(double v) { return tan(v); }
+double fn_asin(double v) { return asin(v); }
+double fn_acos(double v) { return acos(v); }
+double fn_atan(double v) { return atan(v); }
+double fn_sinh(double v) { return sinh(v); }
+double fn_cosh(double v) { return cosh(v); }
+double fn_tanh(double v) { return tanh(v); }
+double fn_sqrt(double v) { return sqrt(v); }
+double fn_exp(double v) { return exp(v); }
+double fn_log(double v) { return log(v); }
+double fn_log10(double v) { return log10(v); }
+double fn_fabs(double v) { return fabs(v); }
+double fn_floor(double v) { return floor(v); }
+double fn_ceil(double v) { return ceil(v); }
+double fn_pow(double a, double b) { return pow(a, b); }
+double fn_atan2(double a, double b) { return atan2(a, b); }
+
+const Function1 functions1[] = {
+  {"sin", fn_sin}, {"cos", fn_cos}, {"tan", fn_tan}, {"asin", fn_asin},
+  {"acos", fn_acos}, {"atan", fn_atan}, {"sinh", fn_sinh}, {"cosh", fn_cosh},
+  {"tanh", fn_tanh}, {"sqrt", fn_sqrt}, {"exp", fn_exp}, {"log", fn_log},
+  {"log10", fn_log10}, {"fabs", fn_fabs}, {"abs", fn_fabs},
+  {"floor", fn_floor}, {"ceil", fn_ceil}
+};
+
+const Function2 functions2[] = {{"pow", fn_pow}, {"atan2", fn_atan2}};
+
+const Constant constants[] = {{"pi", M_PI}, {"e", M_E}};
+
+// Python's float modulo: the remainder takes the sign of the divisor, and a
+// zero remainder is signed like it too.
+double mod(const double a, const double b) {
+  double r = fmod(a, b);
+  if (r == 0) return copysign(0.0, b);
+  return (r < 0) != (b < 0) ? r + b : r;
+}
+
+void skip_space(const char **pos) {
+  while (isspace(static_cast<unsigned char>(**pos))) ++*pos;
+}
+
+// Consume a token if it is next in the input.
+bool accept(const char **pos, const char *token) {
+  skip_space(pos);
+  size_t len = strlen(token);
+  if (strncmp(*pos, token, len)) return false;
+  *pos += len;
+  return true;
+}
+
+}  // namespace
+
+Expression::Expression() : code_(std::vector<Instruction>()), depth_(0),
+                           valid_(false) {}
+
+bool Expression::parse(const char *text) {
+  this->code_.clear();
+  this->depth_ = 0;
+  this->valid_ = false;
+  if (!text) return false;
+  const char *pos = text;
+  if (!this->parse_sum(&pos)) return false;
+  skip_space(&pos);
+  if (*pos != '\0') return false;
+#ifdef DEBUG
+  assert(this->depth_ == 1);
+#endif
+  this->valid_ = true;
+  return true;
+}
+
+double Expression::evaluate(const double x) const {
+  if (!this->valid_) return 0;
+  double stack[kMaxDepth];
+  size_t top = 0;
+  for (std::vector<Instruction>::const_iterator it = this->code_.begin();
+       it != this->code_.end(); ++it) {
+    switch (it->op) {
+      case kConst: stack[top++] = it->value; break;
+      case kVar: stack[top++] = x; break;
+      case kNeg: stack[top - 1] = -stack[top - 1]; break;
+      case kAdd: --top; stack[top - 1] += stack[top]; break;
+      case kSub: --top; stack[top - 1] -= stack[top]; break;
+      case kMul: --top; stack[top - 1] *= stack[top]; break;
+      case kDiv: --top; stack[top - 1] /= stack[top]; break;
+      case kMod: --top; stack[top - 1] = mod(stack[top - 1], stack[top]);
+        break;
+      case kPow: --top; stack[top - 1] = pow(stack[top - 1], stack[top]);
+        break;
+      case kPowInt: {
+        double base = stack[top - 1];
+        double result = 1.0;
+        for (int n = static_cast<int>(it->value); n > 0; --n) result *= base;
+        stack[top - 1] = result;
+        break;
+      }
+      case kCall1: stack[top - 1] = it->fn1(stack[top - 1]); break;
+      case kCall2: --top; stack[top - 1] = it->fn2(stack[top - 1], stack[top]);
+        break;
+    }
+  }
+  return stack[0];
+}
+
+bool Expression::emit(const Opcode op, const double value,
+                      double (*fn1)(double), double (*fn2)(double, double)) {
+  switch (op) {
+    case kConst:
+    case kVar:
+      if (++this->depth_ > kMaxDepth) return false;
+      break;
+    case kNeg:
+    case kPowInt:
+    case kCall1:
+      break;
+    default:
+      --this->depth_;
+      break;
+  }
+  Instruction ins = {op, value, fn1, fn2};
+  this->code_.push_back(ins);
+  return true;
+}
+
+bool Expression::parse_sum(const char **pos) {
+  if (!this->parse_product(pos)) return false;
+  while (true) {
+    if (accept(pos, "+")) {
+      if (!this->parse_product(pos) || !this->emit(kAdd)) return false;
+    } else if (accept(pos, "-")) {
+      if (!this->parse_product(pos) || !this->emit(kSub)) return false;
+    } else {
+      return true;
+    }
+  }
+}
+
+bool Expression::parse_product(const char **pos) {
+  if (!this->parse_unary(pos)) return false;
+  while (true) {
+    skip_space(pos);
+    if ((*pos)[0] == '*' && (*pos)[1] == '*') return true;  // Power operator.
+    if (accept(pos, "*")) {
+      if (!this->parse_unary(pos) || !this->emit(kMul)) return false;
+    } else if (accept(pos, "/")) {
+      if (!this->parse_unary(pos) || !this->emit(kDiv)) return false;
+    } else if (accept(pos, "%")) {
+      if (!this->parse_unary(pos) || !this->emit(kMod)) return false;
+    } else {
+      return true;
+    }
+  }
+}
+
+bool Expression::parse_unary(const char **pos) {
+  if (accept(pos, "-")) {
+    return this->parse_unary(pos) && this->emit(kNeg);
+  } else if (accept(pos, "+")) {
+    return this->parse_unary(pos);
+  } else {
+    return this->parse_power(pos);
+  }
+}
+
+bool Expression::parse_power(const char **pos) {
+  if (!this->parse_primary(pos)) return false;
+  // Exponentiation is right associative and binds tighter than unary minus
+  // on its left, as in Python: -x ** 2 == -(x ** 2).
+  if (accept(pos, "**")) {
+    if (!this->parse_unary(pos)) return false;
+    // Small constant integer powers such as x ** 3 are common in curves and
+    // are much cheaper as repeated multiplication.
+    Instruction &exponent = this->code_.back();
+    if (exponent.op == kConst && exponent.value >= 0 &&
+        exponent.value <= kMaxPowInt &&
+        exponent.value == floor(exponent.value)) {
+      exponent.op = kPowInt;
+      --this->depth_;
+      return true;
+    }
+    return this->emit(kPow);
+  }
+  return true;
+}
+
+bool Expression::parse_primary(const char **pos) {
+  skip_space(pos);
+  if (accept(pos, "(")) {
+    return this->parse_sum(pos) && accept(pos, ")");
+  }
+
+  if (isdigit(static_cast<unsigned char>(**pos)) || **pos == '.') {
+    char *end = NULL;
+    double value = strtod(*pos, &end);
+    if (end == *pos) return false;
+    *pos = end;
+    return this->emit(kConst, value);
+  }
+
+  if (!isalpha(static_cast<unsigned char>(**pos)) && **pos != '_') {
+    return false;
+  }
+  accept(pos, "math.");
+  const char *start = *pos;
+  while (isalnum(static_cast<unsigned char>(**pos)) || **pos == '_') ++*pos;
+  size_t len = *pos - start;
+
+  if (len == 1 && *start == 'x') return this->emit(kVar);
+  for (size_t i = 0; i < sizeof(constants) / sizeof(constants[0]); ++i) {
+    if (strlen(constants[i].name) == len &&
+        !strncmp(start, constants[i].name, len)) {
+      return this->emit(kConst, constants[i].value);
+    }
+  }
+  for (size_t i = 0; i < sizeof(functions1) / sizeof(functions1[0]); ++i) {
+    if (strlen(functions1[i].name) == len &&
+        !strncmp(start, functions1[i].name, len)) {
+      return accept(pos, "(") && this->parse_sum(pos) && accept(pos, ")") &&
+        this->emit(kCall1, 0, functions1[i].fn);
+    }
+  }
+  for (size_t i = 0; i < sizeof(functions2) / sizeof(functions2[0]); ++i) {
+    if (strlen(functions2[i].name) == len &&
+        !strncmp(start, functions2[i].name, len)) {
+      return accept(pos, "(") && this->parse_sum(pos) && accept(pos, ",") &&
+        this->parse_sum(pos) && accept(pos, ")") &&
+        this->emit(kCall2, 0, NULL, functions2[i].fn);
+    }
+  }
+  return false;
+}
+
+}  // namespace pathest
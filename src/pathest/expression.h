@@ -0,0 +1,77 @@
+/// @file pathest/expression.h
+/// @brief Class for evaluating a mathematical function of x.
+///
+/// Accepts the same expressions as the Python generator, e.g.
+/// "50 * math.sin(x / 20)" or "math.sqrt(x) + (((x - 100) ** 3) / 10000)".
+/// The "math." prefix is optional. Supported operators are + - * / % and **,
+/// with Python's precedence and results: % takes the sign of its divisor, as
+/// Python's float modulo does. ^ is rejected, as Python only defines it as the
+/// bitwise exclusive or of integers. Supported names are x, pi, e, and the
+/// functions sin, cos, tan, asin, acos, atan, sinh, cosh, tanh, sqrt, exp, log,
+/// log10, fabs, abs, floor, ceil, and the two-argument pow and atan2.
+///
+/// Expressions are compiled once to a postfix program so that evaluation does
+/// no parsing or allocation. Evaluation is safe from multiple threads.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_EXPRESSION_H_
+#define PATHEST_EXPRESSION_H_
+
+#include <stddef.h>
+#include <vector>
+
+namespace pathest {
+
+class Expression {
+ public:
+  Expression();
+  ~Expression() {}
+
+  /// @brief Compile an expression.
+  ///
+  /// @param text The expression as a null-terminated string.
+  /// @returns true if successful, false if the expression is invalid.
+  bool parse(const char *text);
+
+  /// @brief Evaluate the compiled expression.
+  ///
+  /// Returns zero if no expression has been compiled.
+  ///
+  /// @param x The value of the variable x.
+  double evaluate(const double x) const;
+
+ private:
+  enum Opcode {
+    kConst, kVar, kNeg, kAdd, kSub, kMul, kDiv, kMod, kPow, kPowInt, kCall1,
+    kCall2
+  };
+
+  struct Instruction {
+    Opcode op;
+    double value;  //< Constant value for kConst, exponent for kPowInt.
+    double (*fn1)(double);  //< Function for kCall1.
+    double (*fn2)(double, double);  //< Function for kCall2.
+  };
+
+  static const size_t kMaxDepth = 64;  //< Evaluation stack size.
+  static const int kMaxPowInt = 16;  //< Largest exponent to multiply out.
+
+  std::vector<Instruction> code_;  //< Postfix program.
+  size_t depth_;  //< Current stack depth while compiling.
+  bool valid_;  //< Whether or not the compilation succeeded.
+
+  // Recursive descent parser, one function per precedence level.
+  bool parse_sum(const char **pos);
+  bool parse_product(const char **pos);
+  bool parse_unary(const char **pos);
+  bool parse_power(const char **pos);
+  bool parse_primary(const char **pos);
+  bool emit(const Opcode op, const double value = 0,
+            double (*fn1)(double) = NULL,
+            double (*fn2)(double, double) = NULL);
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_EXPRESSION_H_
@@ -0,0 +1,86 @@
+/// @file pathest/generator.cc
+/// @brief Class for generating synthetic paths.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/generator.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <random>
+
+#include "pathest/expression.h"
+#include "pathest/path.h"
+
+namespace pathest {
+
+namespace {
+
+// Precision of the search for the next point, the same as the Python
+// generator, and an upper bound on the number of bisection steps.
+const double search_precision = 1e-10;
+const int search_steps = 64;
+
+// Mix the seed and track number into a well distributed 64-bit seed.
+uint64_t splitmix64(uint64_t value) {
+  value += 0x9e3779b97f4a7c15ULL;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+}  // namespace
+
+const double Generator::kStdevDistance = 14.4841;
+const double Generator::kSpeed = 200.0 / 60.0;
+
+Generator::Generator(const Expression &curve, const double start,
+                     const size_t num, const uint64_t seed) :
+  curve_(curve), start_(start), num_(num), seed_(seed) {}
+
+void Generator::next(const double prev_x, const double prev_y,
+                     const double dist, double *x, double *y) const {
+  // Bisect on x for the point whose straight-line distance from the previous
+  // point equals the distance travelled.
+  double min_x = prev_x;
+  double max_x = prev_x + dist;
+  for (int i = 0; i < search_steps && max_x - min_x > search_precision;
+       ++i) {
+    double med_x = (min_x + max_x) / 2;
+    double med_y = this->curve_.evaluate(med_x);
+    double dx = med_x - prev_x;
+    double dy = med_y - prev_y;
+    double radius = sqrt(dx * dx + dy * dy);
+    if (radius < dist) {
+      min_x = med_x;
+    } else if (radius > dist) {
+      max_x = med_x;
+    } else {
+      min_x = max_x = med_x;
+    }
+  }
+  *x = min_x;
+  *y = this->curve_.evaluate(min_x);
+}
+
+void Generator::generate(const uint64_t track, Path *ref, Path *input) const {
+  std::mt19937_64 rng(splitmix64(this->seed_ ^ splitmix64(track)));
+  std::uniform_real_distribution<double> step(0.0, 1.0);
+  std::uniform_real_distribution<double> angle(0.0, 2 * M_PI);
+  std::normal_distribution<double> radius(0.0, kStdevDistance);
+
+  double time = 0;
+  double ref_x = this->start_;
+  double ref_y = this->curve_.evaluate(ref_x);
+  for (size_t i = 0; i < this->num_; ++i) {
+    double dt = step(rng);
+    this->next(ref_x, ref_y, kSpeed * dt, &ref_x, &ref_y);
+    time += dt;
+    if (ref) ref->insert(ref_x, ref_y, time);
+    double r = radius(rng);
+    double a = angle(rng);
+    if (input) input->insert(ref_x + r * cos(a), ref_y + r * sin(a), time);
+  }
+}
+
+}  // namespace pathest
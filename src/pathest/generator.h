@@ -0,0 +1,63 @@
+/// @file pathest/generator.h
+/// @brief Class for generating synthetic paths.
+///
+/// Follows the same model as test/generate.py: a reference path moves along
+/// the curve y = f(x) at an approximately constant speed, with random time
+/// steps between reports, and the input path offsets each reference location
+/// by normally distributed noise in a uniformly random direction.
+///
+/// Each track draws from its own random number generator seeded from the
+/// generator seed and the track number, so the output for a given track does
+/// not depend on how many tracks are generated or on which thread.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_GENERATOR_H_
+#define PATHEST_GENERATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pathest/expression.h"
+#include "pathest/path.h"
+
+namespace pathest {
+
+class Generator {
+ public:
+  /// @brief Create a generator.
+  ///
+  /// @param curve The compiled function of x to follow.
+  /// @param start The starting value of x.
+  /// @param num The number of locations per track.
+  /// @param seed The base random seed.
+  Generator(const Expression &curve, const double start, const size_t num,
+            const uint64_t seed);
+  ~Generator() {}
+
+  static const double kStdevDistance;  //< Noise standard deviation (KM).
+  static const double kSpeed;  //< Reference speed (KPM).
+
+  /// @brief Generate one track.
+  ///
+  /// Either output may be NULL if it is not needed.
+  ///
+  /// @param track The track number.
+  /// @param ref Path to append the reference locations to.
+  /// @param input Path to append the noisy locations to.
+  void generate(const uint64_t track, Path *ref, Path *input) const;
+
+ private:
+  const Expression &curve_;  //< Function of x to follow.
+  const double start_;  //< Starting value of x.
+  const size_t num_;  //< Number of locations per track.
+  const uint64_t seed_;  //< Base random seed.
+
+  /// Find the next point on the curve at a given distance from the previous.
+  void next(const double prev_x, const double prev_y, const double dist,
+            double *x, double *y) const;
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_GENERATOR_H_
@@ -0,0 +1,100 @@
+/// @file pathest/indexed_file.cc
+/// @brief Files of records behind an index sorted by id.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/indexed_file.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+namespace pathest {
+
+bool has_indexed_file_magic(const IndexedFileFormat &format, const void *buf,
+                            const size_t len) {
+  return len >= sizeof(format.magic) &&
+    !memcmp(buf, format.magic, sizeof(format.magic));
+}
+
+std::string indexed_file_temp_name(const char *filename) {
+  // Unique per process, so that two processes can't write the same file.
+  return std::string(filename) + ".tmp." + std::to_string(getpid());
+}
+
+FILE *create_indexed_file(const char *filename, const uint64_t data_start) {
+  FILE *fp = fopen(filename, "wb");
+  if (fp && fseeko(fp, data_start, SEEK_SET) != 0) {
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+bool finish_indexed_file(FILE *fp, const char *temp, const char *filename,
+                         bool ok) {
+  ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  if (fclose(fp) != 0) ok = false;
+  if (!ok || rename(temp, filename) < 0) {
+    remove(temp);
+    return false;
+  }
+  return true;
+}
+
+bool write_indexed_file_index(FILE *fp, const IndexedFileFormat &format,
+                              const void *index, const uint64_t count,
+                              const size_t entry_size) {
+  return fseeko(fp, 0, SEEK_SET) == 0 &&
+    fwrite(format.magic, sizeof(format.magic), 1, fp) == 1 &&
+    fwrite(&format.version, sizeof(format.version), 1, fp) == 1 &&
+    fwrite(&count, sizeof(count), 1, fp) == 1 &&
+    fwrite(index, entry_size, count, fp) == count;
+}
+
+const unsigned char *map_indexed_file(const char *filename,
+                                      const IndexedFileFormat &format,
+                                      const size_t entry_size, size_t *len,
+                                      uint64_t *count) {
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+      static_cast<size_t>(st.st_size) < kIndexedFileHeaderSize) {
+    ::close(fd);
+    return NULL;
+  }
+  size_t size = st.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) return NULL;
+  // Records read one at a time gain nothing from readahead of the rest.
+  if (format.random_access) madvise(mapping, size, MADV_RANDOM);
+  const unsigned char *data = static_cast<const unsigned char *>(mapping);
+
+  uint32_t version;
+  uint64_t num_entries;
+  memcpy(&version, data + sizeof(format.magic), sizeof(version));
+  memcpy(&num_entries, data + sizeof(format.magic) + sizeof(version),
+         sizeof(num_entries));
+  if (!has_indexed_file_magic(format, data, size) ||
+      version != format.version ||
+      num_entries > (size - kIndexedFileHeaderSize) / entry_size) {
+    munmap(mapping, size);
+    return NULL;
+  }
+  *len = size;
+  *count = num_entries;
+  return data;
+}
+
+void unmap_indexed_file(const unsigned char *data, const size_t len) {
+  munmap(const_cast<unsigned char *>(data), len);
+}
+
+}  // namespace pathest
@@ -0,0 +1,342 @@
+/// @file pathest/indexed_file.h
+/// @brief Files of records behind an index sorted by id.
+///
+/// Track archives (see pathest/track_archive.h) and state maps (see
+/// pathest/estimator_state.h) share one layout, and are built on the writer
+/// and reader here:
+///
+///   char     magic[4]    Identifies the format.
+///   uint32_t version     Version of the format.
+///   uint64_t count       Number of records.
+///   Entry    index[n]    One entry per record, in increasing order of id.
+///   char     data[...]   The records, each starting at a multiple of 8 bytes.
+///
+/// Every index entry starts with the id of its record and the offset of the
+/// record from the start of the file, each a uint64_t, and may be followed by
+/// fields of its format. All fields use the byte order of the host that wrote
+/// the file.
+///
+/// Files are written under a temporary name, synced and then renamed over the
+/// file they replace, so a crash while writing leaves the old file intact.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_INDEXED_FILE_H_
+#define PATHEST_INDEXED_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace pathest {
+
+/// Size in bytes of the header of an indexed file.
+const size_t kIndexedFileHeaderSize = 16;
+
+/// Alignment in bytes of the records of an indexed file.
+const size_t kIndexedFileAlign = 8;
+
+/// Format of an indexed file.
+struct IndexedFileFormat {
+  char magic[4];  //< Magic bytes at the start of the file.
+  uint32_t version;  //< Version of the format.
+  bool random_access;  //< Whether records are read in no particular order.
+};
+
+/// @brief Check whether a buffer starts with the magic bytes of a format.
+///
+/// @param format The format.
+/// @param buf The buffer.
+/// @param len The number of bytes in the buffer.
+bool has_indexed_file_magic(const IndexedFileFormat &format, const void *buf,
+                            const size_t len);
+
+/// @brief Get the temporary name an indexed file is written under.
+///
+/// @param filename The file to write.
+std::string indexed_file_temp_name(const char *filename);
+
+/// @brief Create an indexed file, positioned at the start of its data.
+///
+/// @param filename The file to create.
+/// @param data_start The offset of the data, after the header and index.
+/// @returns the open file, or NULL if unsuccessful.
+FILE *create_indexed_file(const char *filename, const uint64_t data_start);
+
+/// @brief Close an indexed file written under a temporary name, and move it
+/// over the file it replaces once it is on disk.
+///
+/// @param fp The file.
+/// @param temp The temporary name of the file.
+/// @param filename The name to move it to.
+/// @param ok Whether the file is complete. If not, it is removed instead.
+/// @returns true if the file was moved, false otherwise.
+bool finish_indexed_file(FILE *fp, const char *temp, const char *filename,
+                         const bool ok);
+
+/// @brief Write the header and index of an indexed file.
+///
+/// @param fp The file.
+/// @param format The format.
+/// @param index The index entries, sorted by id.
+/// @param count The number of entries.
+/// @param entry_size The size of each entry in bytes.
+/// @returns true if successful, false otherwise.
+bool write_indexed_file_index(FILE *fp, const IndexedFileFormat &format,
+                              const void *index, const uint64_t count,
+                              const size_t entry_size);
+
+/// @brief Map an indexed file and check its header.
+///
+/// @param filename The file to map.
+/// @param format The expected format.
+/// @param entry_size The size of each index entry in bytes.
+/// @param len Set to the length of the mapping.
+/// @param count Set to the number of index entries, which lie within the file.
+/// @returns the mapping, or NULL if unsuccessful.
+const unsigned char *map_indexed_file(const char *filename,
+                                      const IndexedFileFormat &format,
+                                      const size_t entry_size, size_t *len,
+                                      uint64_t *count);
+
+/// Unmap a file mapped by map_indexed_file().
+void unmap_indexed_file(const unsigned char *data, const size_t len);
+
+/// @brief Writer of an indexed file.
+///
+/// Records are appended in any order of id, and the index is written, sorted
+/// by id, when the file is closed. The number of records must be known when the
+/// file is opened, so that the data can follow the index directly. The file
+/// only replaces an existing one once it has been closed successfully.
+///
+/// @tparam Entry Index entry, a standard-layout struct whose first fields are
+///   the uint64_t id and offset of its record.
+template <typename Entry>
+class IndexedFileWriter {
+  static_assert(std::is_standard_layout<Entry>::value &&
+                sizeof(Entry) % kIndexedFileAlign == 0,
+                "index entries must be packed");
+
+ public:
+  explicit IndexedFileWriter(const IndexedFileFormat &format) :
+    format_(format), fp_(NULL), filename_(), temp_(), num_entries_(0),
+    offset_(0), ok_(false), index_() {}
+  ~IndexedFileWriter() {  //< Closes the file if it is still open.
+    if (this->fp_) this->close();
+  }
+
+  IndexedFileWriter(const IndexedFileWriter &) = delete;
+  IndexedFileWriter &operator=(const IndexedFileWriter &) = delete;
+
+  /// @brief Create the file.
+  ///
+  /// @param filename The file to create.
+  /// @param num_entries The number of records that will be added.
+  /// @returns true if successful, false otherwise.
+  bool open(const char *filename, const size_t num_entries) {
+    if (this->fp_ || !filename) return false;
+    this->filename_ = filename;
+    this->temp_ = indexed_file_temp_name(filename);
+    this->num_entries_ = num_entries;
+    this->offset_ = kIndexedFileHeaderSize + num_entries * sizeof(Entry);
+    this->index_.clear();
+    this->index_.reserve(num_entries);
+    // The header and index are written last, in front of the data.
+    this->fp_ = create_indexed_file(this->temp_.c_str(), this->offset_);
+    this->ok_ = this->fp_ != NULL;
+    return this->ok_;
+  }
+
+  /// @brief Check whether another record can be added.
+  ///
+  /// @returns true if the file is open, every write so far succeeded and fewer
+  ///   records were added than were given to open().
+  bool can_add() const {
+    return this->fp_ && this->ok_ &&
+      this->index_.size() < this->num_entries_;
+  }
+
+  /// Offset of the end of the data written so far, where the next record
+  /// starts.
+  uint64_t offset() const { return this->offset_; }
+
+  /// @brief Append data to the current record.
+  ///
+  /// @param buf The data.
+  /// @param size The number of bytes.
+  /// @returns true if successful, false otherwise.
+  bool write(const void *buf, const size_t size) {
+    if (!this->fp_ || !this->ok_) return false;
+    if (size && fwrite(buf, size, 1, this->fp_) != 1) {
+      this->ok_ = false;
+      return false;
+    }
+    this->offset_ += size;
+    return true;
+  }
+
+  /// @brief End the current record, padding it to the record alignment, and
+  /// add its index entry.
+  ///
+  /// @param entry The index entry, with the offset of the record.
+  /// @returns true if successful, false otherwise.
+  bool add(const Entry &entry) {
+    if (!this->can_add()) return false;
+    const char padding[kIndexedFileAlign] = {};
+    size_t pad = (kIndexedFileAlign - this->offset_ % kIndexedFileAlign) %
+      kIndexedFileAlign;
+    if (!this->write(padding, pad)) return false;
+    this->index_.push_back(entry);
+    return true;
+  }
+
+  /// @brief Write the header and index, close the file and move it into
+  /// place.
+  ///
+  /// @returns true if successful, false otherwise, including when fewer
+  ///   records were added than were given to open() or two records share an
+  ///   id. The file it would have replaced is then left as it was.
+  bool close() {
+    if (!this->fp_) return false;
+    bool ok = this->ok_ && this->index_.size() == this->num_entries_;
+    std::sort(this->index_.begin(), this->index_.end(), comp_id);
+    for (size_t i = 1; ok && i < this->index_.size(); ++i) {
+      if (this->index_[i - 1].id == this->index_[i].id) ok = false;
+    }
+    if (ok) {
+      ok = write_indexed_file_index(this->fp_, this->format_,
+                                    this->index_.data(), this->index_.size(),
+                                    sizeof(Entry));
+    }
+    ok = finish_indexed_file(this->fp_, this->temp_.c_str(),
+                             this->filename_.c_str(), ok);
+    this->fp_ = NULL;
+    this->ok_ = false;
+    return ok;
+  }
+
+ private:
+  static bool comp_id(const Entry &entry1, const Entry &entry2) {
+    return entry1.id < entry2.id;
+  }
+
+  const IndexedFileFormat format_;  //< Format of the file.
+  FILE *fp_;  //< Open file, or NULL.
+  std::string filename_;  //< Name of the file once it is closed.
+  std::string temp_;  //< Name of the file while it is written.
+  size_t num_entries_;  //< Number of records given to open().
+  uint64_t offset_;  //< Offset of the end of the data written so far.
+  bool ok_;  //< Whether every write so far succeeded.
+  std::vector<Entry> index_;  //< Entries of the records added so far.
+};
+
+/// @brief Reader of an indexed file.
+///
+/// The file is mapped read-only, and records are read in place from the
+/// mapping. An indexed file is safe to read from multiple threads at once.
+///
+/// @tparam Entry Index entry, as for IndexedFileWriter.
+template <typename Entry>
+class IndexedFile {
+  static_assert(std::is_standard_layout<Entry>::value &&
+                sizeof(Entry) % kIndexedFileAlign == 0,
+                "index entries must be packed");
+
+ public:
+  explicit IndexedFile(const IndexedFileFormat &format) :
+    format_(format), data_(NULL), len_(0), index_(NULL), size_(0) {}
+  ~IndexedFile() {  //< Unmaps the file.
+    this->close();
+  }
+
+  IndexedFile(const IndexedFile &) = delete;
+  IndexedFile &operator=(const IndexedFile &) = delete;
+
+  /// @brief Map an indexed file.
+  ///
+  /// Checks the header, that the index is sorted and that every record is
+  /// aligned and within the file.
+  ///
+  /// @param filename The file to map.
+  /// @param fits Called with each entry and the number of bytes from its
+  ///   offset to the end of the file, returns whether the record fits in them.
+  /// @returns true if successful, false otherwise.
+  template <typename Fits>
+  bool open(const char *filename, Fits fits) {
+    this->close();
+    if (!filename) return false;
+    uint64_t count;
+    this->data_ = map_indexed_file(filename, this->format_, sizeof(Entry),
+                                   &this->len_, &count);
+    if (!this->data_) return false;
+    this->index_ =
+      reinterpret_cast<const Entry *>(this->data_ + kIndexedFileHeaderSize);
+    this->size_ = count;
+
+    uint64_t data_start = kIndexedFileHeaderSize + count * sizeof(Entry);
+    for (size_t i = 0; i < this->size_; ++i) {
+      const Entry &entry = this->index_[i];
+      if ((i && entry.id <= this->index_[i - 1].id) ||
+          entry.offset % kIndexedFileAlign || entry.offset < data_start ||
+          entry.offset > this->len_ ||
+          !fits(entry, this->len_ - entry.offset)) {
+        this->close();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void close() {  //< Unmap the file. Pointers to its records become invalid.
+    if (this->data_) unmap_indexed_file(this->data_, this->len_);
+    this->data_ = NULL;
+    this->len_ = 0;
+    this->index_ = NULL;
+    this->size_ = 0;
+  }
+
+  bool empty() const { return this->size_ == 0; }
+  size_t size() const { return this->size_; }  //< Number of records.
+
+  /// Get an index entry by position, in increasing order of id.
+  const Entry &operator[](const size_t i) const {
+    return this->index_[i];
+  }
+
+  /// @brief Find a record by id.
+  ///
+  /// @param id The record id.
+  /// @returns the index entry, or NULL if there is no such record.
+  const Entry *find(const uint64_t id) const {
+    const Entry *end = this->index_ + this->size_;
+    const Entry *it = std::lower_bound(this->index_, end, id, comp_id);
+    return it != end && it->id == id ? it : NULL;
+  }
+
+  /// @brief Get a record in place.
+  ///
+  /// @param entry An index entry of this file.
+  /// @returns the record, valid until the file is closed.
+  const void *record(const Entry &entry) const {
+    return this->data_ + entry.offset;
+  }
+
+ private:
+  static bool comp_id(const Entry &entry, const uint64_t id) {
+    return entry.id < id;
+  }
+
+  const IndexedFileFormat format_;  //< Format of the file.
+  const unsigned char *data_;  //< Mapped file, or NULL.
+  size_t len_;  //< Length of the mapped file.
+  const Entry *index_;  //< Index within the mapping.
+  size_t size_;  //< Number of records.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_INDEXED_FILE_H_
@@ -5,8 +5,15 @@
 
 #include "pathest/kalman_filter.h"
 
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <armadillo>
+#include <memory_resource>
+#include <vector>
 
+#include "pathest/estimator_state.h"
 #include "pathest/location.h"
 
 namespace pathest {
@@ -35,15 +42,122 @@ const arma::mat KalmanFilter::I_ = arma::eye(4, 4);
 const arma::mat KalmanFilter::Q_ = initQ();
 const arma::mat KalmanFilter::R_ = 0.1 * arma::eye(4, 4);
 
-KalmanFilter::KalmanFilter() :
+// Limits for the gain schedule. Gains converge within a few dozen steps for
+// the hardcoded model.
+const double gain_tolerance = 1e-15;
+const size_t max_gain_steps = 10000;
+
+namespace {
+
+const uint32_t state_version = 1;
+
+// Layout of a saved state. Exact filters keep the state vector and covariance;
+// steady-state filters keep the state vector and their step in the gain
+// schedule, and save a zero covariance.
+struct SavedState {
+  StateHeader header;
+  uint32_t mode;
+  uint32_t reserved;
+  uint64_t step;
+  double x[4];
+  double p[16];  // Covariance, in row-major order.
+};
+
+}  // namespace
+
+KalmanFilter::KalmanFilter(const Mode mode) :
   m_(arma::zeros(4, 1)),
   x_(arma::zeros(4, 1)),
   y_(arma::zeros(4, 1)),
   K_(arma::zeros(4, 4)),
   P_(arma::zeros(4, 4)),
-  S_(arma::zeros(4, 4)) {}
+  S_(arma::zeros(4, 4)),
+  mode_(mode),
+  step_(0),
+  state_() {}
+
+const std::vector<KalmanFilter::Gain> &KalmanFilter::gains() {
+  static const std::vector<Gain> schedule = [] {
+#ifdef DEBUG
+    // Invariant: the fast update assumes a constant velocity model.
+    assert(A_(0, 0) == 1 && A_(1, 1) == 1 && A_(2, 2) == 1 && A_(3, 3) == 1);
+    assert(H_(0, 0) == 1 && H_(0, 2) == 1 && H_(1, 1) == 1 && H_(1, 3) == 1);
+#endif
+    // Run the covariance recursion of predict() until the gains stop
+    // changing.
+    std::vector<Gain> gains;
+    arma::mat P = arma::zeros(4, 4);
+    arma::mat K = arma::zeros(4, 4);
+    arma::mat C = arma::zeros(4, 4);
+    for (size_t step = 0; step < max_gain_steps; ++step) {
+      P = (A_ * P * A_.t()) + Q_;
+      arma::mat S = (H_ * P * H_.t()) + R_;
+      arma::mat next_K = P * H_.t() * solve(S, I_);
+      P = (I_ - (next_K * H_)) * P;
+      arma::mat next_C = P * A_.t() * solve((A_ * P * A_.t()) + Q_, I_);
+      double change = arma::abs(next_K - K).max();
+      double change_C = arma::abs(next_C - C).max();
+      K = next_K;
+      C = next_C;
+      Gain gain;
+      for (int i = 0; i < 4; ++i) {
+        gain.k[i][0] = K(i, 0);
+        gain.k[i][1] = K(i, 1);
+        for (int j = 0; j < 4; ++j) gain.c[i][j] = C(i, j);
+      }
+      gains.push_back(gain);
+      if (change <= gain_tolerance * arma::abs(K).max() &&
+          change_C <= gain_tolerance * arma::abs(C).max()) {
+        break;
+      }
+    }
+    return gains;
+  }();
+  return schedule;
+}
+
+size_t KalmanFilter::convergence_steps() { return gains().size(); }
+
+size_t KalmanFilter::warm_up_steps(const double epsilon) {
+  const Gain &gain = gains().back();
+  arma::mat K = arma::zeros(4, 4);
+  for (int i = 0; i < 4; ++i) {
+    K(i, 0) = gain.k[i][0];
+    K(i, 1) = gain.k[i][1];
+  }
+  const arma::mat F = (I_ - (K * H_)) * A_;
+  arma::mat decay = I_;
+  size_t steps = 0;
+  while (steps < max_gain_steps && arma::abs(decay).max() > epsilon) {
+    decay = F * decay;
+    ++steps;
+  }
+  return gains().size() + steps;
+}
 
 Location KalmanFilter::predict(const Location &loc) {
+  if (this->mode_ == kSteadyState) {
+    const std::vector<Gain> &schedule = gains();
+    const Gain &gain = schedule[this->step_];
+    if (this->step_ + 1 < schedule.size()) ++this->step_;
+
+    // Prediction step, A * x.
+    double *s = this->state_;
+    double x0 = s[0] + A_.at(0, 2) * s[2];
+    double x1 = s[1] + A_.at(1, 3) * s[3];
+    double x2 = s[2];
+    double x3 = s[3];
+
+    // Update step with the measurement residual, m - H * x.
+    double y0 = loc.x() - (x0 + x2);
+    double y1 = loc.y() - (x1 + x3);
+    s[0] = x0 + gain.k[0][0] * y0 + gain.k[0][1] * y1;
+    s[1] = x1 + gain.k[1][0] * y0 + gain.k[1][1] * y1;
+    s[2] = x2 + gain.k[2][0] * y0 + gain.k[2][1] * y1;
+    s[3] = x3 + gain.k[3][0] * y0 + gain.k[3][1] * y1;
+    return Location(s[0], s[1], loc.t());
+  }
+
   this->m_(0, 0) = loc.x();
   this->m_(1, 0) = loc.y();
 
@@ -63,4 +177,89 @@ Location KalmanFilter::predict(const Location &loc) {
   return Location(pred_x, pred_y, loc.t());
 }
 
+size_t KalmanFilter::state_size() const { return sizeof(SavedState); }
+
+void KalmanFilter::save_state(void *buf) const {
+  SavedState state = SavedState();
+  state.header.kind = kKalmanFilterState;
+  state.header.version = state_version;
+  state.mode = this->mode_;
+  state.step = this->step_;
+  if (this->mode_ == kSteadyState) {
+    for (int i = 0; i < 4; ++i) state.x[i] = this->state_[i];
+  } else {
+    for (int i = 0; i < 4; ++i) {
+      state.x[i] = this->x_(i, 0);
+      for (int j = 0; j < 4; ++j) state.p[4 * i + j] = this->P_(i, j);
+    }
+  }
+  memcpy(buf, &state, sizeof(state));
+}
+
+bool KalmanFilter::restore_state(const void *buf, const size_t len) {
+  if (!buf || len != sizeof(SavedState)) return false;
+  SavedState state;
+  memcpy(&state, buf, sizeof(state));
+  if (state.header.kind != kKalmanFilterState ||
+      state.header.version != state_version ||
+      state.mode != static_cast<uint32_t>(this->mode_) ||
+      (this->mode_ == kSteadyState && state.step >= gains().size())) {
+    return false;
+  }
+  this->step_ = state.step;
+  if (this->mode_ == kSteadyState) {
+    for (int i = 0; i < 4; ++i) this->state_[i] = state.x[i];
+  } else {
+    for (int i = 0; i < 4; ++i) {
+      this->x_(i, 0) = state.x[i];
+      for (int j = 0; j < 4; ++j) this->P_(i, j) = state.p[4 * i + j];
+    }
+  }
+  return true;
+}
+
+void KalmanFilter::smooth_in_place(Location *locations, const size_t n,
+                                   std::pmr::memory_resource *resource) {
+  if (n < 2) {
+    if (n) {
+      KalmanFilter kf(kSteadyState);
+      locations[0] = kf.predict(locations[0]);
+    }
+    return;
+  }
+
+  // Forward pass, keeping the filtered state of every step.
+  std::pmr::vector<double> states(4 * n, resource);
+  KalmanFilter kf(kSteadyState);
+  for (size_t i = 0; i < n; ++i) {
+    kf.predict(locations[i]);
+    for (int j = 0; j < 4; ++j) states[4 * i + j] = kf.state_[j];
+  }
+
+  // Backward pass, replacing each filtered state with the smoothed one:
+  // s(i) = f(i) + C(i) * (s(i + 1) - A * f(i)).
+  const std::vector<Gain> &schedule = gains();
+  const double a02 = A_.at(0, 2);
+  const double a13 = A_.at(1, 3);
+  const double *next = &states[4 * (n - 1)];
+  locations[n - 1] = Location(next[0], next[1], locations[n - 1].t());
+  for (size_t i = n - 1; i-- > 0;) {
+    double *s = &states[4 * i];
+    const Gain &gain =
+      schedule[i < schedule.size() ? i : schedule.size() - 1];
+    double d[4] = {
+      next[0] - (s[0] + a02 * s[2]),
+      next[1] - (s[1] + a13 * s[3]),
+      next[2] - s[2],
+      next[3] - s[3]
+    };
+    for (int j = 0; j < 4; ++j) {
+      s[j] += gain.c[j][0] * d[0] + gain.c[j][1] * d[1] +
+        gain.c[j][2] * d[2] + gain.c[j][3] * d[3];
+    }
+    locations[i] = Location(s[0], s[1], locations[i].t());
+    next = s;
+  }
+}
+
 }  // namespace pathest
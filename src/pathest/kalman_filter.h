@@ -1,11 +1,26 @@
 /// @file pathest/kalman_filter.h
 /// @brief Class for Kalman filter.
+///
+/// The model matrices are constant and the filter always starts from the same
+/// covariance, so the covariance and gain after each step do not depend on the
+/// measurements. In steady-state mode the gains are computed once, from the
+/// first step until they converge to the solution of the discrete algebraic
+/// Riccati equation, and shared by every filter. Each prediction then costs a
+/// few multiply-adds instead of several 4x4 matrix products and a solve.
+///
+/// The Rauch-Tung-Striebel smoother reuses the same schedule for its
+/// backward gains, so smoothing a whole path takes one forward and one
+/// backward pass of fixed-size arithmetic.
+///
 //===----------------------------------------------------------------------===//
 
 #ifndef PATHEST_KALMAN_FILTER_H_
 #define PATHEST_KALMAN_FILTER_H_
 
+#include <stddef.h>
 #include <armadillo>
+#include <memory_resource>
+#include <vector>
 
 #include "pathest/location.h"
 
@@ -13,16 +28,82 @@ namespace pathest {
 
 class KalmanFilter {
  public:
-  KalmanFilter();
+  enum Mode {
+    kExact,  //< Propagate the covariance and solve for the gain every step.
+    kSteadyState  //< Use the shared gain schedule.
+  };
+
+  explicit KalmanFilter(const Mode mode = kExact);
   ~KalmanFilter() {}
 
   /// Predict the next location in chronological order.
   Location predict(const Location &loc);
 
+  /// Size in bytes of the saved state.
+  size_t state_size() const;
+
+  /// @brief Save the state, as described in pathest/estimator_state.h.
+  ///
+  /// @param buf The buffer, of at least state_size() bytes.
+  void save_state(void *buf) const;
+
+  /// @brief Restore a state saved by an estimator with the same mode.
+  ///
+  /// @param buf The saved state.
+  /// @param len The size of the saved state in bytes.
+  /// @returns true if successful, false if the state is not valid for this
+  ///   estimator, which is then left unchanged.
+  bool restore_state(const void *buf, const size_t len);
+
+  /// @brief Get the number of steps until the gain converges.
+  ///
+  /// From this step on, steady-state filters use a fixed gain.
+  static size_t convergence_steps();
+
+  /// @brief Get the number of steps after which the start is forgotten.
+  ///
+  /// A steady-state filter started this many steps before a location gives
+  /// the same estimate there as one started at the beginning of the path, up
+  /// to epsilon times the difference between their states before the
+  /// horizon. The gains converge first, after which the difference decays
+  /// with the closed-loop transition (I - K * H) * A.
+  ///
+  /// @param epsilon The relative influence of the forgotten start.
+  static size_t warm_up_steps(const double epsilon);
+
+  /// @brief Smooth a sequence of locations in place with an RTS smoother.
+  ///
+  /// Runs the filter forward in steady-state mode, keeping the four state
+  /// values of each step, then runs the Rauch-Tung-Striebel recursion
+  /// backward so that every estimate uses all measurements. The state buffer
+  /// is the only allocation.
+  ///
+  /// @param locations The locations, in chronological order.
+  /// @param n The number of locations.
+  /// @param resource The memory resource for the state buffer.
+  static void smooth_in_place(Location *locations, const size_t n,
+                              std::pmr::memory_resource *resource =
+                              std::pmr::get_default_resource());
+
  private:
+  // Gains shared by all filters for one step.
+  struct Gain {
+    // Columns for the x and y measurements, by state row. The other
+    // measurement rows are always zero, so their columns are never used.
+    double k[4][2];
+    // Smoother gain P * A' * inverse(A * P * A' + Q), for the filtered
+    // covariance P of the step.
+    double c[4][4];
+  };
+
   static const arma::mat A_, H_, I_, Q_, R_;  //< Constant matrices.
   arma::colvec m_, x_, y_;  //< State vectors.
   arma::mat K_, P_, S_;  //< State matrices.
+  Mode mode_;  //< How gains are computed.
+  size_t step_;  //< Number of predictions made, up to convergence.
+  double state_[4];  //< State vector in steady-state mode.
+
+  static const std::vector<Gain> &gains();  //< Shared gain schedule.
 };
 
 }  // namespace pathest
@@ -9,7 +9,8 @@ namespace pathest {
 
 class Location {
  public:
-  Location(const double x, const double y, const double t);
+  Location(const double x, const double y, const double t) :
+    x_(x), y_(y), t_(t) {}
   ~Location() {}
 
   // Comparison functions.
@@ -17,10 +18,11 @@ class Location {
   static bool comp_y(const Location &loc1, const Location &loc2);
   static bool comp_t(const Location &loc1, const Location &loc2);
 
-  // Field access.
-  double x() const;
-  double y() const;
-  double t() const;
+  // Field access, inline so that per-location loops can be optimized across
+  // estimators.
+  double x() const { return this->x_; }
+  double y() const { return this->y_; }
+  double t() const { return this->t_; }
 
  private:
   double x_;  //< The x coordinate.
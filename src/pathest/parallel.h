@@ -0,0 +1,67 @@
+/// @file pathest/parallel.h
+/// @brief Helpers for splitting work across threads.
+///
+/// Work is divided into contiguous chunks, one per thread, so that results
+/// which depend only on the chunk boundaries are identical for any thread
+/// count.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_PARALLEL_H_
+#define PATHEST_PARALLEL_H_
+
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+namespace pathest {
+
+/// @brief Get the number of threads to use when none is requested.
+inline unsigned default_threads() {
+  unsigned threads = std::thread::hardware_concurrency();
+  return threads ? threads : 1;
+}
+
+/// @brief Get the first index of a chunk.
+///
+/// @param n The number of items.
+/// @param chunks The number of chunks.
+/// @param chunk The chunk index, where chunk == chunks gives n.
+inline size_t chunk_begin(const size_t n, const size_t chunks,
+                          const size_t chunk) {
+  return (n / chunks) * chunk + (chunk < n % chunks ? chunk : n % chunks);
+}
+
+/// @brief Run a function over [0, n) split into contiguous chunks.
+///
+/// The function is called as fn(chunk, begin, end) for each chunk. The calling
+/// thread runs the first chunk itself. A thread count of zero selects
+/// default_threads(), and no more chunks than items are created.
+///
+/// @param n The number of items.
+/// @param threads The number of threads.
+/// @param fn The function to run on each chunk.
+/// @returns the number of chunks.
+template <typename Fn>
+size_t parallel_for(const size_t n, unsigned threads, Fn fn) {
+  if (!threads) threads = default_threads();
+  size_t chunks = threads < n ? threads : n;
+  if (chunks < 2) {
+    if (n) fn(static_cast<size_t>(0), static_cast<size_t>(0), n);
+    return n ? 1 : 0;
+  }
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (size_t i = 1; i < chunks; ++i) {
+    workers.push_back(std::thread(fn, i, chunk_begin(n, chunks, i),
+                                  chunk_begin(n, chunks, i + 1)));
+  }
+  fn(static_cast<size_t>(0), static_cast<size_t>(0),
+     chunk_begin(n, chunks, 1));
+  for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+  return chunks;
+}
+
+}  // namespace pathest
+
+#endif  // PATHEST_PARALLEL_H_
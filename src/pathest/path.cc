@@ -14,32 +14,138 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <algorithm>
+#include <atomic>
+#include <memory_resource>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "pathest/exponential_smoothing.h"
 #include "pathest/kalman_filter.h"
 #include "pathest/location.h"
+#include "pathest/profile.h"
 #include "pathest/simple_moving_average.h"
+#include "pathest/time_moving_average.h"
 
 namespace pathest {
 
-Path::Path() : data_(std::vector<Location>()) {}
-Path::Path(std::vector<Location> locations) : data_(locations) {
-  std::sort(this->data_.begin(), this->data_.end(), Location::comp_t);
+Path::Path() : data_(storage_type()), index_(index_type()), indexed_(0) {}
+Path::Path(std::pmr::memory_resource *resource) :
+  data_(resource), index_(resource), indexed_(0) {}
+Path::Path(const std::vector<Location> &locations,
+           std::pmr::memory_resource *resource) :
+  data_(locations.begin(), locations.end(), resource), index_(resource),
+  indexed_(0) {
+  PATHEST_PROFILE_SCOPE_ITEMS("sort", this->data_.size());
+  // Stable, so that equal timestamps keep their order as with insert().
+  std::stable_sort(this->data_.begin(), this->data_.end(), Location::comp_t);
+}
+
+Path::Path(storage_type &&locations) :
+  data_(std::move(locations)), index_(this->data_.get_allocator().resource()),
+  indexed_(0) {
+  if (!std::is_sorted(this->data_.begin(), this->data_.end(),
+                      Location::comp_t)) {
+    PATHEST_PROFILE_SCOPE_ITEMS("sort", this->data_.size());
+    std::stable_sort(this->data_.begin(), this->data_.end(), Location::comp_t);
+  }
+}
+
+Path::Path(PathView view, std::pmr::memory_resource *resource) :
+  data_(view.begin(), view.end(), resource), index_(resource), indexed_(0) {
+  // Views of paths are already sorted.
+  if (!std::is_sorted(this->data_.begin(), this->data_.end(),
+                      Location::comp_t)) {
+    PATHEST_PROFILE_SCOPE_ITEMS("sort", this->data_.size());
+    std::stable_sort(this->data_.begin(), this->data_.end(), Location::comp_t);
+  }
+}
+
+// Another thread may be building the index of the other path, so it is only
+// copied once complete, when no thread will write it.
+Path::Path(const Path &other, std::pmr::memory_resource *resource) :
+  data_(other.data_, resource), index_(resource), indexed_(0) {
+  if (other.index_ready()) {
+    this->index_.assign(other.index_.begin(), other.index_.end());
+    this->indexed_.store(this->index_.size(), std::memory_order_relaxed);
+  }
+}
+
+Path::Path(const Path &other) :
+  Path(other, std::pmr::get_default_resource()) {}
+
+Path::Path(Path &&other) :
+  data_(std::move(other.data_)), index_(std::move(other.index_)),
+  indexed_(this->index_.size()) {
+  other.indexed_.store(other.index_.size(), std::memory_order_relaxed);
+}
+
+Path &Path::operator=(const Path &other) {
+  if (this == &other) return *this;
+  this->data_ = other.data_;
+  if (other.index_ready()) {
+    this->index_ = other.index_;
+  } else {
+    this->truncate_index(0);
+  }
+  this->indexed_.store(this->index_.size(), std::memory_order_relaxed);
+  return *this;
+}
+
+Path &Path::operator=(Path &&other) {
+  if (this == &other) return *this;
+  this->data_ = std::move(other.data_);
+  this->index_ = std::move(other.index_);
+  this->indexed_.store(this->index_.size(), std::memory_order_relaxed);
+  other.indexed_.store(other.index_.size(), std::memory_order_relaxed);
+  return *this;
 }
 
 bool Path::empty() const { return this->data_.empty(); }
 size_t Path::size() const { return this->data_.size(); }
 
-Path::iterator Path::begin() { return this->data_.begin(); }
-Path::iterator Path::end() { return this->data_.end(); }
+const Location *Path::data() const { return this->data_.data(); }
+
+PathView Path::view() const {
+  return PathView(this->data_.data(), this->data_.data() + this->data_.size(),
+                  this);
+}
+
+PathView Path::slice(const double t1, const double t2) const {
+  return this->view().slice(t1, t2);
+}
+
+std::pmr::memory_resource *Path::resource() const {
+  return this->data_.get_allocator().resource();
+}
+
+void Path::reserve(const size_t n) { this->data_.reserve(n); }
+void Path::clear() {
+  this->data_.clear();
+  this->truncate_index(0);
+}
+
+// Locations may be changed through the iterators, so drop the whole index.
+Path::iterator Path::begin() {
+  this->truncate_index(0);
+  return this->data_.begin();
+}
+
+Path::iterator Path::end() {
+  this->truncate_index(0);
+  return this->data_.end();
+}
 
 Path::const_iterator Path::begin() const { return this->data_.begin(); }
 Path::const_iterator Path::end() const { return this->data_.end(); }
 
 void Path::insert(const Location &loc) {
-  this->data_.insert(std::upper_bound(this->begin(), this->end(), loc,
-                                      Location::comp_t), loc);
+  storage_type::iterator pos = std::upper_bound(
+      this->data_.begin(), this->data_.end(), loc, Location::comp_t);
+  // Totals before the new location are still valid.
+  size_t i = pos - this->data_.begin();
+  this->truncate_index(i);
+  this->data_.insert(pos, loc);
 }
 
 void Path::insert(const double x, const double y, const double t) {
@@ -121,21 +227,22 @@ std::pair<double, double> Path::predict(const double time) const {
                                      data_[len - 1].y() - dy);
   } else {
     // Case 3: min_t <= time <= max_t
-    for (Path::const_iterator it = this->begin(); it != this->end(); ++it) {
-      if (time < it->t()) {
-#ifdef DEBUG
-        assert(it - 1 != this->begin());
-#endif
-        double avg_x = ((it - 1)->x() + it->x()) / 2.0;
-        double avg_y = ((it - 1)->y() + it->y()) / 2.0;
-        return std::pair<double, double>(avg_x, avg_y);
-      }
+    // Interpolate linearly between the locations on either side of the time.
+    Path::const_iterator next = std::upper_bound(
+        this->begin(), this->end(), Location(0, 0, time), Location::comp_t);
+    if (next == this->end()) {
+      return std::pair<double, double>(data_[this->size() - 1].x(),
+                                       data_[this->size() - 1].y());
     }
-  }
 #ifdef DEBUG
-  assert(false);
+    assert(next != this->begin());
 #endif
-  return std::pair<double, double>(0, 0);
+    Path::const_iterator prev = next - 1;
+    double frac = (time - prev->t()) / (next->t() - prev->t());
+    return std::pair<double, double>(
+        prev->x() + frac * (next->x() - prev->x()),
+        prev->y() + frac * (next->y() - prev->y()));
+  }
 }
 
 std::pair<double, double> Path::sma_predict(const int samples,
@@ -175,63 +282,276 @@ std::pair<double, double> Path::kf_predict(const double time) const {
   }
 }
 
-Path Path::sma_path(const int samples) const {
-  Path data;
-  if (samples <= 0) return data;
-  SimpleMovingAverage sma(samples);
-  for (Path::const_iterator it = this->begin(); it != this->end(); ++it) {
-    data.insert(sma.predict(*it));
-  }
+Path Path::sma_path(const int samples) const & {
+  Path data(*this, this->resource());
+  data.sma_in_place(samples);
   return data;
 }
 
-Path Path::es_path(const double smoothing) const {
-  Path data;
-  if ((smoothing <= 0) || (smoothing >= 1.0)) return data;
-  ExponentialSmoothing es(smoothing);
-  for (Path::const_iterator it = this->begin(); it != this->end(); ++it) {
-    data.insert(es.predict(*it));
-  }
+Path Path::sma_path(const int samples) && {
+  this->sma_in_place(samples);
+  return std::move(*this);
+}
+
+Path Path::tma_path(const double duration) const & {
+  Path data(*this, this->resource());
+  data.tma_in_place(duration);
   return data;
 }
 
-Path Path::kf_path() const {
-  Path data;
-  KalmanFilter kf;
-  for (Path::const_iterator it = this->begin(); it != this->end(); ++it) {
-    data.insert(kf.predict(*it));
-  }
+Path Path::tma_path(const double duration) && {
+  this->tma_in_place(duration);
+  return std::move(*this);
+}
+
+Path Path::es_path(const double smoothing) const & {
+  Path data(*this, this->resource());
+  data.es_in_place(smoothing);
   return data;
 }
 
+Path Path::es_path(const double smoothing) && {
+  this->es_in_place(smoothing);
+  return std::move(*this);
+}
+
+Path Path::kf_path() const & {
+  Path data(*this, this->resource());
+  data.kf_in_place();
+  return data;
+}
+
+Path Path::kf_path() && {
+  this->kf_in_place();
+  return std::move(*this);
+}
+
+Path Path::rts_path() const & {
+  Path data(*this, this->resource());
+  data.rts_in_place();
+  return data;
+}
+
+Path Path::rts_path() && {
+  this->rts_in_place();
+  return std::move(*this);
+}
+
+Path Path::simplify_path(const double tolerance) const & {
+  Path data(*this, this->resource());
+  data.simplify_in_place(tolerance);
+  return data;
+}
+
+Path Path::simplify_path(const double tolerance) && {
+  this->simplify_in_place(tolerance);
+  return std::move(*this);
+}
+
+// The estimators copy what they need from each location into their own state,
+// so every location can be overwritten by its estimate as soon as it is read.
+// Estimates keep the timestamps of their inputs, so the path stays sorted.
+
+void Path::sma_in_place(const int samples, const unsigned threads) {
+  PATHEST_PROFILE_SCOPE_ITEMS("sma", this->size());
+  if (samples <= 0) {
+    this->clear();
+    return;
+  }
+  this->truncate_index(0);
+  SimpleMovingAverage::average_in_place(samples, this->data_.data(),
+                                        this->data_.size(), threads,
+                                        this->resource());
+}
+
+void Path::tma_in_place(const double duration) {
+  PATHEST_PROFILE_SCOPE_ITEMS("tma", this->size());
+  if (duration <= 0) {
+    this->clear();
+    return;
+  }
+  TimeMovingAverage tma(duration, this->resource());
+  for (Path::iterator it = this->begin(); it != this->end(); ++it) {
+    *it = tma.predict(*it);
+  }
+}
+
+void Path::es_in_place(const double smoothing, const unsigned threads) {
+  PATHEST_PROFILE_SCOPE_ITEMS("es", this->size());
+  if ((smoothing <= 0) || (smoothing >= 1.0)) {
+    this->clear();
+    return;
+  }
+  this->truncate_index(0);
+  ExponentialSmoothing::smooth_in_place(smoothing, this->data_.data(),
+                                        this->data_.size(), threads);
+}
+
+void Path::kf_in_place() {
+  PATHEST_PROFILE_SCOPE_ITEMS("kf", this->size());
+  KalmanFilter kf(KalmanFilter::kSteadyState);
+  for (Path::iterator it = this->begin(); it != this->end(); ++it) {
+    *it = kf.predict(*it);
+  }
+}
+
+void Path::rts_in_place() {
+  PATHEST_PROFILE_SCOPE_ITEMS("rts", this->size());
+  this->truncate_index(0);
+  KalmanFilter::smooth_in_place(this->data_.data(), this->data_.size(),
+                                this->resource());
+}
+
+void Path::simplify_in_place(const double tolerance) {
+  PATHEST_PROFILE_SCOPE_ITEMS("simplify", this->size());
+  if (tolerance < 0) {
+    this->clear();
+    return;
+  }
+  const size_t n = this->data_.size();
+  if (n < 3) return;
+  const Location *data = this->data_.data();
+
+  // Split ranges of locations, given by their first and last, at the
+  // location farthest from the chord between them, until every location
+  // within a range is close enough. Distances are compared squared.
+  std::pmr::vector<bool> keep(n, false, this->resource());
+  std::pmr::vector<std::pair<size_t, size_t> > ranges(this->resource());
+  const double max_d2 = tolerance * tolerance;
+  keep[0] = true;
+  keep[n - 1] = true;
+  ranges.push_back(std::make_pair(static_cast<size_t>(0), n - 1));
+  while (!ranges.empty()) {
+    const size_t first = ranges.back().first;
+    const size_t last = ranges.back().second;
+    ranges.pop_back();
+    const Location &a = data[first];
+    const Location &b = data[last];
+    const double dt = b.t() - a.t();
+    double far_d2 = -1;
+    size_t far = first;
+    for (size_t i = first + 1; i < last; ++i) {
+      // Compare with the position on the chord at the same time, so that
+      // speed along the path is kept as well as its shape.
+      double frac = dt > 0 ? (data[i].t() - a.t()) / dt : 0;
+      double dx = data[i].x() - (a.x() + frac * (b.x() - a.x()));
+      double dy = data[i].y() - (a.y() + frac * (b.y() - a.y()));
+      double d2 = dx * dx + dy * dy;
+      if (d2 > far_d2) {
+        far_d2 = d2;
+        far = i;
+      }
+    }
+    if (far_d2 <= max_d2) continue;
+    keep[far] = true;
+    if (far - first > 1) ranges.push_back(std::make_pair(first, far));
+    if (last - far > 1) ranges.push_back(std::make_pair(far, last));
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (keep[i]) this->data_[kept++] = this->data_[i];
+  }
+  this->data_.erase(this->data_.begin() + kept, this->data_.end());
+  this->truncate_index(0);
+}
+
+bool Path::index_ready() const {
+  return this->indexed_.load(std::memory_order_acquire) == this->data_.size();
+}
+
+void Path::truncate_index(const size_t n) {
+  if (n < this->index_.size()) this->index_.resize(n);
+  this->indexed_.store(this->index_.size(), std::memory_order_relaxed);
+}
+
+void Path::build_index() const {
+  // One thread claims the build, and the others wait for it to publish.
+  size_t n = this->indexed_.load(std::memory_order_acquire);
+  while (n != this->data_.size()) {
+    if (n == kBuildingIndex) {
+      std::this_thread::yield();
+      n = this->indexed_.load(std::memory_order_acquire);
+    } else if (this->indexed_.compare_exchange_weak(
+                   n, kBuildingIndex, std::memory_order_acquire)) {
+      this->extend_index();
+      this->indexed_.store(this->index_.size(), std::memory_order_release);
+      return;
+    }
+  }
+}
+
+void Path::extend_index() const {
+  size_t i = this->index_.size();
+  this->index_.reserve(this->data_.size());
+  if (i == 0) {
+    Prefix first = { 0, 0, 0 };
+    this->index_.push_back(first);
+    ++i;
+  }
+  const Location &first = this->data_[0];
+  for (; i < this->data_.size(); ++i) {
+    const Location &prev = this->data_[i - 1];
+    const Location &curr = this->data_[i];
+    Prefix p = this->index_[i - 1];
+    double dx = curr.x() - prev.x();
+    double dy = curr.y() - prev.y();
+    p.distance += sqrt(dx * dx + dy * dy);
+    if (curr.t() != first.t()) {
+      dx = curr.x() - first.x();
+      dy = curr.y() - first.y();
+      p.speed += sqrt(dx * dx + dy * dy) / (curr.t() - first.t());
+      ++p.speeds;
+    }
+    this->index_.push_back(p);
+  }
+}
+
+double Path::distance_at(const double time) const {
+  if (time <= this->data_.front().t()) return 0;
+  if (time >= this->data_.back().t()) return this->index_.back().distance;
+  // The first location after the time; there is one before it too.
+  size_t j = std::upper_bound(this->data_.begin(), this->data_.end(),
+                              Location(0, 0, time), Location::comp_t)
+    - this->data_.begin();
+  const Location &prev = this->data_[j - 1];
+  const Location &next = this->data_[j];
+  double frac = (time - prev.t()) / (next.t() - prev.t());
+  double start = this->index_[j - 1].distance;
+  return start + frac * (this->index_[j].distance - start);
+}
+
+double Path::distance_between(const size_t i, const size_t j) const {
+  this->build_index();
+  return this->index_[j].distance - this->index_[i].distance;
+}
+
 double Path::avg_speed() const {
 #ifdef DEBUG
   assert(this->size() > 1);
 #endif
   if (this->size() < 2) return 0;
-  double sum = 0.0;
-  double num = 0.0;
-  Path::const_iterator it = this->begin();
-  double prev_x = it->x();
-  double prev_y = it->y();
-  double prev_t = it->t();
-  for (; it != this->end(); ++it) {
-    double curr_x = it->x();
-    double curr_y = it->y();
-    double curr_t = it->t();
-    if (curr_t != prev_t) {
-      double dx = curr_x - prev_x;
-      double dy = curr_y - prev_y;
-      double dt = curr_t - prev_t;
-      if (dx * dx + dy * dy >= 0) {
-        double speed = sqrt(dx * dx + dy * dy) / dt;
-        sum += speed;
-        ++num;
-      }
-    }
-  }
-  if (!num) return 0;
-  return sum / num;
+  this->build_index();
+  const Prefix &total = this->index_.back();
+  if (!total.speeds) return 0;
+  return total.speed / total.speeds;
+}
+
+double Path::mean_speed(const double t1, const double t2) const {
+  if (!(t1 < t2)) return 0;
+  return this->distance(t1, t2) / (t2 - t1);
+}
+
+double Path::distance() const {
+  if (this->size() < 2) return 0;
+  this->build_index();
+  return this->index_.back().distance;
+}
+
+double Path::distance(const double t1, const double t2) const {
+  if (this->size() < 2 || !(t1 < t2)) return 0;
+  this->build_index();
+  return this->distance_at(t2) - this->distance_at(t1);
 }
 
 }  // namespace pathest
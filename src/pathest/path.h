@@ -5,27 +5,63 @@
 /// certain public functions. These functions may have undefined behavior when
 /// these expectations are not followed.
 ///
+/// Locations are stored in memory from a std::pmr::memory_resource, the
+/// default resource unless one is given. Estimated paths use the same resource
+/// as the path they are computed from, so a whole analysis run can draw from
+/// one arena (see pathest/arena.h). Copy construction without a resource uses
+/// the default resource, so copies may outlive the arena they were taken from.
+///
+/// Distance and speed queries use a prefix index of cumulative segment
+/// lengths and speeds, built on the first query and extended as locations are
+/// appended. Inserting before the end, or writing through non-const
+/// iterators, discards the index from that point on. A const query that finds
+/// the index stale builds it behind an atomic count of the locations it
+/// covers, so one path may be queried from several threads at once. Calling
+/// build_index() first spares the threads from waiting on that build.
+///
 //===----------------------------------------------------------------------===//
 
 #ifndef PATHEST_PATH_H_
 #define PATHEST_PATH_H_
 
 #include <stddef.h>
+#include <atomic>
+#include <memory_resource>
 #include <utility>
 #include <vector>
 
 #include "pathest/location.h"
+#include "pathest/path_view.h"
 
 namespace pathest {
 
 class Path {
  public:
   Path();
-  explicit Path(std::vector<Location> locations);
+  explicit Path(std::pmr::memory_resource *resource);
+  explicit Path(const std::vector<Location> &locations,
+                std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource());
+  Path(const Path &other, std::pmr::memory_resource *resource);
   ~Path() {}
 
-  typedef std::vector<Location>::iterator iterator;
-  typedef std::vector<Location>::const_iterator const_iterator;
+  typedef std::pmr::vector<Location> storage_type;
+
+  /// Take ownership of locations, keeping their memory resource. Sorts them
+  /// by time unless they already are.
+  explicit Path(storage_type &&locations);
+
+  /// Copy the locations of a view.
+  explicit Path(PathView view, std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource());
+
+  Path(const Path &other);
+  Path(Path &&other);
+  Path &operator=(const Path &other);
+  Path &operator=(Path &&other);
+
+  typedef storage_type::iterator iterator;
+  typedef storage_type::const_iterator const_iterator;
   iterator begin();
   iterator end();
   const_iterator begin() const;
@@ -34,6 +70,30 @@ class Path {
   bool empty() const;
   size_t size() const;
 
+  /// Get a pointer to the locations, in time order.
+  const Location *data() const;
+
+  /// Get a read-only view of all locations.
+  PathView view() const;
+  operator PathView() const { return this->view(); }
+
+  /// @brief Get a view of the locations within a time range.
+  ///
+  /// Costs two binary searches and no copies. See PathView::slice().
+  ///
+  /// @param t1 The start of the range, inclusive.
+  /// @param t2 The end of the range, inclusive.
+  PathView slice(const double t1, const double t2) const;
+
+  /// Get the memory resource that locations are stored in.
+  std::pmr::memory_resource *resource() const;
+
+  /// Reserve storage for a number of locations.
+  void reserve(const size_t n);
+
+  /// Remove all locations, keeping the storage.
+  void clear();
+
   /// @brief Get the minimum x coordinate.
   ///
   /// Undefined behavior for paths with zero locations.
@@ -130,9 +190,28 @@ class Path {
   /// broken this function returns an empty path. Otherwise, the estimated data
   /// will have an equal number of points as the input data.
   ///
+  /// Called on a temporary, the estimate is computed in place and the storage
+  /// is moved into the result, e.g. path.sma_path(5).sma_path(5) copies once.
+  ///
   /// @param samples The number of samples factored into each average.
   /// @returns the estimated path if successful, an empty path otherwise.
-  Path sma_path(const int samples) const;
+  Path sma_path(const int samples) const &;
+  Path sma_path(const int samples) &&;
+
+  /// @brief Calculate an estimated path with a time moving average.
+  ///
+  /// Each estimate averages the locations within the given duration up to
+  /// and including its own timestamp. Assumes the duration is greater than
+  /// zero. If this assumption is broken this function returns an empty path.
+  /// Otherwise, the estimated data will have an equal number of points as the
+  /// input data.
+  ///
+  /// Called on a temporary, the estimate is computed in place.
+  ///
+  /// @param duration The length of the time window.
+  /// @returns the estimated path if successful, an empty path otherwise.
+  Path tma_path(const double duration) const &;
+  Path tma_path(const double duration) &&;
 
   /// @brief Calculate an estimated path with exponential smoothing.
   ///
@@ -140,16 +219,101 @@ class Path {
   /// this assumption is broken this function returns an empty path. Otherwise,
   /// the estimated data will have an equal number of points as the input data.
   ///
+  /// Called on a temporary, the estimate is computed in place.
+  ///
   /// @param smoothing The smoothing factor.
   /// @returns the estimated path if successful, an empty path otherwise.
-  Path es_path(const double smoothing) const;
+  Path es_path(const double smoothing) const &;
+  Path es_path(const double smoothing) &&;
 
   /// @brief Calculate an estimated path with a Kalman filter.
   ///
   /// The estimated data has an equal number of data points as the input data.
+  /// Called on a temporary, the estimate is computed in place.
   ///
   /// @returns The estimated data.
-  Path kf_path() const;
+  Path kf_path() const &;
+  Path kf_path() &&;
+
+  /// @brief Calculate a smoothed path with a Rauch-Tung-Striebel smoother.
+  ///
+  /// Unlike the other estimates, each location is estimated from the whole
+  /// path, both before and after it. The estimated data has an equal number
+  /// of data points as the input data.
+  ///
+  /// @returns The smoothed data.
+  Path rts_path() const &;
+  Path rts_path() &&;
+
+  /// @brief Calculate a simplified path within a distance of this one.
+  ///
+  /// Keeps the first and last locations and as few others as a time-aware
+  /// Douglas-Peucker pass needs so that every dropped location lies within
+  /// the tolerance of where the simplified path places it at its own
+  /// timestamp, measured between the kept locations on either side by linear
+  /// interpolation in time. Since predict() interpolates the same way, it
+  /// stays within the tolerance of the original at any time between the first
+  /// and last locations, not just at the dropped ones. Assumes the tolerance
+  /// is not negative. If this assumption is broken this function returns an
+  /// empty path.
+  ///
+  /// Meant as a last stage after an estimate. Called on a temporary, the
+  /// path is simplified in place, e.g. path.kf_path().simplify_path(1) copies
+  /// once.
+  ///
+  /// @param tolerance The largest distance of a dropped location.
+  /// @returns the simplified path if successful, an empty path otherwise.
+  Path simplify_path(const double tolerance) const &;
+  Path simplify_path(const double tolerance) &&;
+
+  /// @brief Replace the path with its simple moving average.
+  ///
+  /// Each estimate only depends on earlier locations, so the path is
+  /// overwritten as it is read, without copying. Clears the path if the number
+  /// of samples is not greater than zero, like sma_path(). Very long paths may
+  /// be averaged across several threads (see
+  /// SimpleMovingAverage::average_in_place).
+  ///
+  /// @param samples The number of samples factored into each average.
+  /// @param threads The number of threads, or zero for the default.
+  void sma_in_place(const int samples, const unsigned threads = 1);
+
+  /// @brief Replace the path with its time moving average.
+  ///
+  /// Clears the path if the duration is not greater than zero, like
+  /// tma_path().
+  ///
+  /// @param duration The length of the time window.
+  void tma_in_place(const double duration);
+
+  /// @brief Replace the path with its exponential smoothing.
+  ///
+  /// Clears the path if the smoothing factor is not between zero and one,
+  /// like es_path(). Very long paths may be smoothed across several threads
+  /// (see ExponentialSmoothing::smooth_in_place), matching the sequential
+  /// result up to rounding.
+  ///
+  /// @param smoothing The smoothing factor.
+  /// @param threads The number of threads, or zero for the default.
+  void es_in_place(const double smoothing, const unsigned threads = 1);
+
+  /// @brief Replace the path with its Kalman filter estimate.
+  void kf_in_place();
+
+  /// @brief Replace the path with its Rauch-Tung-Striebel smoothing.
+  void rts_in_place();
+
+  /// @brief Replace the path with its simplification.
+  ///
+  /// Ranges of locations are split at their farthest location on an explicit
+  /// stack rather than by recursion, so long paths cannot overflow the call
+  /// stack, and the kept locations are then moved down in place. Splits that
+  /// halve their ranges, as on typical tracks, take O(n log n) time; the
+  /// worst case is quadratic. Clears the path if the tolerance is negative,
+  /// like simplify_path().
+  ///
+  /// @param tolerance The largest distance of a dropped location.
+  void simplify_in_place(const double tolerance);
 
   /// @}
 
@@ -161,16 +325,70 @@ class Path {
 
   /// @brief Calculate average speed.
   ///
-  /// Estimates the speed of movement by taking the average of the estimated
-  /// speed between each point. Undefined behavior for paths with fewer than two
-  /// locations.
+  /// Estimates the speed of movement by taking the average of the speeds
+  /// implied by travelling from the first location to each later location.
+  /// Measuring every speed from the same start keeps sampling noise in the
+  /// locations from dominating the estimate. Undefined behavior for paths with
+  /// fewer than two locations.
   double avg_speed() const;
 
+  /// @brief Calculate mean speed within a time range.
+  ///
+  /// The distance travelled within the range divided by its duration. Returns
+  /// zero for empty ranges.
+  ///
+  /// @param t1 The start of the range.
+  /// @param t2 The end of the range.
+  double mean_speed(const double t1, const double t2) const;
+
+  /// @brief Calculate the length of the path.
+  double distance() const;
+
+  /// @brief Calculate the distance travelled within a time range.
+  ///
+  /// Movement along each segment is taken to be at constant speed, so segments
+  /// that straddle either end of the range count in proportion. Returns zero
+  /// for empty ranges.
+  ///
+  /// @param t1 The start of the range.
+  /// @param t2 The end of the range.
+  double distance(const double t1, const double t2) const;
+
+  /// @brief Build the distance index for all locations.
+  ///
+  /// Queries build the index as needed, and are safe to run concurrently.
+  /// Building it up front makes them read-only.
+  void build_index() const;
+
   /// @}
 
  private:
-  std::vector<Location> data_;  //< List of locations.
+  friend class PathView;
+
+  // Running totals over the segments ending at or before a location.
+  struct Prefix {
+    double distance;  //< Sum of segment lengths.
+    double speed;  //< Sum of speeds from the first location.
+    double speeds;  //< Number of speeds in the sum.
+  };
+  typedef std::pmr::vector<Prefix> index_type;
+
+  /// Value of indexed_ while a const query builds the index.
+  static const size_t kBuildingIndex = static_cast<size_t>(-1);
+
+  storage_type data_;  //< List of locations.
+  mutable index_type index_;  //< Prefix totals for the first locations.
+  /// Number of entries of index_ that may be read, or kBuildingIndex. Stored
+  /// with release order once the entries are written.
+  mutable std::atomic<size_t> indexed_;
+
+  bool index_ready() const;  //< Whether the index covers every location.
+  void extend_index() const;  //< Add totals for the unindexed locations.
+  void truncate_index(const size_t n);  //< Keep the first n totals, if any.
+
   std::pair<double, double> predict(const double time) const;
+  double distance_at(const double time) const;  //< Distance up to a time.
+  double distance_between(const size_t i, const size_t j) const;  //< By index.
 };
 
 }  // namespace pathest
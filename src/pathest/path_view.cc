@@ -0,0 +1,186 @@
+/// @file pathest/path_view.cc
+/// @brief Class for read-only access to a range of locations.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/path_view.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
+#include <memory_resource>
+
+#include "pathest/location.h"
+#include "pathest/path.h"
+
+namespace pathest {
+
+namespace {
+
+double segment_length(const Location &a, const Location &b) {
+  double dx = b.x() - a.x();
+  double dy = b.y() - a.y();
+  return sqrt(dx * dx + dy * dy);
+}
+
+// Distance along a view up to a time, by scanning. Used for views that are
+// not of a Path.
+double scan_distance_at(const PathView &view, const double time) {
+  double sum = 0;
+  for (size_t i = 1; i < view.size(); ++i) {
+    const Location &prev = view[i - 1];
+    const Location &curr = view[i];
+    if (curr.t() <= time) {
+      sum += segment_length(prev, curr);
+    } else {
+      if (time > prev.t()) {
+        sum += (time - prev.t()) / (curr.t() - prev.t()) *
+          segment_length(prev, curr);
+      }
+      break;
+    }
+  }
+  return sum;
+}
+
+}  // namespace
+
+PathView PathView::slice(const double t1, const double t2) const {
+  const Location *begin = std::lower_bound(this->begin_, this->end_,
+                                           Location(0, 0, t1),
+                                           Location::comp_t);
+  const Location *end = std::upper_bound(begin, this->end_,
+                                         Location(0, 0, t2),
+                                         Location::comp_t);
+  if (end < begin) end = begin;
+  return PathView(begin, end, this->owner_);
+}
+
+double PathView::min_x() const {
+#ifdef DEBUG
+  assert(!this->empty());
+#endif
+  if (this->empty()) return 0;
+  return std::min_element(this->begin_, this->end_, Location::comp_x)->x();
+}
+
+double PathView::min_y() const {
+#ifdef DEBUG
+  assert(!this->empty());
+#endif
+  if (this->empty()) return 0;
+  return std::min_element(this->begin_, this->end_, Location::comp_y)->y();
+}
+
+// Views are sorted by timestamp, so the time bounds are at the ends.
+double PathView::min_t() const {
+#ifdef DEBUG
+  assert(!this->empty());
+#endif
+  if (this->empty()) return 0;
+  return this->front().t();
+}
+
+double PathView::max_x() const {
+#ifdef DEBUG
+  assert(!this->empty());
+#endif
+  if (this->empty()) return 0;
+  return std::max_element(this->begin_, this->end_, Location::comp_x)->x();
+}
+
+double PathView::max_y() const {
+#ifdef DEBUG
+  assert(!this->empty());
+#endif
+  if (this->empty()) return 0;
+  return std::max_element(this->begin_, this->end_, Location::comp_y)->y();
+}
+
+double PathView::max_t() const {
+#ifdef DEBUG
+  assert(!this->empty());
+#endif
+  if (this->empty()) return 0;
+  return this->back().t();
+}
+
+double PathView::avg_speed() const {
+#ifdef DEBUG
+  assert(this->size() > 1);
+#endif
+  if (this->size() < 2) return 0;
+  const Location &first = this->front();
+  double sum = 0.0;
+  double num = 0.0;
+  for (const Location *it = this->begin_ + 1; it != this->end_; ++it) {
+    if (it->t() != first.t()) {
+      sum += segment_length(first, *it) / (it->t() - first.t());
+      ++num;
+    }
+  }
+  if (!num) return 0;
+  return sum / num;
+}
+
+double PathView::distance() const {
+  if (this->size() < 2) return 0;
+  if (this->owner_) {
+    size_t i = this->begin_ - this->owner_->data();
+    return this->owner_->distance_between(i, i + this->size() - 1);
+  }
+  double sum = 0;
+  for (size_t i = 1; i < this->size(); ++i) {
+    sum += segment_length((*this)[i - 1], (*this)[i]);
+  }
+  return sum;
+}
+
+double PathView::distance(const double t1, const double t2) const {
+  if (this->size() < 2) return 0;
+  double start = std::max(t1, this->min_t());
+  double end = std::min(t2, this->max_t());
+  if (!(start < end)) return 0;
+  if (this->owner_) return this->owner_->distance(start, end);
+  return scan_distance_at(*this, end) - scan_distance_at(*this, start);
+}
+
+double PathView::mean_speed(const double t1, const double t2) const {
+  if (!(t1 < t2)) return 0;
+  return this->distance(t1, t2) / (t2 - t1);
+}
+
+Path PathView::sma_path(const int samples,
+                        std::pmr::memory_resource *resource) const {
+  Path data(*this, resource);
+  data.sma_in_place(samples);
+  return data;
+}
+
+Path PathView::tma_path(const double duration,
+                        std::pmr::memory_resource *resource) const {
+  Path data(*this, resource);
+  data.tma_in_place(duration);
+  return data;
+}
+
+Path PathView::es_path(const double smoothing,
+                       std::pmr::memory_resource *resource) const {
+  Path data(*this, resource);
+  data.es_in_place(smoothing);
+  return data;
+}
+
+Path PathView::kf_path(std::pmr::memory_resource *resource) const {
+  Path data(*this, resource);
+  data.kf_in_place();
+  return data;
+}
+
+Path PathView::rts_path(std::pmr::memory_resource *resource) const {
+  Path data(*this, resource);
+  data.rts_in_place();
+  return data;
+}
+
+}  // namespace pathest
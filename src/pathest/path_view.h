@@ -0,0 +1,135 @@
+/// @file pathest/path_view.h
+/// @brief Class for read-only access to a range of locations.
+///
+/// A path view refers to contiguous locations owned by something else, like
+/// std::span, and is cheap to copy and pass by value. It is only valid while
+/// the owner is alive and unmodified. Views created from a Path are sorted by
+/// timestamp, and can be sliced by time in O(log n) without copying.
+///
+/// Views of a Path remember it, so that distance queries use its prefix index
+/// (see Path::distance()) and cost O(1) after two binary searches. Views of
+/// other memory compute distances by scanning. Smoothing a view copies it once
+/// into the resulting path.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_PATH_VIEW_H_
+#define PATHEST_PATH_VIEW_H_
+
+#include <stddef.h>
+#include <memory_resource>
+
+#include "pathest/location.h"
+
+namespace pathest {
+
+class Path;
+
+class PathView {
+ public:
+  PathView() : begin_(NULL), end_(NULL), owner_(NULL) {}
+  PathView(const Location *begin, const Location *end) :
+    begin_(begin), end_(end), owner_(NULL) {}
+  PathView(const Location *data, const size_t size) :
+    begin_(data), end_(data + size), owner_(NULL) {}
+
+  typedef const Location *const_iterator;
+  const_iterator begin() const { return this->begin_; }
+  const_iterator end() const { return this->end_; }
+
+  bool empty() const { return this->begin_ == this->end_; }
+  size_t size() const { return this->end_ - this->begin_; }
+  const Location *data() const { return this->begin_; }
+
+  /// Access a location by index. Undefined behavior when out of range.
+  const Location &operator[](const size_t i) const { return this->begin_[i]; }
+
+  /// Get the first location. Undefined behavior for empty views.
+  const Location &front() const { return *this->begin_; }
+
+  /// Get the last location. Undefined behavior for empty views.
+  const Location &back() const { return *(this->end_ - 1); }
+
+  /// Get the path the view is of, or NULL for views of other memory.
+  const Path *owner() const { return this->owner_; }
+
+  /// @brief Get the locations within a time range.
+  ///
+  /// Assumes the view is sorted by timestamp.
+  ///
+  /// @param t1 The start of the range, inclusive.
+  /// @param t2 The end of the range, inclusive.
+  /// @returns a view of the same owner, empty if no location is in range.
+  PathView slice(const double t1, const double t2) const;
+
+  /// @defgroup Bounds
+  ///
+  /// Coordinate bounds, like the ones of Path. Undefined behavior for empty
+  /// views.
+  ///
+  /// @{
+  double min_x() const;
+  double min_y() const;
+  double min_t() const;
+  double max_x() const;
+  double max_y() const;
+  double max_t() const;
+  /// @}
+
+  /// @brief Calculate average speed, like Path::avg_speed().
+  ///
+  /// Speeds are measured from the first location in the view, so this scans
+  /// the view. Undefined behavior for views with fewer than two locations.
+  double avg_speed() const;
+
+  double distance() const;  //< Length of the view.
+
+  /// @brief Calculate the distance travelled within a time range.
+  ///
+  /// The range is clipped to the view. See Path::distance().
+  ///
+  /// @param t1 The start of the range.
+  /// @param t2 The end of the range.
+  double distance(const double t1, const double t2) const;
+
+  /// @brief Calculate mean speed within a time range.
+  ///
+  /// The distance travelled within the view and the range, divided by the
+  /// duration of the range, like Path::mean_speed().
+  ///
+  /// @param t1 The start of the range.
+  /// @param t2 The end of the range.
+  double mean_speed(const double t1, const double t2) const;
+
+  /// @defgroup Playback
+  ///
+  /// Estimated paths of the locations in the view, as from the Path functions
+  /// of the same names. The result is allocated from the given resource.
+  ///
+  /// @{
+  Path sma_path(const int samples, std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource()) const;
+  Path tma_path(const double duration, std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource()) const;
+  Path es_path(const double smoothing, std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource()) const;
+  Path kf_path(std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource()) const;
+  Path rts_path(std::pmr::memory_resource *resource =
+                std::pmr::get_default_resource()) const;
+  /// @}
+
+ private:
+  friend class Path;
+
+  PathView(const Location *begin, const Location *end, const Path *owner) :
+    begin_(begin), end_(end), owner_(owner) {}
+
+  const Location *begin_;  //< First location.
+  const Location *end_;  //< One past the last location.
+  const Path *owner_;  //< Path that owns the locations, if any.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_PATH_VIEW_H_
@@ -0,0 +1,182 @@
+/// @file pathest/pipeline.h
+/// @brief Templates for chaining estimators into one pass.
+///
+/// A pipeline runs several estimators one after another on each location, so
+/// that e.g. a moving average followed by exponential smoothing takes a single
+/// pass over a path with no intermediate paths. Stages are held by value and
+/// called directly, so the compiler can inline the whole chain into the loop.
+///
+/// Any class with a Location predict(const Location &) member that handles
+/// locations in chronological order can be a stage, including the estimators
+/// of the library. The stages defined here are header-only, so that they
+/// inline without link-time optimization:
+///
+/// - FixedMovingAverage<N>, a simple moving average with a window size fixed
+///   at compile time.
+/// - InlineExponentialSmoothing, equivalent to ExponentialSmoothing.
+///
+/// Example:
+///
+///     Pipeline<FixedMovingAverage<5>, KalmanFilter> pipeline =
+///       make_pipeline(FixedMovingAverage<5>(),
+///                     KalmanFilter(KalmanFilter::kSteadyState));
+///     pipeline.run_in_place(&path);
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_PIPELINE_H_
+#define PATHEST_PIPELINE_H_
+
+#include <stddef.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "pathest/exponential_smoothing.h"
+#include "pathest/location.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+#include "pathest/simple_moving_average.h"
+
+namespace pathest {
+
+/// @brief Simple moving average over N samples.
+///
+/// Gives the same estimates as SimpleMovingAverage(N), by the same update
+/// (see MovingAverageSums), with the history in fixed-size arrays instead of
+/// allocated vectors.
+template <size_t N>
+class FixedMovingAverage {
+  static_assert(N > 0, "the window must have at least one sample");
+
+ public:
+  FixedMovingAverage() : sums_(), history_x_(), history_y_() {}
+
+  /// Predict the next location in chronological order.
+  Location predict(const Location &loc) {
+    return this->sums_.add(loc, N, this->history_x_, this->history_y_);
+  }
+
+ private:
+  MovingAverageSums sums_;  //< Running sums over the history.
+  double history_x_[N];  //< History of x coordinates.
+  double history_y_[N];  //< History of y coordinates.
+};
+
+/// @brief Exponential smoothing, defined inline.
+///
+/// Gives the same estimates as ExponentialSmoothing, by the same update (see
+/// SmoothedPrediction). Invalid smoothing factors pass locations through
+/// unchanged.
+class InlineExponentialSmoothing {
+ public:
+  explicit InlineExponentialSmoothing(const double smoothing) :
+    pred_(), smoothing_(smoothing),
+    valid_((smoothing > 0) && (smoothing < 1.0)) {}
+
+  /// Predict the next location in chronological order.
+  Location predict(const Location &loc) {
+    if (!this->valid_) return loc;
+    return this->pred_.add(loc, this->smoothing_);
+  }
+
+ private:
+  SmoothedPrediction pred_;  //< Last prediction.
+  double smoothing_;  //< Smoothing factor.
+  bool valid_;  //< Whether the smoothing factor is in range.
+};
+
+/// @brief Estimators applied in sequence to each location.
+///
+/// The first stage sees each input location, and every later stage sees the
+/// estimate of the stage before it. A pipeline keeps the state of its stages,
+/// so it can also be fed one location at a time.
+template <typename... Stages>
+class Pipeline {
+  static_assert(sizeof...(Stages) > 0, "a pipeline needs at least one stage");
+
+ public:
+  explicit Pipeline(Stages... stages) : stages_(std::move(stages)...) {}
+
+  /// Predict the next location in chronological order.
+  Location predict(const Location &loc) {
+    Location est = loc;
+    std::apply([&est](Stages &... stages) {
+      ((est = stages.predict(est)), ...);
+    }, this->stages_);
+    return est;
+  }
+
+  /// @brief Run the pipeline over locations.
+  ///
+  /// @param in The locations, in chronological order.
+  /// @param out The array for the estimates, of at least in.size() elements.
+  ///   It may be the same memory as in.
+  void run(PathView in, Location *out) {
+    const Location *data = in.data();
+    const size_t n = in.size();
+    for (size_t i = 0; i < n; ++i) out[i] = this->predict(data[i]);
+  }
+
+  /// @brief Run the pipeline over a path, replacing its locations.
+  ///
+  /// The estimates keep the timestamps of their inputs, so the path stays
+  /// sorted.
+  void run_in_place(Path *path) {
+    for (Path::iterator it = path->begin(); it != path->end(); ++it) {
+      *it = this->predict(*it);
+    }
+  }
+
+  /// @brief Run the pipeline over locations into a new path.
+  ///
+  /// @param in The locations, in chronological order.
+  /// @param resource The memory resource for the result.
+  Path run(PathView in, std::pmr::memory_resource *resource =
+           std::pmr::get_default_resource()) {
+    Path out(in, resource);
+    this->run_in_place(&out);
+    return out;
+  }
+
+  /// @brief Run the pipeline over decoded locations into a new path.
+  ///
+  /// Reads any input iterator range of locations in chronological order, such
+  /// as that of a compact path (see pathest/compact_path.h), decoding each
+  /// location only as it is used.
+  ///
+  /// @param first The first location.
+  /// @param last One past the last location.
+  /// @param resource The memory resource for the result.
+  template <typename InputIt>
+  Path run(InputIt first, const InputIt last,
+           std::pmr::memory_resource *resource =
+           std::pmr::get_default_resource()) {
+    Path::storage_type out(resource);
+    for (; first != last; ++first) out.push_back(this->predict(*first));
+    return Path(std::move(out));
+  }
+
+  /// Get a stage by its position.
+  template <size_t I>
+  typename std::tuple_element<I, std::tuple<Stages...> >::type &stage() {
+    return std::get<I>(this->stages_);
+  }
+
+ private:
+  std::tuple<Stages...> stages_;  //< Stages in the order they run.
+};
+
+/// @brief Create a pipeline, deducing the stage types.
+///
+/// @param stages The stages in the order they run.
+template <typename... Stages>
+Pipeline<typename std::decay<Stages>::type...> make_pipeline(
+    Stages &&... stages) {
+  return Pipeline<typename std::decay<Stages>::type...>(
+      std::forward<Stages>(stages)...);
+}
+
+}  // namespace pathest
+
+#endif  // PATHEST_PIPELINE_H_
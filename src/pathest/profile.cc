@@ -0,0 +1,230 @@
+/// @file pathest/profile.cc
+/// @brief Scoped timers and counters for hot-path instrumentation.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/profile.h"
+
+#ifdef PATHEST_PROFILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifdef PATHEST_PROFILE_TSC
+#include <x86intrin.h>
+#endif
+
+namespace pathest {
+namespace profile {
+
+namespace {
+
+const size_t max_stages = 64;
+
+struct StageStats {
+  uint64_t calls;
+  uint64_t ticks;
+  uint64_t items;
+  uint64_t allocations;
+};
+
+// Statistics for every stage, owned by one thread.
+class ThreadStats {
+ public:
+  ThreadStats();
+  ~ThreadStats();
+  StageStats stages[max_stages];
+
+ private:
+  ThreadStats(const ThreadStats &);
+  ThreadStats &operator=(const ThreadStats &);
+};
+
+// Global registry. Threads only take the lock when they start or exit, and
+// when a stage is first registered.
+struct Registry {
+  Registry() : lock(), names(), threads(), retired() {
+    memset(this->retired, 0, sizeof(this->retired));
+  }
+  std::mutex lock;
+  std::vector<const char *> names;
+  std::vector<ThreadStats *> threads;
+  StageStats retired[max_stages];  // Totals from threads that have exited.
+};
+
+Registry &registry() {
+  static Registry *reg = new Registry();  // Never destroyed, see ~ThreadStats.
+  return *reg;
+}
+
+// Plain counters so that they are safe to touch from operator new.
+thread_local uint64_t thread_allocations = 0;
+std::atomic<uint64_t> total_allocations(0);
+
+uint64_t now() {
+#ifdef PATHEST_PROFILE_TSC
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Reference points for converting ticks to seconds and for total run time.
+const uint64_t start_ticks = now();
+const std::chrono::steady_clock::time_point start_time =
+  std::chrono::steady_clock::now();
+
+double seconds_per_tick() {
+#ifdef PATHEST_PROFILE_TSC
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start_time).count();
+  uint64_t ticks = now() - start_ticks;
+  return ticks ? elapsed / ticks : 0;
+#else
+  return 1e-9;
+#endif
+}
+
+ThreadStats::ThreadStats() {
+  memset(this->stages, 0, sizeof(this->stages));
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  reg.threads.push_back(this);
+}
+
+ThreadStats::~ThreadStats() {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  for (size_t i = 0; i < max_stages; ++i) {
+    reg.retired[i].calls += this->stages[i].calls;
+    reg.retired[i].ticks += this->stages[i].ticks;
+    reg.retired[i].items += this->stages[i].items;
+    reg.retired[i].allocations += this->stages[i].allocations;
+  }
+  reg.threads.erase(std::find(reg.threads.begin(), reg.threads.end(), this));
+}
+
+StageStats *thread_stats(const size_t stage) {
+  thread_local ThreadStats stats;
+  return &stats.stages[stage];
+}
+
+// Sum the statistics of all live and exited threads into arrays of
+// max_stages entries, so that writing a profile does not allocate.
+size_t collect(const char **names, StageStats *totals) {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  std::copy(reg.names.begin(), reg.names.end(), names);
+  std::copy(reg.retired, reg.retired + reg.names.size(), totals);
+  for (size_t t = 0; t < reg.threads.size(); ++t) {
+    for (size_t i = 0; i < reg.names.size(); ++i) {
+      totals[i].calls += reg.threads[t]->stages[i].calls;
+      totals[i].ticks += reg.threads[t]->stages[i].ticks;
+      totals[i].items += reg.threads[t]->stages[i].items;
+      totals[i].allocations += reg.threads[t]->stages[i].allocations;
+    }
+  }
+  return reg.names.size();
+}
+
+}  // namespace
+
+size_t register_stage(const char *name) {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  for (size_t i = 0; i < reg.names.size(); ++i) {
+    if (!strcmp(reg.names[i], name)) return i;
+  }
+  // Stages beyond the limit share the last slot rather than failing.
+  if (reg.names.size() == max_stages) return max_stages - 1;
+  reg.names.push_back(name);
+  return reg.names.size() - 1;
+}
+
+void count(const size_t stage, const uint64_t items) {
+  StageStats *stats = thread_stats(stage);
+  ++stats->calls;
+  stats->items += items;
+}
+
+void count_allocation() {
+  ++thread_allocations;
+  total_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+ScopedTimer::ScopedTimer(const size_t stage, const uint64_t items) :
+  stage_(stage), items_(items), start_(now()),
+  allocations_(thread_allocations) {}
+
+ScopedTimer::~ScopedTimer() {
+  uint64_t end = now();
+  StageStats *stats = thread_stats(this->stage_);
+  ++stats->calls;
+  stats->ticks += end - this->start_;
+  stats->items += this->items_;
+  stats->allocations += thread_allocations - this->allocations_;
+}
+
+void write_text(FILE *fp) {
+  const char *names[max_stages];
+  StageStats totals[max_stages];
+  size_t len = collect(names, totals);
+  double scale = seconds_per_tick();
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start_time).count();
+
+  fprintf(fp, "Profile\n-------\n\n");
+  fprintf(fp, "%-16s %10s %12s %12s %12s %14s %12s\n", "Stage", "Calls",
+          "Total (ms)", "Mean (us)", "Items", "Items/s", "Allocations");
+  for (size_t i = 0; i < len; ++i) {
+    double seconds = totals[i].ticks * scale;
+    double mean = totals[i].calls ? 1e6 * seconds / totals[i].calls : 0;
+    double rate = seconds > 0 ? totals[i].items / seconds : 0;
+    fprintf(fp, "%-16s %10llu %12.3f %12.3f %12llu %14.0f %12llu\n",
+            names[i], static_cast<unsigned long long>(totals[i].calls),
+            1e3 * seconds, mean,
+            static_cast<unsigned long long>(totals[i].items), rate,
+            static_cast<unsigned long long>(totals[i].allocations));
+  }
+  fprintf(fp, "\nStage times include nested stages.\n");
+  fprintf(fp, "Wall time: %.3f ms\n", 1e3 * elapsed);
+  fprintf(fp, "Total allocations: %llu\n",
+          static_cast<unsigned long long>(total_allocations.load()));
+}
+
+void write_json(FILE *fp) {
+  const char *names[max_stages];
+  StageStats totals[max_stages];
+  size_t len = collect(names, totals);
+  double scale = seconds_per_tick();
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start_time).count();
+
+  fprintf(fp, "{\n   \"allocations\" : %llu,\n   \"stages\" : [",
+          static_cast<unsigned long long>(total_allocations.load()));
+  for (size_t i = 0; i < len; ++i) {
+    double seconds = totals[i].ticks * scale;
+    fprintf(fp, "%s\n      {\n         \"allocations\" : %llu,\n"
+            "         \"calls\" : %llu,\n         \"items\" : %llu,\n"
+            "         \"items_per_second\" : %.17g,\n"
+            "         \"name\" : \"%s\",\n         \"seconds\" : %.17g\n"
+            "      }", i ? "," : "",
+            static_cast<unsigned long long>(totals[i].allocations),
+            static_cast<unsigned long long>(totals[i].calls),
+            static_cast<unsigned long long>(totals[i].items),
+            seconds > 0 ? totals[i].items / seconds : 0, names[i], seconds);
+  }
+  fprintf(fp, "\n   ],\n   \"wall_seconds\" : %.17g\n}\n", elapsed);
+}
+
+}  // namespace profile
+}  // namespace pathest
+
+#endif  // PATHEST_PROFILE
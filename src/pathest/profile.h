@@ -0,0 +1,111 @@
+/// @file pathest/profile.h
+/// @brief Scoped timers and counters for hot-path instrumentation.
+///
+/// Instrumentation is compiled in only when PATHEST_PROFILE is defined (see
+/// the PROFILE option in the Makefile). Otherwise the macros expand to nothing
+/// and this header declares no functions.
+///
+/// Each instrumented scope is a named stage. A stage records the number of
+/// calls, the total time spent (inclusive of nested stages), the number of
+/// items processed, and the number of heap allocations made on the calling
+/// thread while the scope was active. Statistics are accumulated per thread
+/// without locking, and are merged when a report is written or when a thread
+/// exits.
+///
+/// Timing uses std::chrono::steady_clock by default, or the processor time
+/// stamp counter when PATHEST_PROFILE_TSC is also defined. Allocations are
+/// only counted if the program reports them with count_allocation(), e.g. from
+/// a replacement operator new.
+///
+/// Example usage:
+///   PATHEST_PROFILE_SCOPE("parse");
+///   PATHEST_PROFILE_SCOPE_ITEMS("sma", path.size());
+///   PATHEST_PROFILE_COUNT("points", n);
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_PROFILE_H_
+#define PATHEST_PROFILE_H_
+
+#ifdef PATHEST_PROFILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PATHEST_PROFILE_CONCAT_(a, b) a##b
+#define PATHEST_PROFILE_CONCAT(a, b) PATHEST_PROFILE_CONCAT_(a, b)
+
+/// Time the rest of the enclosing scope as the named stage.
+#define PATHEST_PROFILE_SCOPE(name) \
+  PATHEST_PROFILE_SCOPE_ITEMS(name, 0)
+
+/// Time the rest of the enclosing scope and count items processed.
+#define PATHEST_PROFILE_SCOPE_ITEMS(name, items) \
+  static const size_t PATHEST_PROFILE_CONCAT(profile_stage_, __LINE__) = \
+    ::pathest::profile::register_stage(name); \
+  ::pathest::profile::ScopedTimer PATHEST_PROFILE_CONCAT(profile_timer_, \
+                                                         __LINE__)( \
+    PATHEST_PROFILE_CONCAT(profile_stage_, __LINE__), (items))
+
+/// Count items for the named stage without timing anything.
+#define PATHEST_PROFILE_COUNT(name, items) \
+  do { \
+    static const size_t profile_stage = \
+      ::pathest::profile::register_stage(name); \
+    ::pathest::profile::count(profile_stage, (items)); \
+  } while (0)
+
+namespace pathest {
+namespace profile {
+
+/// @brief Get the identifier for a stage name, registering it if needed.
+///
+/// Scopes with the same name share one stage.
+size_t register_stage(const char *name);
+
+/// @brief Add to the call and item counts of a stage.
+void count(const size_t stage, const uint64_t items);
+
+/// @brief Record one heap allocation on the calling thread.
+///
+/// Safe to call from a replacement operator new.
+void count_allocation();
+
+/// @brief Write a per-stage breakdown as a text table.
+///
+/// Should be called while no other thread is inside an instrumented scope.
+void write_text(FILE *fp);
+
+/// @brief Write a per-stage breakdown as JSON.
+///
+/// Should be called while no other thread is inside an instrumented scope.
+void write_json(FILE *fp);
+
+class ScopedTimer {
+ public:
+  ScopedTimer(const size_t stage, const uint64_t items);
+  ~ScopedTimer();
+
+ private:
+  ScopedTimer(const ScopedTimer &);
+  ScopedTimer &operator=(const ScopedTimer &);
+
+  const size_t stage_;  //< Stage identifier.
+  const uint64_t items_;  //< Number of items processed.
+  const uint64_t start_;  //< Start time in clock ticks.
+  const uint64_t allocations_;  //< Thread allocation count at start.
+};
+
+}  // namespace profile
+}  // namespace pathest
+
+#else  // PATHEST_PROFILE
+
+#define PATHEST_PROFILE_SCOPE(name)
+#define PATHEST_PROFILE_SCOPE_ITEMS(name, items)
+#define PATHEST_PROFILE_COUNT(name, items) do {} while (0)
+
+#endif  // PATHEST_PROFILE
+
+#endif  // PATHEST_PROFILE_H_
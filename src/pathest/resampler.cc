@@ -0,0 +1,172 @@
+/// @file pathest/resampler.cc
+/// @brief Class for resampling a path on a uniform clock.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/resampler.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <algorithm>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "pathest/location.h"
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+namespace {
+
+// Number of outputs whose segments are looked up before evaluating them.
+const size_t block_len = 256;
+
+}  // namespace
+
+Resampler::Resampler(PathView path, const Mode mode,
+                     std::pmr::memory_resource *resource) :
+  t_(resource),
+  x0_(resource), x1_(resource), x2_(resource), x3_(resource),
+  y0_(resource), y1_(resource), y2_(resource), y3_(resource) {
+  // Knots, averaging locations with equal timestamps.
+  this->t_.reserve(path.size());
+  this->x0_.reserve(path.size());
+  this->y0_.reserve(path.size());
+  for (size_t i = 0; i < path.size();) {
+    double t = path[i].t();
+    double sum_x = 0;
+    double sum_y = 0;
+    size_t j = i;
+    for (; j < path.size() && path[j].t() == t; ++j) {
+      sum_x += path[j].x();
+      sum_y += path[j].y();
+    }
+    this->t_.push_back(t);
+    this->x0_.push_back(sum_x / (j - i));
+    this->y0_.push_back(sum_y / (j - i));
+    i = j;
+  }
+
+  size_t knots = this->t_.size();
+  this->x1_.assign(knots, 0);
+  this->x2_.assign(knots, 0);
+  this->x3_.assign(knots, 0);
+  this->y1_.assign(knots, 0);
+  this->y2_.assign(knots, 0);
+  this->y3_.assign(knots, 0);
+  if (knots < 2) return;
+
+  array_type h(knots - 1, resource);
+  for (size_t i = 0; i + 1 < knots; ++i) h[i] = this->t_[i + 1] - this->t_[i];
+
+  if (mode == kCubic && knots > 2) {
+    this->fit_cubic(h, &this->x0_, &this->x1_, &this->x2_, &this->x3_);
+    this->fit_cubic(h, &this->y0_, &this->y1_, &this->y2_, &this->y3_);
+  } else {
+    for (size_t i = 0; i + 1 < knots; ++i) {
+      this->x1_[i] = (this->x0_[i + 1] - this->x0_[i]) / h[i];
+      this->y1_[i] = (this->y0_[i + 1] - this->y0_[i]) / h[i];
+    }
+  }
+}
+
+void Resampler::fit_cubic(const array_type &h, array_type *a, array_type *b,
+                          array_type *c, array_type *d) const {
+  // Solve the tridiagonal system for the second derivatives m at the inner
+  // knots, with m = 0 at both ends, by forward elimination and back
+  // substitution.
+  const size_t knots = a->size();
+  std::pmr::memory_resource *resource = a->get_allocator().resource();
+  array_type m(knots, 0.0, resource);
+  array_type upper(knots, 0.0, resource);
+  for (size_t i = 1; i + 1 < knots; ++i) {
+    double rhs = 6 * (((*a)[i + 1] - (*a)[i]) / h[i] -
+                      ((*a)[i] - (*a)[i - 1]) / h[i - 1]);
+    double diag = 2 * (h[i - 1] + h[i]) - h[i - 1] * upper[i - 1];
+    upper[i] = h[i] / diag;
+    m[i] = (rhs - h[i - 1] * m[i - 1]) / diag;
+  }
+  for (size_t i = knots - 2; i > 0; --i) m[i] -= upper[i] * m[i + 1];
+
+  for (size_t i = 0; i + 1 < knots; ++i) {
+    (*b)[i] = ((*a)[i + 1] - (*a)[i]) / h[i] - h[i] * (2 * m[i] + m[i + 1]) / 6;
+    (*c)[i] = m[i] / 2;
+    (*d)[i] = (m[i + 1] - m[i]) / (6 * h[i]);
+  }
+}
+
+bool Resampler::empty() const { return this->t_.empty(); }
+double Resampler::min_t() const { return this->t_.front(); }
+double Resampler::max_t() const { return this->t_.back(); }
+
+size_t Resampler::segment(const double time) const {
+  return std::upper_bound(this->t_.begin() + 1, this->t_.end(), time)
+    - this->t_.begin() - 1;
+}
+
+std::pair<double, double> Resampler::at(const double time) const {
+#ifdef DEBUG
+  assert(!this->empty());
+#endif
+  double t = std::min(std::max(time, this->min_t()), this->max_t());
+  size_t i = this->segment(t);
+  double u = t - this->t_[i];
+  return std::pair<double, double>(
+      this->x0_[i] + u * (this->x1_[i] + u * (this->x2_[i] + u * this->x3_[i])),
+      this->y0_[i] + u * (this->y1_[i] + u * (this->y2_[i] + u * this->y3_[i])));
+}
+
+void Resampler::resample(const double start, const double step, const size_t n,
+                         double *x, double *y) const {
+  if (this->empty()) return;
+  const double lo = this->min_t();
+  const double hi = this->max_t();
+  const size_t last = this->t_.size() - 1;
+  size_t seg[block_len];
+  double u[block_len];
+  size_t i = 0;
+  for (size_t begin = 0; begin < n; begin += block_len) {
+    size_t len = std::min(block_len, n - begin);
+
+    // Find the segment of every output in the block. Consecutive times
+    // usually share or advance the segment, so walk forward from the last.
+    for (size_t j = 0; j < len; ++j) {
+      double t = std::min(std::max(start + (begin + j) * step, lo), hi);
+      if (t < this->t_[i]) {
+        i = this->segment(t);
+      } else {
+        while (i < last && this->t_[i + 1] <= t) ++i;
+      }
+      seg[j] = i;
+      u[j] = t - this->t_[i];
+    }
+
+    // Evaluate the polynomials, with no branches.
+    double *out_x = x + begin;
+    double *out_y = y + begin;
+    for (size_t j = 0; j < len; ++j) {
+      size_t s = seg[j];
+      double v = u[j];
+      out_x[j] = this->x0_[s] +
+        v * (this->x1_[s] + v * (this->x2_[s] + v * this->x3_[s]));
+      out_y[j] = this->y0_[s] +
+        v * (this->y1_[s] + v * (this->y2_[s] + v * this->y3_[s]));
+    }
+  }
+}
+
+size_t Resampler::resample(const double step, std::vector<double> *x,
+                           std::vector<double> *y) const {
+  if (this->empty() || !(step > 0)) {
+    x->clear();
+    y->clear();
+    return 0;
+  }
+  size_t n = static_cast<size_t>((this->max_t() - this->min_t()) / step) + 1;
+  x->resize(n);
+  y->resize(n);
+  this->resample(this->min_t(), step, n, &(*x)[0], &(*y)[0]);
+  return n;
+}
+
+}  // namespace pathest
@@ -0,0 +1,101 @@
+/// @file pathest/resampler.h
+/// @brief Class for resampling a path on a uniform clock.
+///
+/// A resampler fits a curve through the locations of a path once, then
+/// evaluates it at any number of evenly spaced times. The curve is either
+/// piecewise linear or a natural cubic spline. Locations with equal timestamps
+/// are averaged into a single knot.
+///
+/// The curve is stored as one cubic polynomial per segment between knots, with
+/// the coefficients in separate arrays, so that evaluation is the same
+/// branch-free arithmetic in either mode. Output is written to separate x and
+/// y arrays with a fixed stride in time.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_RESAMPLER_H_
+#define PATHEST_RESAMPLER_H_
+
+#include <stddef.h>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+class Resampler {
+ public:
+  enum Mode {
+    kLinear,  //< Straight lines between locations.
+    kCubic  //< Natural cubic spline through the locations.
+  };
+
+  /// @brief Fit a curve through a path.
+  ///
+  /// @param path The locations, in chronological order.
+  /// @param mode The kind of curve.
+  /// @param resource The memory resource for the coefficients.
+  Resampler(PathView path, const Mode mode,
+            std::pmr::memory_resource *resource =
+            std::pmr::get_default_resource());
+  ~Resampler() {}
+
+  bool empty() const;  //< Whether the path had no locations.
+  double min_t() const;  //< Time of the first knot.
+  double max_t() const;  //< Time of the last knot.
+
+  /// @brief Evaluate the curve at one time.
+  ///
+  /// Times outside the path are clamped to its ends. Undefined behavior for
+  /// empty resamplers.
+  ///
+  /// @param time The time.
+  /// @returns the interpolated coordinates.
+  std::pair<double, double> at(const double time) const;
+
+  /// @brief Evaluate the curve on a uniform clock.
+  ///
+  /// Writes the coordinates at start + i * step for i in [0, n). Times outside
+  /// the path are clamped to its ends. Nothing is written for empty
+  /// resamplers.
+  ///
+  /// @param start The first time.
+  /// @param step The time between outputs.
+  /// @param n The number of outputs.
+  /// @param x The array for x coordinates, of at least n elements.
+  /// @param y The array for y coordinates, of at least n elements.
+  void resample(const double start, const double step, const size_t n,
+                double *x, double *y) const;
+
+  /// @brief Evaluate the curve on a uniform clock covering the path.
+  ///
+  /// Outputs start at min_t() and continue while within max_t().
+  ///
+  /// @param step The time between outputs, greater than zero.
+  /// @param x The vector to fill with x coordinates.
+  /// @param y The vector to fill with y coordinates.
+  /// @returns the number of outputs.
+  size_t resample(const double step, std::vector<double> *x,
+                  std::vector<double> *y) const;
+
+ private:
+  typedef std::pmr::vector<double> array_type;
+
+  // Knot times, and for each segment the polynomial coefficients in powers of
+  // the time since the start of the segment. The last knot has a segment of
+  // its own with only a constant term, so that clamped times need no special
+  // case.
+  array_type t_;
+  array_type x0_, x1_, x2_, x3_;
+  array_type y0_, y1_, y2_, y3_;
+
+  void fit_cubic(const array_type &h, array_type *a, array_type *b,
+                 array_type *c, array_type *d) const;
+  size_t segment(const double time) const;  //< Segment containing a time.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_RESAMPLER_H_
@@ -6,52 +6,141 @@
 #include "pathest/simple_moving_average.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
+#include <string.h>
+#include <memory_resource>
 #include <vector>
 
+#include "pathest/estimator_state.h"
 #include "pathest/location.h"
+#include "pathest/parallel.h"
 
 namespace pathest {
 
-SimpleMovingAverage::SimpleMovingAverage(const size_t samples) :
-  sum_x_(0.0),
-  sum_y_(0.0),
-  history_x_(std::vector<double>(samples)),
-  history_y_(std::vector<double>(samples)),
-  num_predicted_(0),
-  history_index_(0),
+namespace {
+
+const uint32_t state_version = 1;
+
+// Layout of a saved state, which is followed by the x and then the y history
+// buffer, as kept in the ring.
+struct SavedState {
+  StateHeader header;
+  uint64_t samples;
+  uint64_t num_predicted;
+  uint64_t history_index;
+  double sum_x;
+  double sum_y;
+  double comp_x;
+  double comp_y;
+};
+
+}  // namespace
+
+SimpleMovingAverage::SimpleMovingAverage(const size_t samples,
+                                         std::pmr::memory_resource *resource) :
+  sums_(),
+  history_x_(samples, resource),
+  history_y_(samples, resource),
   samples_(samples) {}
 
 Location SimpleMovingAverage::predict(const Location &loc) {
   if (!this->samples_) return loc;
 
 #ifdef DEBUG
-  assert(this->num_predicted_ <= this->samples_);
-  assert(this->history_index_ < this->samples_);  // No invalid array access.
+  assert(this->sums_.num_predicted <= this->samples_);
+  // No invalid array access.
+  assert(this->sums_.history_index < this->samples_);
 #endif
 
-  double x = loc.x();
-  double y = loc.y();
+  return this->sums_.add(loc, this->samples_, this->history_x_.data(),
+                         this->history_y_.data());
+}
+
+size_t SimpleMovingAverage::state_size() const {
+  return sizeof(SavedState) + 2 * this->samples_ * sizeof(double);
+}
 
-  if (this->num_predicted_ < this->samples_) {
-    ++this->num_predicted_;
-  } else {
-    this->sum_x_ -= this->history_x_[this->history_index_];
-    this->sum_y_ -= this->history_y_[this->history_index_];
+void SimpleMovingAverage::save_state(void *buf) const {
+  SavedState state;
+  state.header.kind = kSimpleMovingAverageState;
+  state.header.version = state_version;
+  state.samples = this->samples_;
+  state.num_predicted = this->sums_.num_predicted;
+  state.history_index = this->sums_.history_index;
+  state.sum_x = this->sums_.sum_x;
+  state.sum_y = this->sums_.sum_y;
+  state.comp_x = this->sums_.comp_x;
+  state.comp_y = this->sums_.comp_y;
+  unsigned char *out = static_cast<unsigned char *>(buf);
+  memcpy(out, &state, sizeof(state));
+  out += sizeof(state);
+  memcpy(out, this->history_x_.data(), this->samples_ * sizeof(double));
+  out += this->samples_ * sizeof(double);
+  memcpy(out, this->history_y_.data(), this->samples_ * sizeof(double));
+}
+
+bool SimpleMovingAverage::restore_state(const void *buf, const size_t len) {
+  if (!buf || len != this->state_size()) return false;
+  SavedState state;
+  memcpy(&state, buf, sizeof(state));
+  if (state.header.kind != kSimpleMovingAverageState ||
+      state.header.version != state_version ||
+      state.samples != this->samples_ ||
+      state.num_predicted > this->samples_ ||
+      (this->samples_ && state.history_index >= this->samples_) ||
+      (!this->samples_ && state.history_index)) {
+    return false;
   }
-  this->sum_x_ += x;
-  this->sum_y_ += y;
-  this->history_x_[this->history_index_] = x;
-  this->history_y_[this->history_index_] = y;
-  this->history_index_ = (this->history_index_ + 1) % this->samples_;
+  this->sums_.sum_x = state.sum_x;
+  this->sums_.sum_y = state.sum_y;
+  this->sums_.comp_x = state.comp_x;
+  this->sums_.comp_y = state.comp_y;
+  this->sums_.num_predicted = state.num_predicted;
+  this->sums_.history_index = state.history_index;
+  const unsigned char *in = static_cast<const unsigned char *>(buf);
+  in += sizeof(state);
+  memcpy(this->history_x_.data(), in, this->samples_ * sizeof(double));
+  in += this->samples_ * sizeof(double);
+  memcpy(this->history_y_.data(), in, this->samples_ * sizeof(double));
+  return true;
+}
 
-#ifdef DEBUG
-  assert(this->num_predicted_ > 0);  // No division by zero possible.
-#endif
+void SimpleMovingAverage::average_in_place(const size_t samples,
+                                           Location *locations,
+                                           const size_t n, unsigned threads,
+                                           std::pmr::memory_resource
+                                           *resource) {
+  if (!samples) return;
+  if (!threads) threads = default_threads();
+  size_t min_chunk = samples > kMinChunk ? samples : kMinChunk;
+  if (threads > n / min_chunk) threads = n / min_chunk;
+  if (threads < 2) {
+    SimpleMovingAverage sma(samples, resource);
+    for (size_t i = 0; i < n; ++i) locations[i] = sma.predict(locations[i]);
+    return;
+  }
+
+  // Keep the inputs that lead into each chunk, since the chunk before will
+  // have overwritten them by the time they are needed. Chunks are at least a
+  // window long, so these all come from the chunk just before.
+  const size_t warm_up = samples - 1;
+  std::vector<std::vector<Location> > leads(threads);
+  for (size_t c = 1; c < threads; ++c) {
+    const Location *begin = locations + chunk_begin(n, threads, c);
+    leads[c].assign(begin - warm_up, begin);
+  }
 
-  double pred_x = this->sum_x_ / this->num_predicted_;
-  double pred_y = this->sum_y_ / this->num_predicted_;
-  return Location(pred_x, pred_y, loc.t());
+  parallel_for(n, threads,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    // Worker threads must not share the caller's resource.
+    SimpleMovingAverage sma(samples);
+    const std::vector<Location> &lead = leads[chunk];
+    for (size_t i = 0; i < lead.size(); ++i) sma.predict(lead[i]);
+    for (size_t i = begin; i < end; ++i) {
+      locations[i] = sma.predict(locations[i]);
+    }
+  });
 }
 
 }  // namespace pathest
@@ -1,32 +1,124 @@
 /// @file pathest/simple_moving_average.h
 /// @brief Class for simple moving average.
+///
+/// The running sums are kept with Neumaier compensation, so adding each new
+/// sample and removing the oldest does not drift over long paths.
+///
 //===----------------------------------------------------------------------===//
 
 #ifndef PATHEST_SIMPLE_MOVING_AVERAGE_H_
 #define PATHEST_SIMPLE_MOVING_AVERAGE_H_
 
 #include <stddef.h>
+#include <memory_resource>
 #include <vector>
 
 #include "pathest/location.h"
+#include "pathest/summation.h"
 
 namespace pathest {
 
+/// @brief Running sums of a simple moving average.
+///
+/// Holds the update rule shared by SimpleMovingAverage and FixedMovingAverage
+/// (see pathest/pipeline.h), which differ only in where they keep the sample
+/// history. Defined inline so that pipeline stages inline it.
+struct MovingAverageSums {
+  MovingAverageSums() :
+    sum_x(0), sum_y(0), comp_x(0), comp_y(0), num_predicted(0),
+    history_index(0) {}
+
+  /// @brief Add a location to the window and get the average.
+  ///
+  /// @param loc The location, in chronological order.
+  /// @param samples The number of samples in the window, at least one.
+  /// @param history_x The ring of x coordinates, of samples elements.
+  /// @param history_y The ring of y coordinates, of samples elements.
+  Location add(const Location &loc, const size_t samples, double *history_x,
+               double *history_y) {
+    if (this->num_predicted < samples) {
+      ++this->num_predicted;
+    } else {
+      compensated_add(&this->sum_x, &this->comp_x,
+                      -history_x[this->history_index]);
+      compensated_add(&this->sum_y, &this->comp_y,
+                      -history_y[this->history_index]);
+    }
+    compensated_add(&this->sum_x, &this->comp_x, loc.x());
+    compensated_add(&this->sum_y, &this->comp_y, loc.y());
+    history_x[this->history_index] = loc.x();
+    history_y[this->history_index] = loc.y();
+    if (++this->history_index == samples) this->history_index = 0;
+    return Location((this->sum_x + this->comp_x) / this->num_predicted,
+                    (this->sum_y + this->comp_y) / this->num_predicted,
+                    loc.t());
+  }
+
+  double sum_x;  //< Sum of x coordinates.
+  double sum_y;  //< Sum of y coordinates.
+  double comp_x;  //< Compensation for rounding error in sum_x.
+  double comp_y;  //< Compensation for rounding error in sum_y.
+  size_t num_predicted;  //< Number of samples in history that are predicted.
+  size_t history_index;  //< Index into the history rings.
+};
+
 class SimpleMovingAverage {
  public:
-  explicit SimpleMovingAverage(const size_t samples);
+  /// @brief Create a simple moving average.
+  ///
+  /// @param samples The number of samples factored into each average.
+  /// @param resource The memory resource for the sample history.
+  explicit SimpleMovingAverage(const size_t samples,
+                               std::pmr::memory_resource *resource =
+                               std::pmr::get_default_resource());
   ~SimpleMovingAverage() {}
 
   /// Predict the next location in chronological order.
   Location predict(const Location &loc);
 
+  /// Size in bytes of the saved state.
+  size_t state_size() const;
+
+  /// @brief Save the state, as described in pathest/estimator_state.h.
+  ///
+  /// @param buf The buffer, of at least state_size() bytes.
+  void save_state(void *buf) const;
+
+  /// @brief Restore a state saved by an estimator with the same number of samples.
+  ///
+  /// @param buf The saved state.
+  /// @param len The size of the saved state in bytes.
+  /// @returns true if successful, false if the state is not valid for this
+  ///   estimator, which is then left unchanged.
+  bool restore_state(const void *buf, const size_t len);
+
+  /// @brief Average a sequence of locations in place.
+  ///
+  /// Gives the same result as calling predict() on each location in order,
+  /// up to rounding. Long sequences are split into chunks that are averaged
+  /// in parallel; each chunk first replays the samples - 1 inputs before it,
+  /// so the first chunk ramps up through partial averages exactly like
+  /// predict() and the others start with a full window. Sequences are only
+  /// split into chunks of at least kMinChunk locations and at least the
+  /// window size.
+  ///
+  /// @param samples The number of samples factored into each average.
+  /// @param locations The locations, in chronological order.
+  /// @param n The number of locations.
+  /// @param threads The number of threads, or zero for the default.
+  /// @param resource The memory resource for the sample history when running
+  ///   on the calling thread only.
+  static void average_in_place(const size_t samples, Location *locations,
+                               const size_t n, unsigned threads,
+                               std::pmr::memory_resource *resource =
+                               std::pmr::get_default_resource());
+
+  static const size_t kMinChunk = 64 * 1024;  //< Locations per thread.
+
  private:
-  double sum_x_;  //< Sum of x coordinates.
-  double sum_y_;  //< Sum of y coordinates.
-  std::vector<double> history_x_;  //< History of x coordinates.
-  std::vector<double> history_y_;  //< History of y coordinates.
-  size_t num_predicted_;  //< Number of samples in history that are predicted.
-  size_t history_index_;  //< Index into the history buffers.
+  MovingAverageSums sums_;  //< Running sums over the history.
+  std::pmr::vector<double> history_x_;  //< History of x coordinates.
+  std::pmr::vector<double> history_y_;  //< History of y coordinates.
   const size_t samples_;  //< Number of samples factored into each average.
 };
 
@@ -0,0 +1,155 @@
+/// @file pathest/smoothed_view.cc
+/// @brief Class for lazily smoothing parts of a path.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/smoothed_view.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
+#include <memory_resource>
+#include <vector>
+
+#include "pathest/exponential_smoothing.h"
+#include "pathest/kalman_filter.h"
+#include "pathest/location.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+#include "pathest/profile.h"
+#include "pathest/simple_moving_average.h"
+#include "pathest/time_moving_average.h"
+
+namespace pathest {
+
+namespace {
+
+// Run an estimator from warm to end, keeping the estimates from begin on.
+template <typename Estimator>
+void run(Estimator *estimator, const PathView &path, const size_t warm,
+         const size_t begin, const size_t end, Location *out) {
+  for (size_t i = warm; i < begin; ++i) estimator->predict(path[i]);
+  for (size_t i = begin; i < end; ++i) out[i] = estimator->predict(path[i]);
+}
+
+}  // namespace
+
+SmoothedView::SmoothedView(const Path &path, const Method method,
+                           const double param,
+                           std::pmr::memory_resource *resource) :
+  path_(path.view()),
+  method_(method),
+  param_(param),
+  valid_(true),
+  horizon_(0),
+  estimates_(resource),
+  done_(resource),
+  computed_(0) {
+  switch (method) {
+    case kSma:
+      this->valid_ = param >= 1;
+      break;
+    case kTma:
+      this->valid_ = param > 0;
+      break;
+    case kEs:
+      this->valid_ = param > 0 && param < 1.0;
+      // The start's weight after h steps is (1 - smoothing)^h.
+      if (this->valid_) {
+        this->horizon_ = static_cast<size_t>(
+            ceil(log(kEpsilon) / log(1 - param)));
+      }
+      break;
+    case kKf:
+      this->horizon_ = KalmanFilter::warm_up_steps(kEpsilon);
+      break;
+  }
+}
+
+size_t SmoothedView::size() const { return this->path_.size(); }
+size_t SmoothedView::computed() const { return this->computed_; }
+
+size_t SmoothedView::warm_up_start(const size_t i) const {
+  switch (this->method_) {
+    case kSma: {
+      size_t lead = static_cast<size_t>(this->param_) - 1;
+      return i > lead ? i - lead : 0;
+    }
+    case kTma:
+      // Locations after t - duration are in the window at t.
+      if (i >= this->path_.size()) return i;
+      return std::upper_bound(this->path_.begin(), this->path_.begin() + i,
+                              Location(0, 0, this->path_[i].t() - this->param_),
+                              Location::comp_t) - this->path_.begin();
+    case kEs:
+    case kKf:
+      return i > this->horizon_ ? i - this->horizon_ : 0;
+  }
+  return 0;
+}
+
+void SmoothedView::compute(const size_t begin, const size_t end) {
+  PATHEST_PROFILE_SCOPE_ITEMS("smoothed_view", end - begin);
+  size_t warm = this->warm_up_start(begin);
+  Location *out = this->estimates_.data();
+  std::pmr::memory_resource *resource =
+    this->estimates_.get_allocator().resource();
+  switch (this->method_) {
+    case kSma: {
+      SimpleMovingAverage sma(static_cast<size_t>(this->param_), resource);
+      run(&sma, this->path_, warm, begin, end, out);
+      break;
+    }
+    case kTma: {
+      TimeMovingAverage tma(this->param_, resource);
+      run(&tma, this->path_, warm, begin, end, out);
+      break;
+    }
+    case kEs: {
+      ExponentialSmoothing es(this->param_);
+      run(&es, this->path_, warm, begin, end, out);
+      break;
+    }
+    case kKf: {
+      KalmanFilter kf(KalmanFilter::kSteadyState);
+      run(&kf, this->path_, warm, begin, end, out);
+      break;
+    }
+  }
+  this->computed_ += end - begin;
+}
+
+PathView SmoothedView::range(const double t1, const double t2) {
+  if (!this->valid_) return PathView();
+  PathView slice = this->path_.slice(t1, t2);
+  if (slice.empty()) return PathView();
+  size_t first = slice.begin() - this->path_.begin();
+  size_t last = first + slice.size();
+
+  if (this->estimates_.empty()) {
+    size_t n = this->path_.size();
+    this->estimates_.assign(n, Location(0, 0, 0));
+    this->done_.assign((n + kBlockSize - 1) / kBlockSize, false);
+  }
+
+  // Compute each run of consecutive missing blocks with one warm-up.
+  size_t block = first / kBlockSize;
+  size_t last_block = (last - 1) / kBlockSize;
+  while (block <= last_block) {
+    if (this->done_[block]) {
+      ++block;
+      continue;
+    }
+    size_t run_end = block;
+    while (run_end <= last_block && !this->done_[run_end]) {
+      this->done_[run_end] = true;
+      ++run_end;
+    }
+    this->compute(block * kBlockSize,
+                  std::min(run_end * kBlockSize, this->path_.size()));
+    block = run_end;
+  }
+  return PathView(this->estimates_.data() + first,
+                  this->estimates_.data() + last);
+}
+
+}  // namespace pathest
@@ -0,0 +1,100 @@
+/// @file pathest/smoothed_view.h
+/// @brief Class for lazily smoothing parts of a path.
+///
+/// A smoothed view gives the estimates of a path for a time range without
+/// smoothing the rest of the path. Each estimator only depends on a bounded
+/// stretch of the locations before an estimate, so a range is computed by
+/// starting a fresh estimator that far back:
+///
+/// - Simple moving average: the samples - 1 locations before.
+/// - Time moving average: the locations within the duration before.
+/// - Exponential smoothing: enough locations for the weight of the skipped
+///   start to decay below epsilon.
+/// - Kalman filter: enough locations for the gain to converge and the state
+///   difference to decay below epsilon (see KalmanFilter::warm_up_steps()).
+///
+/// The moving averages are therefore exact, and the others agree with the
+/// full path estimates to within epsilon of the state they forget. Estimates
+/// are computed in blocks of kBlockSize locations and kept, so later queries
+/// only compute blocks they have not seen. Consecutive missing blocks share one
+/// warm-up.
+///
+/// A view refers to its path, which must outlive it and stay unmodified. A
+/// view is not safe to use from multiple threads at once.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_SMOOTHED_VIEW_H_
+#define PATHEST_SMOOTHED_VIEW_H_
+
+#include <stddef.h>
+#include <memory_resource>
+#include <vector>
+
+#include "pathest/location.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+class SmoothedView {
+ public:
+  enum Method {
+    kSma,  //< Simple moving average with a number of samples.
+    kTma,  //< Time moving average with a duration.
+    kEs,  //< Exponential smoothing with a smoothing factor.
+    kKf  //< Kalman filter, without a parameter.
+  };
+
+  /// @brief Create a smoothed view of a path.
+  ///
+  /// Nothing is computed until the first query. Invalid parameters, as for
+  /// the Path functions, give empty ranges.
+  ///
+  /// @param path The path to smooth.
+  /// @param method The estimator.
+  /// @param param The parameter of the estimator.
+  /// @param resource The memory resource for the estimates.
+  SmoothedView(const Path &path, const Method method, const double param = 0,
+               std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource());
+  ~SmoothedView() {}
+
+  static const size_t kBlockSize = 4096;  //< Locations per memoized block.
+  static constexpr double kEpsilon = 1e-12;  //< Tolerance for warm-ups.
+
+  /// @brief Get the estimates within a time range.
+  ///
+  /// Computes any blocks of the range not computed before.
+  ///
+  /// @param t1 The start of the range, inclusive.
+  /// @param t2 The end of the range, inclusive.
+  /// @returns a view of the estimates, valid until the smoothed view is
+  ///   destroyed.
+  PathView range(const double t1, const double t2);
+
+  size_t size() const;  //< Number of locations in the path.
+  size_t computed() const;  //< Number of locations estimated so far.
+
+  /// @brief Get the warm-up for estimates starting at an index.
+  ///
+  /// @param i The index of the first estimate.
+  /// @returns the index at which to start a fresh estimator.
+  size_t warm_up_start(const size_t i) const;
+
+ private:
+  PathView path_;  //< Locations to smooth.
+  const Method method_;  //< Estimator.
+  const double param_;  //< Parameter of the estimator.
+  bool valid_;  //< Whether the parameter is valid for the estimator.
+  size_t horizon_;  //< Warm-up length for ES and KF.
+  std::pmr::vector<Location> estimates_;  //< Estimates, once computed.
+  std::pmr::vector<bool> done_;  //< Whether each block is computed.
+  size_t computed_;  //< Number of locations estimated.
+
+  void compute(const size_t begin, const size_t end);  //< Estimate a run.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_SMOOTHED_VIEW_H_
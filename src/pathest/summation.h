@@ -0,0 +1,32 @@
+/// @file pathest/summation.h
+/// @brief Helpers for accurate floating point sums.
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_SUMMATION_H_
+#define PATHEST_SUMMATION_H_
+
+#include <math.h>
+
+namespace pathest {
+
+/// @brief Add a value to a sum, accumulating the rounding error separately.
+///
+/// Neumaier's variant of Kahan summation: the exact sum is *sum + *comp, and
+/// stays accurate when values are subtracted again, as in a running window.
+///
+/// @param sum The rounded sum.
+/// @param comp The accumulated rounding error.
+/// @param value The value to add.
+inline void compensated_add(double *sum, double *comp, const double value) {
+  double total = *sum + value;
+  if (fabs(*sum) >= fabs(value)) {
+    *comp += (*sum - total) + value;
+  } else {
+    *comp += (value - total) + *sum;
+  }
+  *sum = total;
+}
+
+}  // namespace pathest
+
+#endif  // PATHEST_SUMMATION_H_
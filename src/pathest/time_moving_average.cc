@@ -0,0 +1,82 @@
+/// @file pathest/time_moving_average.cc
+/// @brief Class for moving average over a time window.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/time_moving_average.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <memory_resource>
+#include <vector>
+
+#include "pathest/location.h"
+#include "pathest/summation.h"
+
+namespace pathest {
+
+namespace {
+
+// Initial capacity of the sample window.
+const size_t initial_capacity = 16;
+
+}  // namespace
+
+TimeMovingAverage::TimeMovingAverage(const double duration,
+                                     std::pmr::memory_resource *resource) :
+  window_(resource),
+  head_(0),
+  size_(0),
+  sum_x_(0.0),
+  sum_y_(0.0),
+  comp_x_(0.0),
+  comp_y_(0.0),
+  duration_(duration) {}
+
+size_t TimeMovingAverage::size() const { return this->size_; }
+
+void TimeMovingAverage::grow() {
+  size_t capacity = this->window_.size();
+  std::pmr::vector<Location> window(this->window_.get_allocator().resource());
+  window.reserve(capacity ? 2 * capacity : initial_capacity);
+  for (size_t i = 0; i < this->size_; ++i) {
+    window.push_back(this->window_[(this->head_ + i) % capacity]);
+  }
+  window.resize(window.capacity(), Location(0, 0, 0));
+  this->window_.swap(window);
+  this->head_ = 0;
+}
+
+Location TimeMovingAverage::predict(const Location &loc) {
+  if (this->duration_ <= 0) return loc;
+
+  // Evict samples that have left the window.
+  double start = loc.t() - this->duration_;
+  while (this->size_ && this->window_[this->head_].t() <= start) {
+    const Location &old = this->window_[this->head_];
+    compensated_add(&this->sum_x_, &this->comp_x_, -old.x());
+    compensated_add(&this->sum_y_, &this->comp_y_, -old.y());
+    this->head_ = (this->head_ + 1) % this->window_.size();
+    --this->size_;
+  }
+  if (!this->size_) {
+    // Start from exact zero rather than the rounding left by evictions.
+    this->sum_x_ = this->sum_y_ = this->comp_x_ = this->comp_y_ = 0;
+  }
+
+  if (this->size_ == this->window_.size()) this->grow();
+  size_t tail = (this->head_ + this->size_) % this->window_.size();
+  this->window_[tail] = loc;
+  ++this->size_;
+  compensated_add(&this->sum_x_, &this->comp_x_, loc.x());
+  compensated_add(&this->sum_y_, &this->comp_y_, loc.y());
+
+#ifdef DEBUG
+  assert(this->size_ > 0);  // No division by zero possible.
+#endif
+
+  double pred_x = (this->sum_x_ + this->comp_x_) / this->size_;
+  double pred_y = (this->sum_y_ + this->comp_y_) / this->size_;
+  return Location(pred_x, pred_y, loc.t());
+}
+
+}  // namespace pathest
@@ -0,0 +1,58 @@
+/// @file pathest/time_moving_average.h
+/// @brief Class for moving average over a time window.
+///
+/// Unlike the simple moving average, which averages a fixed number of
+/// samples, each estimate averages the samples within a fixed duration of the
+/// newest one. Bursts of reports then count for the time they cover rather
+/// than crowding out older samples.
+///
+/// Samples in the window are kept in a ring buffer that grows as needed, so
+/// memory is bounded by the largest number of samples ever in the window.
+/// Each sample is added and evicted once, with compensated running sums.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_TIME_MOVING_AVERAGE_H_
+#define PATHEST_TIME_MOVING_AVERAGE_H_
+
+#include <stddef.h>
+#include <memory_resource>
+#include <vector>
+
+#include "pathest/location.h"
+
+namespace pathest {
+
+class TimeMovingAverage {
+ public:
+  /// @brief Create a time moving average.
+  ///
+  /// @param duration The length of the window. Samples newer than the given
+  ///   location's timestamp minus the duration are averaged.
+  /// @param resource The memory resource for the sample window.
+  explicit TimeMovingAverage(const double duration,
+                             std::pmr::memory_resource *resource =
+                             std::pmr::get_default_resource());
+  ~TimeMovingAverage() {}
+
+  /// Predict the next location in chronological order.
+  Location predict(const Location &loc);
+
+  size_t size() const;  //< Number of samples in the window.
+
+ private:
+  std::pmr::vector<Location> window_;  //< Ring buffer of samples.
+  size_t head_;  //< Index of the oldest sample in the window.
+  size_t size_;  //< Number of samples in the window.
+  double sum_x_;  //< Sum of x coordinates.
+  double sum_y_;  //< Sum of y coordinates.
+  double comp_x_;  //< Compensation for rounding error in sum_x_.
+  double comp_y_;  //< Compensation for rounding error in sum_y_.
+  const double duration_;  //< Length of the window.
+
+  void grow();  //< Double the capacity of the ring buffer.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_TIME_MOVING_AVERAGE_H_
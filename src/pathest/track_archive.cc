@@ -0,0 +1,109 @@
+/// @file pathest/track_archive.cc
+/// @brief Classes for storing many paths in one indexed file.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/track_archive.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#include "pathest/indexed_file.h"
+#include "pathest/location.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+namespace {
+
+const IndexedFileFormat format = {{'P', 'A', 'R', 'C'}, 1, true};
+
+// Number of locations converted per write call.
+const size_t block_len = 1024;
+
+// Mapped tracks are read as locations in place.
+static_assert(std::is_standard_layout<Location>::value &&
+              sizeof(Location) == 3 * sizeof(double),
+              "locations must have the layout of three doubles");
+static_assert(sizeof(ArchiveEntry) == 40, "index entries must be packed");
+
+// Check whether the locations of a track fit in the rest of the file.
+bool track_fits(const ArchiveEntry &entry, const uint64_t available) {
+  return entry.count <= available / sizeof(Location);
+}
+
+}  // namespace
+
+bool is_track_archive(const void *buf, const size_t len) {
+  return has_indexed_file_magic(format, buf, len);
+}
+
+ArchiveWriter::ArchiveWriter() : file_(format) {}
+
+bool ArchiveWriter::open(const char *filename, const size_t num_tracks) {
+  return this->file_.open(filename, num_tracks);
+}
+
+bool ArchiveWriter::add(const uint64_t id, PathView path) {
+  if (!this->file_.can_add()) return false;
+  ArchiveEntry entry;
+  entry.id = id;
+  entry.offset = this->file_.offset();
+  entry.count = path.size();
+  entry.min_t = path.empty() ? 0 : path.front().t();
+  entry.max_t = path.empty() ? 0 : path.back().t();
+
+  double buf[3 * block_len];
+  size_t len = 0;
+  for (PathView::const_iterator it = path.begin(); it != path.end(); ++it) {
+    buf[3 * len] = it->x();
+    buf[3 * len + 1] = it->y();
+    buf[3 * len + 2] = it->t();
+    if (++len == block_len || it + 1 == path.end()) {
+      if (!this->file_.write(buf, 3 * len * sizeof(double))) return false;
+      len = 0;
+    }
+  }
+  return this->file_.add(entry);
+}
+
+bool ArchiveWriter::close() {
+  return this->file_.close();
+}
+
+Archive::Archive() : file_(format) {}
+
+bool Archive::open(const char *filename) {
+  return this->file_.open(filename, track_fits);
+}
+
+void Archive::close() {
+  this->file_.close();
+}
+
+bool Archive::empty() const { return this->file_.empty(); }
+size_t Archive::size() const { return this->file_.size(); }
+
+const ArchiveEntry *Archive::find(const uint64_t id) const {
+  return this->file_.find(id);
+}
+
+PathView Archive::track(const ArchiveEntry &entry) const {
+  const Location *begin =
+    static_cast<const Location *>(this->file_.record(entry));
+  return PathView(begin, entry.count);
+}
+
+bool Archive::read(const uint64_t id, Path *path) const {
+  const ArchiveEntry *entry = this->find(id);
+  if (!entry || !path) return false;
+  PathView view = this->track(*entry);
+  path->reserve(path->size() + view.size());
+  for (PathView::const_iterator it = view.begin(); it != view.end(); ++it) {
+    path->insert(*it);
+  }
+  return true;
+}
+
+}  // namespace pathest
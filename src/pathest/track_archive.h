@@ -0,0 +1,158 @@
+/// @file pathest/track_archive.h
+/// @brief Classes for storing many paths in one indexed file.
+///
+/// A track archive holds any number of tracks, each with a 64-bit id, behind
+/// an index that gives the position and time span of every track. A reader
+/// maps the file into memory and looks tracks up in the index, so loading one
+/// track reads only the index and that track's pages, never the rest of the
+/// file. An archive is an indexed file (see pathest/indexed_file.h) laid out
+/// as:
+///
+///   char     magic[4]    "PARC"
+///   uint32_t version     1
+///   uint64_t count       Number of tracks.
+///   Entry    index[n]    One entry per track, in increasing order of id.
+///   double   data[...]   For each track, x, y and timestamp of each location,
+///                        in time order, as in the binary track format.
+///
+/// Each index entry is:
+///
+///   uint64_t id          Track id.
+///   uint64_t offset      Offset of the track data from the start of the file.
+///   uint64_t count       Number of locations.
+///   double   min_t       Timestamp of the first location.
+///   double   max_t       Timestamp of the last location.
+///
+/// All fields use the byte order of the host that wrote the file, and all
+/// offsets are multiples of 8, so mapped tracks can be read in place.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_TRACK_ARCHIVE_H_
+#define PATHEST_TRACK_ARCHIVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pathest/indexed_file.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+/// Size in bytes of the archive header.
+const size_t kArchiveHeaderSize = kIndexedFileHeaderSize;
+
+/// @brief Check whether a buffer starts with a track archive header.
+///
+/// @param buf The buffer.
+/// @param len The number of bytes in the buffer.
+bool is_track_archive(const void *buf, const size_t len);
+
+/// Index entry of one track in an archive.
+struct ArchiveEntry {
+  uint64_t id;  //< Track id.
+  uint64_t offset;  //< Offset of the track data in the file, in bytes.
+  uint64_t count;  //< Number of locations.
+  double min_t;  //< Timestamp of the first location.
+  double max_t;  //< Timestamp of the last location.
+};
+
+/// @brief Writer of a track archive.
+///
+/// Tracks are appended in any order of id, and the index is written, sorted by
+/// id, when the archive is closed. The number of tracks must be known when the
+/// archive is opened, so that the data can follow the index directly. The
+/// archive is written under a temporary name and only replaces an existing
+/// file once it is closed successfully.
+class ArchiveWriter {
+ public:
+  ArchiveWriter();
+  ~ArchiveWriter() {}  //< Closes the archive if it is still open.
+
+  ArchiveWriter(const ArchiveWriter &) = delete;
+  ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+
+  /// @brief Create an archive file.
+  ///
+  /// @param filename The file to create.
+  /// @param num_tracks The number of tracks that will be added.
+  /// @returns true if successful, false otherwise.
+  bool open(const char *filename, const size_t num_tracks);
+
+  /// @brief Append a track.
+  ///
+  /// @param id The track id, different from that of every other track.
+  /// @param path The locations of the track.
+  /// @returns true if successful, false otherwise, including when more tracks
+  ///   are added than were given to open().
+  bool add(const uint64_t id, PathView path);
+
+  /// @brief Write the index and close the file.
+  ///
+  /// @returns true if successful, false otherwise, including when fewer tracks
+  ///   were added than were given to open() or two tracks share an id.
+  bool close();
+
+ private:
+  IndexedFileWriter<ArchiveEntry> file_;  //< Writer of the archive file.
+};
+
+/// @brief Reader of a track archive.
+///
+/// The file is mapped read-only, and tracks are read in place from the
+/// mapping. An archive is safe to read from multiple threads at once.
+class Archive {
+ public:
+  Archive();
+  ~Archive() {}  //< Unmaps the file.
+
+  Archive(const Archive &) = delete;
+  Archive &operator=(const Archive &) = delete;
+
+  /// @brief Map an archive file.
+  ///
+  /// Checks the header and that the index is sorted and within the file.
+  ///
+  /// @param filename The file to map.
+  /// @returns true if successful, false otherwise.
+  bool open(const char *filename);
+
+  void close();  //< Unmap the file. Views of its tracks become invalid.
+
+  bool empty() const;
+  size_t size() const;  //< Number of tracks.
+
+  /// Get an index entry by position, in increasing order of id.
+  const ArchiveEntry &operator[](const size_t i) const {
+    return this->file_[i];
+  }
+
+  /// @brief Find a track by id.
+  ///
+  /// @param id The track id.
+  /// @returns the index entry, or NULL if there is no such track.
+  const ArchiveEntry *find(const uint64_t id) const;
+
+  /// @brief View the locations of a track in place.
+  ///
+  /// @param entry An index entry of this archive.
+  /// @returns a view valid until the archive is closed.
+  PathView track(const ArchiveEntry &entry) const;
+
+  /// @brief Copy the locations of a track to a path.
+  ///
+  /// Locations are appended to the given path.
+  ///
+  /// @param id The track id.
+  /// @param path The path to append to.
+  /// @returns true if successful, false if there is no such track.
+  bool read(const uint64_t id, Path *path) const;
+
+ private:
+  IndexedFile<ArchiveEntry> file_;  //< Mapped archive file.
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_TRACK_ARCHIVE_H_
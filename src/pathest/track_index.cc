@@ -0,0 +1,479 @@
+/// @file pathest/track_index.cc
+/// @brief Class for finding tracks by region, time and distance.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/track_index.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "pathest/location.h"
+#include "pathest/parallel.h"
+#include "pathest/path_view.h"
+#include "pathest/track_archive.h"
+
+namespace pathest {
+
+namespace {
+
+// Bounds, number, total extent and total duration of the segments of a chunk
+// of tracks.
+struct ChunkBounds {
+  ChunkBounds() :
+    min_x(HUGE_VAL), min_y(HUGE_VAL), max_x(-HUGE_VAL), max_y(-HUGE_VAL),
+    min_t(HUGE_VAL), max_t(-HUGE_VAL), segments(0), extent(0), duration(0) {}
+
+  double min_x;
+  double min_y;
+  double max_x;
+  double max_y;
+  double min_t;
+  double max_t;
+  size_t segments;
+  double extent;  // Sum of the larger side of each segment's bounding box.
+  double duration;  // Sum of the duration of each segment.
+};
+
+// Number of segments of a track.
+size_t num_segments(PathView track) {
+  return track.size() > 1 ? track.size() - 1 : track.size();
+}
+
+// Whether the segment from (x1, y1) to (x2, y2) crosses a region, by
+// Liang-Barsky clipping.
+bool crosses(const double x1, const double y1, const double x2,
+             const double y2, const TrackIndex::Region &region) {
+  const double dx = x2 - x1;
+  const double dy = y2 - y1;
+  const double p[4] = {-dx, dx, -dy, dy};
+  const double q[4] = {x1 - region.min_x, region.max_x - x1,
+                       y1 - region.min_y, region.max_y - y1};
+  double s0 = 0;
+  double s1 = 1;
+  for (int i = 0; i < 4; ++i) {
+    if (p[i] == 0) {
+      if (q[i] < 0) return false;
+    } else {
+      double s = q[i] / p[i];
+      if (p[i] < 0) {
+        if (s > s1) return false;
+        if (s > s0) s0 = s;
+      } else {
+        if (s < s0) return false;
+        if (s < s1) s1 = s;
+      }
+    }
+  }
+  return true;
+}
+
+// Distance from a point to the segment from (x1, y1) to (x2, y2).
+double distance(const double x, const double y, const double x1,
+                const double y1, const double x2, const double y2) {
+  const double dx = x2 - x1;
+  const double dy = y2 - y1;
+  const double len2 = dx * dx + dy * dy;
+  double s = len2 > 0 ? ((x - x1) * dx + (y - y1) * dy) / len2 : 0;
+  s = s < 0 ? 0 : (s > 1 ? 1 : s);
+  return hypot(x - (x1 + s * dx), y - (y1 + s * dy));
+}
+
+// Whether two distances found by nearest() are of the same track.
+bool same_track(const std::pair<uint32_t, double> &f1,
+                const std::pair<uint32_t, double> &f2) {
+  return f1.first == f2.first;
+}
+
+bool comp_neighbor(const TrackIndex::Neighbor &n1,
+                   const TrackIndex::Neighbor &n2) {
+  return n1.distance < n2.distance ||
+    (n1.distance == n2.distance && n1.id < n2.id);
+}
+
+}  // namespace
+
+TrackIndex::TrackIndex() :
+  ids_(), tracks_(), segments_(0), min_x_(0), min_y_(0), cell_(1), nx_(1),
+  ny_(1), min_t_(0), slab_(1), nt_(1), list_start_(2, 0), entries_() {}
+
+bool TrackIndex::build(const std::vector<uint64_t> &ids,
+                       const std::vector<PathView> &tracks,
+                       unsigned threads) {
+  this->clear();
+  // Entries number tracks and segments with 32 bits.
+  if (ids.size() != tracks.size() || tracks.size() > UINT32_MAX) return false;
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    if (tracks[i].size() > UINT32_MAX) return false;
+  }
+  this->ids_ = ids;
+  this->tracks_ = tracks;
+  const size_t n = this->tracks_.size();
+  if (!threads) threads = default_threads();
+  const size_t chunks = threads < n ? threads : (n ? n : 1);
+
+  // Find the bounds of all segments.
+  std::vector<ChunkBounds> parts(chunks);
+  parallel_for(n, threads,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    ChunkBounds &part = parts[chunk];
+    for (size_t i = begin; i < end; ++i) {
+      PathView track = this->tracks_[i];
+      part.segments += num_segments(track);
+      for (PathView::const_iterator it = track.begin(); it != track.end();
+           ++it) {
+        if (it->x() < part.min_x) part.min_x = it->x();
+        if (it->x() > part.max_x) part.max_x = it->x();
+        if (it->y() < part.min_y) part.min_y = it->y();
+        if (it->y() > part.max_y) part.max_y = it->y();
+        if (it->t() < part.min_t) part.min_t = it->t();
+        if (it->t() > part.max_t) part.max_t = it->t();
+        if (it != track.begin()) {
+          part.extent += std::max(fabs(it->x() - (it - 1)->x()),
+                                  fabs(it->y() - (it - 1)->y()));
+          part.duration += it->t() - (it - 1)->t();
+        }
+      }
+    }
+  });
+  ChunkBounds bounds;
+  for (size_t c = 0; c < chunks; ++c) {
+    bounds.min_x = std::min(bounds.min_x, parts[c].min_x);
+    bounds.min_y = std::min(bounds.min_y, parts[c].min_y);
+    bounds.max_x = std::max(bounds.max_x, parts[c].max_x);
+    bounds.max_y = std::max(bounds.max_y, parts[c].max_y);
+    bounds.min_t = std::min(bounds.min_t, parts[c].min_t);
+    bounds.max_t = std::max(bounds.max_t, parts[c].max_t);
+    bounds.segments += parts[c].segments;
+    bounds.extent += parts[c].extent;
+    bounds.duration += parts[c].duration;
+  }
+  this->segments_ = bounds.segments;
+
+  // Size square cells for a few segments each, within the cell limit. Cells
+  // are no smaller than the average segment, which would otherwise be listed
+  // in many of them.
+  this->min_x_ = this->segments_ ? bounds.min_x : 0;
+  this->min_y_ = this->segments_ ? bounds.min_y : 0;
+  double width = this->segments_ ? bounds.max_x - bounds.min_x : 0;
+  double height = this->segments_ ? bounds.max_y - bounds.min_y : 0;
+  double target = this->segments_ / kSegmentsPerCell;
+  if (target < 1) target = 1;
+  if (target > kMaxCells) target = kMaxCells;
+  this->cell_ = sqrt(width * height / target);
+  if (!(this->cell_ > 0)) this->cell_ = std::max(width, height) / target;
+  if (this->segments_ && this->cell_ < bounds.extent / this->segments_) {
+    this->cell_ = bounds.extent / this->segments_;
+  }
+  if (!(this->cell_ > 0)) this->cell_ = 1;
+  for (;;) {
+    this->nx_ = static_cast<size_t>(width / this->cell_) + 1;
+    this->ny_ = static_cast<size_t>(height / this->cell_) + 1;
+    if (this->nx_ <= kMaxCells / this->ny_) break;
+    this->cell_ *= 1.5;
+  }
+  const size_t cells = this->nx_ * this->ny_;
+
+  // Divide time into slabs for a few segments per list, within the cell
+  // limit. Slabs are no shorter than the average segment, for the same reason
+  // as cells.
+  this->min_t_ = this->segments_ ? bounds.min_t : 0;
+  double duration = this->segments_ ? bounds.max_t - bounds.min_t : 0;
+  double slabs =
+    static_cast<double>(this->segments_) / (kSegmentsPerCell * cells);
+  if (bounds.duration > 0) {
+    slabs = std::min(slabs, duration / (bounds.duration / this->segments_));
+  }
+  if (slabs > kMaxCells / cells) slabs = kMaxCells / cells;
+  this->nt_ = slabs > 1 ? static_cast<size_t>(slabs) : 1;
+  this->slab_ = duration / this->nt_;
+  if (!(this->slab_ > 0)) this->slab_ = 1;
+  const size_t lists = cells * this->nt_;
+
+  // Count the segments of each chunk in each list, in as many chunks as the
+  // limit on counts allows.
+  const unsigned grid_chunks = static_cast<unsigned>(
+      std::min(chunks, std::max(kMaxCounts / lists, static_cast<size_t>(1))));
+  std::vector<uint32_t> offsets(grid_chunks * lists, 0);
+  std::vector<char> overflow(grid_chunks, 0);
+  parallel_for(n, grid_chunks,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    uint32_t *counts = &offsets[chunk * lists];
+    char &wrapped = overflow[chunk];
+    for (size_t i = begin; i < end; ++i) {
+      PathView track = this->tracks_[i];
+      for (size_t s = 0; s < num_segments(track); ++s) {
+        const Location &a = track[s];
+        const Location &b = track[s + 1 < track.size() ? s + 1 : s];
+        size_t c1 = this->col(std::min(a.x(), b.x()));
+        size_t c2 = this->col(std::max(a.x(), b.x()));
+        size_t r1 = this->row(std::min(a.y(), b.y()));
+        size_t r2 = this->row(std::max(a.y(), b.y()));
+        size_t t1 = this->slab(std::min(a.t(), b.t()));
+        size_t t2 = this->slab(std::max(a.t(), b.t()));
+        for (size_t r = r1; r <= r2; ++r) {
+          for (size_t c = c1; c <= c2; ++c) {
+            size_t cell = r * this->nx_ + c;
+            for (size_t t = t1; t <= t2; ++t) {
+              if (!++counts[cell * this->nt_ + t]) wrapped = 1;
+            }
+          }
+        }
+      }
+    }
+  });
+
+  if (std::find(overflow.begin(), overflow.end(), 1) != overflow.end()) {
+    this->clear();
+    return false;
+  }
+
+  // Lay the lists out one after another, with the segments of each chunk in
+  // chunk order within a list, so that the lists are in track order. Offsets
+  // within a list, like the counts, must fit in 32 bits.
+  this->list_start_.assign(lists + 1, 0);
+  uint64_t total = 0;
+  for (size_t list = 0; list < lists; ++list) {
+    this->list_start_[list] = total;
+    for (size_t c = 0; c < grid_chunks; ++c) {
+      uint32_t count = offsets[c * lists + list];
+      offsets[c * lists + list] = total - this->list_start_[list];
+      total += count;
+    }
+    if (total - this->list_start_[list] > UINT32_MAX) {
+      this->clear();
+      return false;
+    }
+  }
+  if (total > this->entries_.max_size()) {
+    this->clear();
+    return false;
+  }
+  this->list_start_[lists] = total;
+  this->entries_.resize(total);
+
+  // Place the segments.
+  parallel_for(n, grid_chunks,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    uint32_t *next = &offsets[chunk * lists];
+    for (size_t i = begin; i < end; ++i) {
+      PathView track = this->tracks_[i];
+      for (size_t s = 0; s < num_segments(track); ++s) {
+        const Location &a = track[s];
+        const Location &b = track[s + 1 < track.size() ? s + 1 : s];
+        size_t c1 = this->col(std::min(a.x(), b.x()));
+        size_t c2 = this->col(std::max(a.x(), b.x()));
+        size_t r1 = this->row(std::min(a.y(), b.y()));
+        size_t r2 = this->row(std::max(a.y(), b.y()));
+        size_t t1 = this->slab(std::min(a.t(), b.t()));
+        size_t t2 = this->slab(std::max(a.t(), b.t()));
+        Entry entry = {static_cast<uint32_t>(i), static_cast<uint32_t>(s)};
+        for (size_t r = r1; r <= r2; ++r) {
+          for (size_t c = c1; c <= c2; ++c) {
+            size_t cell = r * this->nx_ + c;
+            for (size_t t = t1; t <= t2; ++t) {
+              size_t list = cell * this->nt_ + t;
+              this->entries_[this->list_start_[list] + next[list]++] = entry;
+            }
+          }
+        }
+      }
+    }
+  });
+  return true;
+}
+
+bool TrackIndex::build(const Archive &archive, unsigned threads) {
+  std::vector<uint64_t> ids(archive.size());
+  std::vector<PathView> tracks(archive.size());
+  for (size_t i = 0; i < archive.size(); ++i) {
+    ids[i] = archive[i].id;
+    tracks[i] = archive.track(archive[i]);
+  }
+  return this->build(ids, tracks, threads);
+}
+
+void TrackIndex::clear() {
+  this->ids_.clear();
+  this->tracks_.clear();
+  this->segments_ = 0;
+  this->min_x_ = 0;
+  this->min_y_ = 0;
+  this->cell_ = 1;
+  this->nx_ = 1;
+  this->ny_ = 1;
+  this->min_t_ = 0;
+  this->slab_ = 1;
+  this->nt_ = 1;
+  this->list_start_.assign(2, 0);
+  this->entries_.clear();
+}
+
+bool TrackIndex::empty() const { return this->ids_.empty(); }
+size_t TrackIndex::size() const { return this->ids_.size(); }
+size_t TrackIndex::segments() const { return this->segments_; }
+size_t TrackIndex::cells() const { return this->nx_ * this->ny_; }
+size_t TrackIndex::slabs() const { return this->nt_; }
+
+size_t TrackIndex::col(const double x) const {
+  double c = floor((x - this->min_x_) / this->cell_);
+  if (!(c > 0)) return 0;
+  return c < this->nx_ - 1 ? static_cast<size_t>(c) : this->nx_ - 1;
+}
+
+size_t TrackIndex::row(const double y) const {
+  double r = floor((y - this->min_y_) / this->cell_);
+  if (!(r > 0)) return 0;
+  return r < this->ny_ - 1 ? static_cast<size_t>(r) : this->ny_ - 1;
+}
+
+size_t TrackIndex::slab(const double t) const {
+  double s = floor((t - this->min_t_) / this->slab_);
+  if (!(s > 0)) return 0;
+  return s < this->nt_ - 1 ? static_cast<size_t>(s) : this->nt_ - 1;
+}
+
+bool TrackIndex::clip_time(const Entry &entry, const double min_t,
+                           const double max_t, double *x1, double *y1,
+                           double *x2, double *y2) const {
+  PathView track = this->tracks_[entry.track];
+  const Location &a = track[entry.segment];
+  const Location &b =
+    track[entry.segment + 1 < track.size() ? entry.segment + 1 : entry.segment];
+  if (b.t() < min_t || a.t() > max_t) return false;
+  double s0 = 0;
+  double s1 = 1;
+  double dt = b.t() - a.t();
+  if (dt > 0) {
+    if (min_t > a.t()) s0 = (min_t - a.t()) / dt;
+    if (max_t < b.t()) s1 = (max_t - a.t()) / dt;
+  }
+  *x1 = a.x() + s0 * (b.x() - a.x());
+  *y1 = a.y() + s0 * (b.y() - a.y());
+  *x2 = a.x() + s1 * (b.x() - a.x());
+  *y2 = a.y() + s1 * (b.y() - a.y());
+  return true;
+}
+
+void TrackIndex::range(const Region &region, std::vector<uint64_t> *ids) const {
+  ids->clear();
+  if (!this->segments_ || region.min_x > region.max_x ||
+      region.min_y > region.max_y || region.min_t > region.max_t) {
+    return;
+  }
+  size_t c1 = this->col(region.min_x);
+  size_t c2 = this->col(region.max_x);
+  size_t r1 = this->row(region.min_y);
+  size_t r2 = this->row(region.max_y);
+  size_t t1 = this->slab(region.min_t);
+  size_t t2 = this->slab(region.max_t);
+  std::vector<uint32_t> found;
+  for (size_t r = r1; r <= r2; ++r) {
+    for (size_t c = c1; c <= c2; ++c) {
+      size_t cell = r * this->nx_ + c;
+      for (size_t t = t1; t <= t2; ++t) {
+        size_t list = cell * this->nt_ + t;
+        uint32_t last = UINT32_MAX;  // Lists are in track order.
+        for (uint64_t e = this->list_start_[list];
+             e < this->list_start_[list + 1]; ++e) {
+          const Entry &entry = this->entries_[e];
+          if (entry.track == last) continue;
+          double x1, y1, x2, y2;
+          if (this->clip_time(entry, region.min_t, region.max_t,
+                              &x1, &y1, &x2, &y2) &&
+              crosses(x1, y1, x2, y2, region)) {
+            found.push_back(entry.track);
+            last = entry.track;
+          }
+        }
+      }
+    }
+  }
+  std::sort(found.begin(), found.end());
+  found.erase(std::unique(found.begin(), found.end()), found.end());
+  ids->reserve(found.size());
+  for (size_t i = 0; i < found.size(); ++i) {
+    ids->push_back(this->ids_[found[i]]);
+  }
+  std::sort(ids->begin(), ids->end());
+}
+
+void TrackIndex::nearest(const double x, const double y, const size_t k,
+                         std::vector<Neighbor> *result, const double min_t,
+                         const double max_t) const {
+  result->clear();
+  if (!k || !this->segments_ || min_t > max_t) return;
+  const size_t cx = this->col(x);
+  const size_t cy = this->row(y);
+  const size_t t1 = this->slab(min_t);
+  const size_t t2 = this->slab(max_t);
+  const size_t max_ring = std::max(std::max(cx, this->nx_ - 1 - cx),
+                                   std::max(cy, this->ny_ - 1 - cy));
+  // Distance of each segment found, by track position, kept nearest first
+  // per track after every ring.
+  std::vector<std::pair<uint32_t, double> > found;
+  double bound = HUGE_VAL;  // Distance of the kth nearest track so far.
+  std::vector<double> kth;
+  for (size_t ring = 0; ring <= max_ring; ++ring) {
+    // Visit the cells at a Chebyshev distance of ring from the center cell.
+    size_t r1 = cy >= ring ? cy - ring : 0;
+    size_t r2 = std::min(cy + ring, this->ny_ - 1);
+    for (size_t r = r1; r <= r2; ++r) {
+      bool edge_row = r + ring == cy || r == cy + ring;
+      size_t c1 = cx >= ring ? cx - ring : 0;
+      size_t c2 = std::min(cx + ring, this->nx_ - 1);
+      for (size_t c = c1; c <= c2; ++c) {
+        if (!edge_row && c + ring != cx && c != cx + ring) {
+          c = c2 == cx + ring ? c2 - 1 : c2;  // Skip to the right edge.
+          continue;
+        }
+        // A segment nearer than the bound has its nearest point in a cell
+        // nearer than the bound, and is listed there.
+        double left = this->min_x_ + c * this->cell_;
+        double bottom = this->min_y_ + r * this->cell_;
+        double dx = std::max(std::max(left - x, x - left - this->cell_), 0.0);
+        double dy =
+          std::max(std::max(bottom - y, y - bottom - this->cell_), 0.0);
+        if (hypot(dx, dy) > bound) continue;
+        size_t cell = r * this->nx_ + c;
+        for (uint64_t e = this->list_start_[cell * this->nt_ + t1];
+             e < this->list_start_[cell * this->nt_ + t2 + 1]; ++e) {
+          const Entry &entry = this->entries_[e];
+          double x1, y1, x2, y2;
+          if (!this->clip_time(entry, min_t, max_t, &x1, &y1, &x2, &y2)) {
+            continue;
+          }
+          found.push_back(
+              std::make_pair(entry.track, distance(x, y, x1, y1, x2, y2)));
+        }
+      }
+    }
+
+    // Keep the nearest segment of each track.
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end(), same_track),
+                found.end());
+
+    // Every cell of the next ring is at least ring cells away.
+    if (found.size() >= k) {
+      kth.resize(found.size());
+      for (size_t i = 0; i < found.size(); ++i) kth[i] = found[i].second;
+      std::nth_element(kth.begin(), kth.begin() + (k - 1), kth.end());
+      bound = kth[k - 1];
+      if (bound <= ring * this->cell_) break;
+    }
+  }
+
+  result->reserve(found.size());
+  for (size_t i = 0; i < found.size(); ++i) {
+    Neighbor neighbor = {this->ids_[found[i].first], found[i].second};
+    result->push_back(neighbor);
+  }
+  std::sort(result->begin(), result->end(), comp_neighbor);
+  if (result->size() > k) result->resize(k);
+}
+
+}  // namespace pathest
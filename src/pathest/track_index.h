@@ -0,0 +1,153 @@
+/// @file pathest/track_index.h
+/// @brief Class for finding tracks by region, time and distance.
+///
+/// The index covers the segments between consecutive locations of many
+/// tracks with a uniform grid. Each segment is listed in every cell that its
+/// bounding box overlaps, so a query only looks at the segments of the cells
+/// it touches instead of at every location of every track.
+///
+/// The grid also divides time into slabs. Each cell keeps one list per slab,
+/// and a segment is listed in every slab that its time span overlaps, so a
+/// query with a time window only looks at the lists of the slabs it overlaps.
+/// The grid is sized for a few segments per list, and the lists are stored
+/// contiguously, cell by cell and slab by slab within a cell.
+///
+/// Segments are tested exactly: a track matches a region when some segment,
+/// cut to the time window by linear interpolation, crosses the region, and the
+/// distance of a track is that of its nearest segment within the window. A
+/// track with a single location has one segment of zero length.
+///
+/// The index keeps views of the tracks rather than copies, such as the mapped
+/// tracks of an Archive, so the tracks must outlive it.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_TRACK_INDEX_H_
+#define PATHEST_TRACK_INDEX_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "pathest/path_view.h"
+#include "pathest/track_archive.h"
+
+namespace pathest {
+
+class TrackIndex {
+ public:
+  /// A region of space and time, with inclusive bounds.
+  struct Region {
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+    double min_t;
+    double max_t;
+  };
+
+  /// A track found by nearest().
+  struct Neighbor {
+    uint64_t id;  //< Track id.
+    double distance;  //< Distance to the nearest segment of the track.
+  };
+
+  TrackIndex();
+  ~TrackIndex() {}
+
+  TrackIndex(const TrackIndex &) = delete;
+  TrackIndex &operator=(const TrackIndex &) = delete;
+
+  static const size_t kSegmentsPerCell = 4;  //< Target grid occupancy.
+  static const size_t kMaxCells = 1 << 20;  //< Largest cells times slabs.
+  static const size_t kMaxCounts = 1 << 22;  //< Largest build scratch counts.
+
+  /// @brief Index tracks, replacing what was indexed before.
+  ///
+  /// The tracks are split into contiguous chunks, one per thread, and each
+  /// chunk counts and then places its segments in the grid in parallel. Each
+  /// chunk counts into its own copy of the grid, so segments are counted and
+  /// placed in no more chunks than kMaxCounts allows for the size of the grid.
+  /// The index is the same for any number of threads.
+  ///
+  /// Tracks and segments are numbered with 32 bits within the index, so there
+  /// can be no more than UINT32_MAX tracks of no more than UINT32_MAX
+  /// locations each, and no list of the grid can hold more segments.
+  ///
+  /// @param ids The track ids.
+  /// @param tracks The tracks, in time order, which must outlive the index.
+  /// @param threads The number of threads, or zero for the default.
+  /// @returns true if successful, false if there are not as many ids as
+  ///   tracks or the tracks are too many or too long. The index is then empty.
+  bool build(const std::vector<uint64_t> &ids,
+             const std::vector<PathView> &tracks, unsigned threads = 0);
+
+  /// @brief Index every track of an archive.
+  ///
+  /// @param archive The archive, which must stay open while the index is used.
+  /// @param threads The number of threads, or zero for the default.
+  /// @returns true if successful, false otherwise, as for the other build().
+  bool build(const Archive &archive, unsigned threads = 0);
+
+  bool empty() const;
+  size_t size() const;  //< Number of tracks.
+  size_t segments() const;  //< Number of segments.
+  size_t cells() const;  //< Number of grid cells.
+  size_t slabs() const;  //< Number of time slabs.
+
+  /// @brief Find the tracks that pass through a region.
+  ///
+  /// @param region The region.
+  /// @param ids The ids of the matching tracks, in increasing order.
+  void range(const Region &region, std::vector<uint64_t> *ids) const;
+
+  /// @brief Find the tracks nearest to a point.
+  ///
+  /// Searches rings of cells outwards from the point, and stops once no
+  /// unsearched cell can hold a nearer segment than the kth nearest track.
+  ///
+  /// @param x The x coordinate of the point.
+  /// @param y The y coordinate of the point.
+  /// @param k The largest number of tracks to find.
+  /// @param result The nearest tracks, nearest first, with ties by id.
+  /// @param min_t The start of the time window.
+  /// @param max_t The end of the time window.
+  void nearest(const double x, const double y, const size_t k,
+               std::vector<Neighbor> *result, const double min_t = -HUGE_VAL,
+               const double max_t = HUGE_VAL) const;
+
+ private:
+  // A segment from location i to i + 1 of a track.
+  struct Entry {
+    uint32_t track;  //< Position of the track in tracks_.
+    uint32_t segment;  //< Index of the first location of the segment.
+  };
+
+  std::vector<uint64_t> ids_;  //< Track ids.
+  std::vector<PathView> tracks_;  //< Indexed tracks.
+  size_t segments_;  //< Number of segments.
+  double min_x_;  //< Left edge of the grid.
+  double min_y_;  //< Bottom edge of the grid.
+  double cell_;  //< Width and height of a cell.
+  size_t nx_;  //< Number of columns.
+  size_t ny_;  //< Number of rows.
+  double min_t_;  //< Start of the first slab.
+  double slab_;  //< Duration of a slab.
+  size_t nt_;  //< Number of slabs.
+  std::vector<uint64_t> list_start_;  //< Start of each list, and end.
+  std::vector<Entry> entries_;  //< Lists of segments, one after another.
+
+  void clear();  //< Drop everything indexed, leaving an empty index.
+  size_t col(const double x) const;  //< Column of an x coordinate.
+  size_t row(const double y) const;  //< Row of a y coordinate.
+  size_t slab(const double t) const;  //< Slab of a timestamp.
+
+  /// Get the part of a segment within a time window, false if none.
+  bool clip_time(const Entry &entry, const double min_t, const double max_t,
+                 double *x1, double *y1, double *x2, double *y2) const;
+};
+
+}  // namespace pathest
+
+#endif  // PATHEST_TRACK_INDEX_H_
@@ -0,0 +1,118 @@
+/// @file pathest/track_io.cc
+/// @brief Functions for streaming path data to and from files.
+//===----------------------------------------------------------------------===//
+
+#include "pathest/track_io.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pathest/location.h"
+#include "pathest/path.h"
+
+namespace pathest {
+
+namespace {
+
+const char magic[4] = {'P', 'T', 'R', 'K'};
+const uint32_t version = 1;
+
+// Number of locations converted per read or write call.
+const size_t block_len = 1024;
+
+// Write a number the way JsonCpp does: 17 significant digits, with a decimal
+// point kept on integral values, and non-finite values spelled as it spells
+// them.
+void write_number(FILE *fp, const double value) {
+  if (isnan(value)) {
+    fputs("null", fp);
+  } else if (isinf(value)) {
+    fputs(value < 0 ? "-1e+9999" : "1e+9999", fp);
+  } else {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    fputs(buf, fp);
+    if (!strchr(buf, '.') && !strchr(buf, 'e')) fputs(".0", fp);
+  }
+}
+
+}  // namespace
+
+bool is_binary_track(const void *buf, const size_t len) {
+  return len >= sizeof(magic) && !memcmp(buf, magic, sizeof(magic));
+}
+
+bool write_json(FILE *fp, PathView path, const char *target) {
+  if (!fp || !target) return false;
+  fputs("{\n   \"reports\" : [", fp);
+  for (PathView::const_iterator it = path.begin(); it != path.end(); ++it) {
+    fputs(it == path.begin() ? "\n" : ",\n", fp);
+    fputs("      {\n         \"timestamp\" : ", fp);
+    write_number(fp, it->t());
+    fputs(",\n         \"x\" : ", fp);
+    write_number(fp, it->x());
+    fputs(",\n         \"y\" : ", fp);
+    write_number(fp, it->y());
+    fputs("\n      }", fp);
+  }
+  // An empty array stays on one line.
+  fprintf(fp, "%s],\n   \"target\" : \"%s\"\n}\n",
+          path.empty() ? "" : "\n   ", target);
+  return !ferror(fp);
+}
+
+bool write_binary(FILE *fp, PathView path) {
+  if (!fp) return false;
+  uint64_t count = path.size();
+  if (fwrite(magic, sizeof(magic), 1, fp) != 1 ||
+      fwrite(&version, sizeof(version), 1, fp) != 1 ||
+      fwrite(&count, sizeof(count), 1, fp) != 1) {
+    return false;
+  }
+  double buf[3 * block_len];
+  size_t len = 0;
+  for (PathView::const_iterator it = path.begin(); it != path.end(); ++it) {
+    buf[3 * len] = it->x();
+    buf[3 * len + 1] = it->y();
+    buf[3 * len + 2] = it->t();
+    if (++len == block_len) {
+      if (fwrite(buf, sizeof(double), 3 * len, fp) != 3 * len) return false;
+      len = 0;
+    }
+  }
+  if (len && fwrite(buf, sizeof(double), 3 * len, fp) != 3 * len) {
+    return false;
+  }
+  return true;
+}
+
+bool read_binary(FILE *fp, Path *path) {
+  if (!fp || !path) return false;
+  char header_magic[sizeof(magic)];
+  uint32_t header_version;
+  uint64_t count;
+  if (fread(header_magic, sizeof(header_magic), 1, fp) != 1 ||
+      fread(&header_version, sizeof(header_version), 1, fp) != 1 ||
+      fread(&count, sizeof(count), 1, fp) != 1) {
+    return false;
+  }
+  if (!is_binary_track(header_magic, sizeof(header_magic)) ||
+      header_version != version) {
+    return false;
+  }
+  double buf[3 * block_len];
+  while (count) {
+    size_t len = count < block_len ? count : block_len;
+    if (fread(buf, sizeof(double), 3 * len, fp) != 3 * len) return false;
+    for (size_t i = 0; i < len; ++i) {
+      path->insert(buf[3 * i], buf[3 * i + 1], buf[3 * i + 2]);
+    }
+    count -= len;
+  }
+  return true;
+}
+
+}  // namespace pathest
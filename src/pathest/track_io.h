@@ -0,0 +1,67 @@
+/// @file pathest/track_io.h
+/// @brief Functions for streaming path data to and from files.
+///
+/// Two formats are supported. The JSON format is the same one read by the
+/// estimate program, and is written directly without building a document in
+/// memory. The binary format is a small header followed by the raw locations:
+///
+///   char     magic[4]   "PTRK"
+///   uint32_t version    1
+///   uint64_t count      Number of locations.
+///   double   data[3n]   x, y and timestamp of each location, in time order.
+///
+/// All fields use the byte order of the host that wrote the file.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PATHEST_TRACK_IO_H_
+#define PATHEST_TRACK_IO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+
+namespace pathest {
+
+/// Size in bytes of the binary header.
+const size_t kTrackHeaderSize = 16;
+
+/// @brief Check whether a buffer starts with a binary track header.
+///
+/// @param buf The buffer.
+/// @param len The number of bytes in the buffer.
+bool is_binary_track(const void *buf, const size_t len);
+
+/// @brief Write a path in the JSON report format.
+///
+/// The layout and number formatting are those of JsonCpp's StyledWriter, so
+/// files match ones written by building a Json::Value document.
+///
+/// @param fp The file to write to.
+/// @param path The path to write.
+/// @param target The value of the "target" field.
+/// @returns true if successful, false otherwise.
+bool write_json(FILE *fp, PathView path, const char *target = "train");
+
+/// @brief Write a path in the binary format.
+///
+/// @param fp The file to write to.
+/// @param path The path to write.
+/// @returns true if successful, false otherwise.
+bool write_binary(FILE *fp, PathView path);
+
+/// @brief Read a path in the binary format.
+///
+/// Locations are appended to the given path.
+///
+/// @param fp The file to read from.
+/// @param path The path to append to.
+/// @returns true if successful, false otherwise.
+bool read_binary(FILE *fp, Path *path);
+
+}  // namespace pathest
+
+#endif  // PATHEST_TRACK_IO_H_
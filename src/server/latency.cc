@@ -0,0 +1,75 @@
+/// @file server/latency.cc
+/// @brief Histogram of request latencies.
+//===----------------------------------------------------------------------===//
+
+#include "server/latency.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+LatencyHistogram::LatencyHistogram() : buckets_(), count_(0), max_(0) {}
+
+size_t LatencyHistogram::bucket(const uint64_t ns) {
+  if (ns < kSubBuckets) return ns;
+  int exp = 63 - __builtin_clzll(ns);
+  size_t sub = (ns >> (exp - 4)) & (kSubBuckets - 1);
+  return (exp - 3) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::upper_bound(const size_t bucket) {
+  if (bucket < kSubBuckets) return bucket;
+  int exp = bucket / kSubBuckets + 3;
+  uint64_t sub = bucket % kSubBuckets;
+  uint64_t width = static_cast<uint64_t>(1) << (exp - 4);
+  return ((kSubBuckets + sub) << (exp - 4)) + (width - 1);
+}
+
+void LatencyHistogram::record(const uint64_t ns) {
+  this->buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  this->count_.fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = this->max_.load(std::memory_order_relaxed);
+  while (ns > max && !this->max_.compare_exchange_weak(
+      max, ns, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+  for (size_t i = 0; i < kBuckets; ++i) {
+    uint64_t n = other.buckets_[i].load(std::memory_order_relaxed);
+    if (n) this->buckets_[i].fetch_add(n, std::memory_order_relaxed);
+  }
+  this->count_.fetch_add(other.count(), std::memory_order_relaxed);
+  uint64_t ns = other.max();
+  uint64_t max = this->max_.load(std::memory_order_relaxed);
+  while (ns > max && !this->max_.compare_exchange_weak(
+      max, ns, std::memory_order_relaxed)) {}
+}
+
+uint64_t LatencyHistogram::count() const {
+  return this->count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+  return this->max_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(const double fraction) const {
+  // Sum the buckets rather than trust count_, which may be updated apart from
+  // them by a concurrent record().
+  uint64_t total = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    total += this->buckets_[i].load(std::memory_order_relaxed);
+  }
+  if (!total) return 0;
+  double rank = fraction * total;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    seen += this->buckets_[i].load(std::memory_order_relaxed);
+    if (seen && seen >= rank) {
+      uint64_t bound = upper_bound(i);
+      uint64_t max = this->max();
+      return bound < max || !max ? bound : max;
+    }
+  }
+  return this->max();
+}
@@ -0,0 +1,57 @@
+/// @file server/latency.h
+/// @brief Histogram of request latencies.
+///
+/// Latencies are counted in log-linear buckets of nanoseconds: exact below
+/// 16 ns, then 16 buckets per power of two, so percentiles are accurate to
+/// about 6% from nanoseconds to minutes with a fixed 8 KB of counters. Any
+/// number of threads may record into one histogram at once.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SERVER_LATENCY_H_
+#define SERVER_LATENCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+  ~LatencyHistogram() {}
+
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+  /// @brief Count one latency.
+  ///
+  /// @param ns The latency in nanoseconds.
+  void record(const uint64_t ns);
+
+  /// Add the counts of another histogram.
+  void merge(const LatencyHistogram &other);
+
+  uint64_t count() const;  //< Number of latencies counted.
+  uint64_t max() const;  //< Largest latency counted, in nanoseconds.
+
+  /// @brief Get a percentile.
+  ///
+  /// @param fraction The fraction of latencies at or below the result, e.g.
+  ///   0.99 for the 99th percentile.
+  /// @returns the upper bound of the bucket holding the percentile, in
+  ///   nanoseconds, or zero if nothing was counted.
+  uint64_t percentile(const double fraction) const;
+
+ private:
+  static const size_t kSubBuckets = 16;  //< Buckets per power of two.
+  static const size_t kBuckets = 64 * kSubBuckets;  //< Total buckets.
+
+  std::atomic<uint64_t> buckets_[kBuckets];  //< Counts by bucket.
+  std::atomic<uint64_t> count_;  //< Number of latencies counted.
+  std::atomic<uint64_t> max_;  //< Largest latency counted.
+
+  static size_t bucket(const uint64_t ns);  //< Bucket of a latency.
+  static uint64_t upper_bound(const size_t bucket);  //< Largest in a bucket.
+};
+
+#endif  // SERVER_LATENCY_H_
@@ -0,0 +1,284 @@
+/// @file server/loadgen.cc
+/// @brief Main program for generating load on the estimation server.
+///
+/// Generates synthetic tracks with the same model as the generate program, then
+/// replays them to a running server over several connections, each owning
+/// its own tracks so that their reports stay in time order. Every append of
+/// a batch of reports is followed by queries of the tracks it updated. The
+/// round trip of every request is timed, and the latency percentiles are
+/// printed per request type, along with the server's own statistics.
+///
+/// Example usage:
+///   ./serve /tmp/pathest.sock &
+///   ./loadgen -c 8 -k 10000 -n 100 -b 256 -x /tmp/pathest.sock
+///
+//===----------------------------------------------------------------------===//
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "pathest/expression.h"
+#include "pathest/generator.h"
+#include "pathest/location.h"
+#include "pathest/parallel.h"
+#include "pathest/path.h"
+#include "server/latency.h"
+#include "server/protocol.h"
+
+// Default load parameters.
+const unsigned default_connections = 4;
+const size_t default_tracks = 1000;
+const size_t default_points = 100;
+const size_t default_batch = 64;
+const size_t default_queries = 1;
+
+// Function of x followed by generated tracks.
+const char *load_curve = "50 * math.sin(x / 20)";
+
+// Totals over all connections.
+struct LoadStats {
+  LoadStats() :
+    append_latency(), query_latency(), requests(0), reports(0), kept(0),
+    queries(0), errors(0) {}
+
+  LatencyHistogram append_latency;  // Round trips of appends.
+  LatencyHistogram query_latency;  // Round trips of queries.
+  std::atomic<uint64_t> requests;  // Number of requests sent.
+  std::atomic<uint64_t> reports;  // Number of reports sent.
+  std::atomic<uint64_t> kept;  // Number of reports the server kept.
+  std::atomic<uint64_t> queries;  // Number of tracks queried.
+  std::atomic<uint64_t> errors;  // Failed requests and unexpected results.
+};
+
+// Replay the tracks owned by one connection.
+void run_connection(const char *path,
+                    const std::vector<pathest::Path> &inputs,
+                    const unsigned connection, const unsigned connections,
+                    const size_t batch, const size_t queries,
+                    LoadStats *stats);
+
+// Send one request and read its response header, timing the round trip.
+bool round_trip(const int fd, const MessageType type, const void *records,
+                const size_t len, const uint32_t count, MessageHeader *response,
+                void *results, const size_t results_len,
+                LatencyHistogram *latency);
+
+// Print the percentiles of a histogram, in microseconds.
+void print_latency(const char *name, const LatencyHistogram &latency);
+
+void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-c connections] [-k tracks] [-n points per track]"
+          " [-b batch size] [-q queries per append] [-s seed] [-x]"
+          " <socket path>\n", name);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned connections = default_connections;
+  size_t tracks = default_tracks;
+  size_t points = default_points;
+  size_t batch = default_batch;
+  size_t queries = default_queries;
+  uint64_t seed = 0;
+  bool shutdown = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:k:n:b:q:s:x")) != -1) {
+    switch (opt) {
+      case 'c': connections = strtoul(optarg, NULL, 10); break;
+      case 'k': tracks = strtoull(optarg, NULL, 10); break;
+      case 'n': points = strtoull(optarg, NULL, 10); break;
+      case 'b': batch = strtoull(optarg, NULL, 10); break;
+      case 'q': queries = strtoull(optarg, NULL, 10); break;
+      case 's': seed = strtoull(optarg, NULL, 10); break;
+      case 'x': shutdown = true; break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (argc - optind != 1 || !connections || !batch || batch > kMaxRecords) {
+    usage(argv[0]);
+    return -1;
+  }
+  const char *path = argv[optind];
+
+  pathest::Expression curve;
+  if (!curve.parse(load_curve)) return -1;
+  pathest::Generator gen(curve, 0, points, seed);
+  std::vector<pathest::Path> inputs(tracks);
+  pathest::parallel_for(tracks, 0, [&](size_t, size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) gen.generate(i, NULL, &inputs[i]);
+  });
+
+  LoadStats stats;
+  std::chrono::steady_clock::time_point begin =
+    std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned c = 0; c < connections; ++c) {
+    threads.emplace_back(run_connection, path, std::cref(inputs), c,
+                         connections, batch, queries, &stats);
+  }
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - begin;
+
+  double seconds = elapsed.count();
+  fprintf(stdout, "Sent %llu report(s), %llu kept, and %llu query(s) in %llu"
+          " request(s) over %u connection(s) in %.3f s (%.0f reports/s)\n",
+          static_cast<unsigned long long>(stats.reports.load()),
+          static_cast<unsigned long long>(stats.kept.load()),
+          static_cast<unsigned long long>(stats.queries.load()),
+          static_cast<unsigned long long>(stats.requests.load()),
+          connections, seconds, seconds > 0 ? stats.reports / seconds : 0);
+  print_latency("Append", stats.append_latency);
+  print_latency("Query", stats.query_latency);
+
+  // Ask for the server's own view, then stop it if asked to.
+  int fd = connect_server(path);
+  MessageHeader response;
+  ServerStats server;
+  if (fd < 0 || !round_trip(fd, kStats, NULL, 0, 0, &response, &server,
+                            sizeof(server), NULL) ||
+      response.type != kStats || response.count != 1) {
+    fprintf(stderr, "Unable to get server statistics from %s\n", path);
+    ++stats.errors;
+  } else {
+    fprintf(stdout, "Server: %llu track(s), %llu request(s), latency p50 %.1f"
+            " us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+            static_cast<unsigned long long>(server.tracks),
+            static_cast<unsigned long long>(server.requests), server.p50_us,
+            server.p90_us, server.p99_us, server.p999_us, server.max_us);
+  }
+  if (fd >= 0 && shutdown &&
+      !round_trip(fd, kShutdown, NULL, 0, 0, &response, NULL, 0, NULL)) {
+    fprintf(stderr, "Unable to shut down the server\n");
+    ++stats.errors;
+  }
+  if (fd >= 0) close(fd);
+
+  if (stats.errors) {
+    fprintf(stderr, "%llu error(s)\n",
+            static_cast<unsigned long long>(stats.errors.load()));
+    return -1;
+  }
+  return 0;
+}
+
+void run_connection(const char *path,
+                    const std::vector<pathest::Path> &inputs,
+                    const unsigned connection, const unsigned connections,
+                    const size_t batch, const size_t queries,
+                    LoadStats *stats) {
+  int fd = connect_server(path);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to connect to %s\n", path);
+    ++stats->errors;
+    return;
+  }
+
+  // This connection owns every track whose number is its own modulo the
+  // number of connections.
+  std::vector<uint64_t> ids;
+  for (uint64_t id = connection; id < inputs.size(); id += connections) {
+    ids.push_back(id);
+  }
+
+  LatencyHistogram append_latency;
+  LatencyHistogram query_latency;
+  std::vector<AppendRecord> reports;
+  std::vector<QueryRecord> targets;
+  std::vector<QueryResult> results(batch);
+  reports.reserve(batch);
+  targets.reserve(batch);
+  uint64_t requests = 0;
+  uint64_t sent = 0;
+  uint64_t kept = 0;
+  uint64_t queried = 0;
+  uint64_t errors = 0;
+  size_t points = ids.empty() ? 0 : inputs[ids[0]].size();
+
+  // Send the reports point by point across the owned tracks, one batch at a
+  // time, querying the tracks of each batch after appending it.
+  for (size_t i = 0; i < points * ids.size() && !errors; ++i) {
+    uint64_t id = ids[i % ids.size()];
+    const pathest::Location &loc = inputs[id].data()[i / ids.size()];
+    AppendRecord report = {id, loc.x(), loc.y(), loc.t()};
+    reports.push_back(report);
+    QueryRecord target = {id};
+    targets.push_back(target);
+    if (reports.size() < batch && i + 1 < points * ids.size()) continue;
+
+    MessageHeader response;
+    if (!round_trip(fd, kAppend, reports.data(),
+                    reports.size() * sizeof(AppendRecord), reports.size(),
+                    &response, NULL, 0, &append_latency) ||
+        response.type != kAppend) {
+      ++errors;
+      break;
+    }
+    ++requests;
+    sent += reports.size();
+    kept += response.count;
+    for (size_t q = 0; q < queries && !errors; ++q) {
+      if (!round_trip(fd, kQuery, targets.data(),
+                      targets.size() * sizeof(QueryRecord), targets.size(),
+                      &response, results.data(),
+                      targets.size() * sizeof(QueryResult), &query_latency) ||
+          response.type != kQuery || response.count != targets.size()) {
+        ++errors;
+        break;
+      }
+      ++requests;
+      queried += targets.size();
+      for (size_t k = 0; k < targets.size(); ++k) {
+        if (results[k].id != targets[k].id || !results[k].count) ++errors;
+      }
+    }
+    reports.clear();
+    targets.clear();
+  }
+  close(fd);
+  if (errors) fprintf(stderr, "Connection %u failed\n", connection);
+
+  stats->append_latency.merge(append_latency);
+  stats->query_latency.merge(query_latency);
+  stats->requests += requests;
+  stats->reports += sent;
+  stats->kept += kept;
+  stats->queries += queried;
+  stats->errors += errors;
+}
+
+bool round_trip(const int fd, const MessageType type, const void *records,
+                const size_t len, const uint32_t count, MessageHeader *response,
+                void *results, const size_t results_len,
+                LatencyHistogram *latency) {
+  std::chrono::steady_clock::time_point begin =
+    std::chrono::steady_clock::now();
+  MessageHeader header = {static_cast<uint32_t>(type), count};
+  if (!write_full(fd, &header, sizeof(header)) ||
+      (len && !write_full(fd, records, len)) ||
+      !read_full(fd, response, sizeof(*response))) {
+    return false;
+  }
+  if (response->type == kError) return false;
+  if (results_len && !read_full(fd, results, results_len)) return false;
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - begin;
+  if (latency) latency->record(elapsed.count());
+  return true;
+}
+
+void print_latency(const char *name, const LatencyHistogram &latency) {
+  fprintf(stdout, "%s latency: p50 %.1f us, p90 %.1f us, p99 %.1f us,"
+          " p99.9 %.1f us, max %.1f us\n", name,
+          1e-3 * latency.percentile(0.5), 1e-3 * latency.percentile(0.9),
+          1e-3 * latency.percentile(0.99), 1e-3 * latency.percentile(0.999),
+          1e-3 * latency.max());
+}
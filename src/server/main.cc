@@ -0,0 +1,315 @@
+/// @file server/main.cc
+/// @brief Main program for the estimation server.
+///
+/// Listens on a Unix domain socket and keeps an online estimator for every
+/// track it is sent reports of, so that position and speed queries are
+/// answered from warm state instead of by running the estimate program over
+/// the whole history (see server/protocol.h for the messages). Each connection
+/// is served by its own thread, joined as soon as the connection closes, and
+/// every request is timed from its header to its response. At most -c
+/// connections are served at once; further clients wait in the listen backlog
+/// until one closes. With -m, tracks are restored from a state map at startup
+/// and saved back to it on shutdown, so a restart keeps the warm state.
+///
+/// The server runs until it receives SIGINT, SIGTERM or a kShutdown request.
+///
+/// Example usage:
+///   ./serve -e sma:5 -c 16 -m /tmp/tracks.map /tmp/pathest.sock
+///
+//===----------------------------------------------------------------------===//
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "server/latency.h"
+#include "server/protocol.h"
+#include "server/track_table.h"
+
+// How often the accept loop checks whether to stop, in milliseconds.
+const int stop_poll_ms = 100;
+
+// Default number of connections served at once.
+const size_t default_max_connections = 256;
+
+// Set by signals and kShutdown requests. Lock-free, so signal handlers may set
+// it as well as connection threads.
+std::atomic<bool> stop_requested(false);
+static_assert(std::atomic<bool>::is_always_lock_free,
+              "signal handlers may only set lock-free atomics");
+
+// State shared by all connections.
+struct Server {
+  Server(const EstimatorConfig &config, const size_t shards) :
+    table(config, shards), latency(), requests(0), reports(0), queries(0),
+    lock(), connections(), finished() {}
+
+  TrackTable table;
+  LatencyHistogram latency;  // Latency of every request.
+  std::atomic<uint64_t> requests;  // Number of requests answered.
+  std::atomic<uint64_t> reports;  // Number of reports kept.
+  std::atomic<uint64_t> queries;  // Number of tracks queried.
+
+  std::mutex lock;  // Guards connections and finished.
+  std::map<int, std::thread> connections;  // Threads by connection socket.
+  std::vector<int> finished;  // Sockets of connections whose threads ended.
+};
+
+// Answer requests on one connection until it closes.
+void serve_connection(Server *server, const int fd);
+
+// Move the threads of finished connections out of the server, so that they
+// can be joined without holding the lock. Call with server->lock held.
+void reap_connections(Server *server, std::vector<std::thread> *threads);
+
+// Join threads, and clear them.
+void join_threads(std::vector<std::thread> *threads);
+
+// Create a listening socket at a path, replacing a stale socket there.
+int listen_socket(const char *path);
+
+void handle_signal(int) { stop_requested = true; }
+
+void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-e estimator] [-n shards] [-c max connections]"
+          " [-m state map] <socket path>\n"
+          "Estimators: kf (default), sma:<samples, at most %zu>,"
+          " es:<smoothing factor>\n", name, EstimatorConfig::kMaxSamples);
+}
+
+int main(int argc, char *argv[]) {
+  EstimatorConfig config;
+  size_t shards = TrackTable::kDefaultShards;
+  size_t max_connections = default_max_connections;
+  const char *state_map = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "e:n:c:m:")) != -1) {
+    switch (opt) {
+      case 'e':
+        if (!config.parse(optarg)) {
+          fprintf(stderr, "Invalid estimator: %s\n", optarg);
+          return -1;
+        }
+        break;
+      case 'n': shards = strtoull(optarg, NULL, 10); break;
+      case 'c': max_connections = strtoull(optarg, NULL, 10); break;
+      case 'm': state_map = optarg; break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (argc - optind != 1 || !max_connections) {
+    usage(argv[0]);
+    return -1;
+  }
+  const char *path = argv[optind];
+
+  Server server(config, shards);
+  struct stat st;
+  if (state_map && stat(state_map, &st) == 0) {
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+    long restored = server.table.load(state_map);
+    if (restored < 0) {
+      fprintf(stderr, "Unable to restore tracks from %s\n", state_map);
+      return -1;
+    }
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+    fprintf(stdout, "Restored %ld track(s) from %s in %.3f ms\n", restored,
+            state_map, 1e3 * elapsed.count());
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  int listen_fd = listen_socket(path);
+  if (listen_fd < 0) return -1;
+  fprintf(stdout, "Listening on %s\n", path);
+  fflush(stdout);
+
+  std::vector<std::thread> finished;
+  bool full = false;
+  while (!stop_requested) {
+    // At the limit, new clients wait in the listen backlog, and poll only
+    // times out so that finished connections are reaped.
+    struct pollfd pfd = {full ? -1 : listen_fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, stop_poll_ms);
+    int fd = ready > 0 ? accept(listen_fd, NULL, NULL) : -1;
+    {
+      // Reap before adding, since a new socket may reuse the number of one
+      // that closed.
+      std::lock_guard<std::mutex> guard(server.lock);
+      reap_connections(&server, &finished);
+      if (fd >= 0) {
+        server.connections.emplace(
+          fd, std::thread(serve_connection, &server, fd));
+      }
+      full = server.connections.size() >= max_connections;
+    }
+    join_threads(&finished);
+  }
+  close(listen_fd);
+  unlink(path);
+
+  // Wake the connection threads from their reads, and wait for them. No more
+  // are added, so the remaining threads can be joined without the lock.
+  {
+    std::lock_guard<std::mutex> guard(server.lock);
+    reap_connections(&server, &finished);
+    for (std::map<int, std::thread>::const_iterator it =
+           server.connections.begin();
+         it != server.connections.end(); ++it) {
+      shutdown(it->first, SHUT_RDWR);
+    }
+  }
+  join_threads(&finished);
+  for (std::map<int, std::thread>::iterator it = server.connections.begin();
+       it != server.connections.end(); ++it) {
+    it->second.join();
+  }
+
+  int status = 0;
+  if (state_map) {
+    if (server.table.save(state_map)) {
+      fprintf(stdout, "Saved %zu track(s) to %s\n", server.table.size(),
+              state_map);
+    } else {
+      fprintf(stderr, "Unable to save tracks to %s\n", state_map);
+      status = -1;
+    }
+  }
+  fprintf(stdout, "Answered %llu request(s); latency p50 %.1f us,"
+          " p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+          static_cast<unsigned long long>(server.requests.load()),
+          1e-3 * server.latency.percentile(0.5),
+          1e-3 * server.latency.percentile(0.99),
+          1e-3 * server.latency.percentile(0.999),
+          1e-3 * server.latency.max());
+  return status;
+}
+
+void serve_connection(Server *server, const int fd) {
+  std::vector<AppendRecord> reports;
+  std::vector<QueryRecord> queries;
+  std::vector<QueryResult> results;
+  std::vector<uint64_t> order;
+  MessageHeader header;
+  while (read_full(fd, &header, sizeof(header))) {
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+    MessageHeader response = {header.type, 0};
+    bool ok = header.count <= kMaxRecords;
+    if (ok && header.type == kAppend) {
+      reports.resize(header.count);
+      ok = read_full(fd, reports.data(), header.count * sizeof(AppendRecord));
+      if (!ok) break;
+      response.count =
+        server->table.append(reports.data(), header.count, &order);
+      server->reports += response.count;
+      ok = write_full(fd, &response, sizeof(response));
+    } else if (ok && header.type == kQuery) {
+      queries.resize(header.count);
+      results.resize(header.count);
+      ok = read_full(fd, queries.data(), header.count * sizeof(QueryRecord));
+      if (!ok) break;
+      server->table.query(queries.data(), header.count, results.data(),
+                          &order);
+      server->queries += header.count;
+      response.count = header.count;
+      ok = write_full(fd, &response, sizeof(response)) &&
+        write_full(fd, results.data(), header.count * sizeof(QueryResult));
+    } else if (ok && header.type == kStats && !header.count) {
+      ServerStats stats;
+      stats.tracks = server->table.size();
+      stats.requests = server->requests;
+      stats.reports = server->reports;
+      stats.queries = server->queries;
+      stats.p50_us = 1e-3 * server->latency.percentile(0.5);
+      stats.p90_us = 1e-3 * server->latency.percentile(0.9);
+      stats.p99_us = 1e-3 * server->latency.percentile(0.99);
+      stats.p999_us = 1e-3 * server->latency.percentile(0.999);
+      stats.max_us = 1e-3 * server->latency.max();
+      response.count = 1;
+      ok = write_full(fd, &response, sizeof(response)) &&
+        write_full(fd, &stats, sizeof(stats));
+    } else if (ok && header.type == kShutdown && !header.count) {
+      stop_requested = true;
+      ok = write_full(fd, &response, sizeof(response));
+    } else {
+      response.type = kError;
+      write_full(fd, &response, sizeof(response));
+      ok = false;
+    }
+    if (!ok) break;
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - begin;
+    server->latency.record(elapsed.count());
+    ++server->requests;
+  }
+
+  std::lock_guard<std::mutex> guard(server->lock);
+  close(fd);
+  server->finished.push_back(fd);
+}
+
+void reap_connections(Server *server, std::vector<std::thread> *threads) {
+  for (size_t i = 0; i < server->finished.size(); ++i) {
+    std::map<int, std::thread>::iterator it =
+      server->connections.find(server->finished[i]);
+    threads->push_back(std::move(it->second));
+    server->connections.erase(it);
+  }
+  server->finished.clear();
+}
+
+void join_threads(std::vector<std::thread> *threads) {
+  for (size_t i = 0; i < threads->size(); ++i) (*threads)[i].join();
+  threads->clear();
+}
+
+int listen_socket(const char *path) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  // Only replace a stale socket, never another kind of file.
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    fprintf(stderr, "Unable to listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
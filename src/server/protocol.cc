@@ -0,0 +1,59 @@
+/// @file server/protocol.cc
+/// @brief Messages between the estimation server and its clients.
+//===----------------------------------------------------------------------===//
+
+#include "server/protocol.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static_assert(sizeof(MessageHeader) == 8, "headers must be packed");
+static_assert(sizeof(AppendRecord) == 32, "append records must be packed");
+static_assert(sizeof(QueryResult) == 48, "query results must be packed");
+
+bool read_full(const int fd, void *buf, const size_t len) {
+  unsigned char *pos = static_cast<unsigned char *>(buf);
+  size_t left = len;
+  while (left) {
+    ssize_t n = read(fd, pos, left);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    pos += n;
+    left -= n;
+  }
+  return true;
+}
+
+bool write_full(const int fd, const void *buf, const size_t len) {
+  const unsigned char *pos = static_cast<const unsigned char *>(buf);
+  size_t left = len;
+  while (left) {
+    ssize_t n = send(fd, pos, left, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    pos += n;
+    left -= n;
+  }
+  return true;
+}
+
+int connect_server(const char *path) {
+  struct sockaddr_un addr;
+  if (!path || strlen(path) >= sizeof(addr.sun_path)) return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+              sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
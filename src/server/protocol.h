@@ -0,0 +1,104 @@
+/// @file server/protocol.h
+/// @brief Messages between the estimation server and its clients.
+///
+/// Clients connect to the server's Unix domain socket and send requests, each
+/// answered by one response, in order. Every message is a MessageHeader
+/// followed by a number of fixed-size records:
+///
+///   Request                       Response
+///   kAppend   AppendRecord[n]     kAppend   no records, count = reports kept
+///   kQuery    QueryRecord[n]      kQuery    QueryResult[n]
+///   kStats    no records          kStats    one ServerStats
+///   kShutdown no records          kShutdown no records
+///
+/// A request with an unknown type or more than kMaxRecords records is answered
+/// with kError, and the server closes the connection. All fields use the byte
+/// order of the host, since both ends run on it.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SERVER_PROTOCOL_H_
+#define SERVER_PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Types of message.
+enum MessageType {
+  kError = 0,  //< The request was malformed.
+  kAppend = 1,  //< Add reports to tracks.
+  kQuery = 2,  //< Get the latest estimates of tracks.
+  kStats = 3,  //< Get server statistics.
+  kShutdown = 4  //< Stop the server.
+};
+
+/// Largest number of records in one message.
+const uint32_t kMaxRecords = 1 << 16;
+
+/// Header of every message.
+struct MessageHeader {
+  uint32_t type;  //< MessageType.
+  uint32_t count;  //< Number of records that follow.
+};
+
+/// One report of a track. Reports of a track must arrive in time order; the
+/// server drops those older than the latest report of their track.
+struct AppendRecord {
+  uint64_t id;  //< Track id.
+  double x;  //< The x coordinate.
+  double y;  //< The y coordinate.
+  double t;  //< Timestamp.
+};
+
+/// A track to query.
+struct QueryRecord {
+  uint64_t id;  //< Track id.
+};
+
+/// Latest estimates of a track.
+struct QueryResult {
+  uint64_t id;  //< Track id.
+  uint64_t count;  //< Number of reports kept, or zero for an unknown track.
+  double x;  //< Estimated x coordinate at the latest report.
+  double y;  //< Estimated y coordinate at the latest report.
+  double t;  //< Timestamp of the latest report.
+  double speed;  //< Speed between the latest two estimates, or zero.
+};
+
+/// Server statistics. Latencies are from reading a request header to writing
+/// the response, over every request since the server started.
+struct ServerStats {
+  uint64_t tracks;  //< Number of tracks.
+  uint64_t requests;  //< Number of requests answered.
+  uint64_t reports;  //< Number of reports kept.
+  uint64_t queries;  //< Number of tracks queried.
+  double p50_us;  //< Median latency, in microseconds.
+  double p90_us;  //< 90th percentile latency, in microseconds.
+  double p99_us;  //< 99th percentile latency, in microseconds.
+  double p999_us;  //< 99.9th percentile latency, in microseconds.
+  double max_us;  //< Largest latency, in microseconds.
+};
+
+/// @brief Read exactly a number of bytes from a socket.
+///
+/// @param fd The socket.
+/// @param buf The buffer to fill.
+/// @param len The number of bytes.
+/// @returns true if successful, false on an error or end of file.
+bool read_full(const int fd, void *buf, const size_t len);
+
+/// @brief Write exactly a number of bytes to a socket.
+///
+/// @param fd The socket.
+/// @param buf The bytes.
+/// @param len The number of bytes.
+/// @returns true if successful, false otherwise.
+bool write_full(const int fd, const void *buf, const size_t len);
+
+/// @brief Connect to the server.
+///
+/// @param path The path of the server socket.
+/// @returns the connected socket, or -1 on failure.
+int connect_server(const char *path);
+
+#endif  // SERVER_PROTOCOL_H_
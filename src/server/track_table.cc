@@ -0,0 +1,261 @@
+/// @file server/track_table.cc
+/// @brief Sharded table of online estimator state by track id.
+//===----------------------------------------------------------------------===//
+
+#include "server/track_table.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "pathest/estimator_state.h"
+#include "pathest/exponential_smoothing.h"
+#include "pathest/kalman_filter.h"
+#include "pathest/location.h"
+#include "pathest/simple_moving_average.h"
+#include "server/protocol.h"
+
+namespace {
+
+// Layout of the saved state of a track, which is followed by the state of its
+// estimator.
+struct SavedTrack {
+  uint64_t count;
+  double last[3];  // x, y and t of the latest estimate.
+  double prev[3];  // x, y and t of the estimate before.
+};
+
+}  // namespace
+
+bool EstimatorConfig::parse(const char *spec) {
+  if (!spec) return false;
+  char *end;
+  if (!strcmp(spec, "kf")) {
+    this->kind = kKalmanFilter;
+    return true;
+  } else if (!strncmp(spec, "sma:", 4)) {
+    unsigned long long samples = strtoull(spec + 4, &end, 10);
+    if (end == spec + 4 || *end || !samples || samples > kMaxSamples) {
+      return false;
+    }
+    this->kind = kSimpleMovingAverage;
+    this->samples = samples;
+    return true;
+  } else if (!strncmp(spec, "es:", 3)) {
+    double smoothing = strtod(spec + 3, &end);
+    if (end == spec + 3 || *end || !(smoothing > 0 && smoothing < 1)) {
+      return false;
+    }
+    this->kind = kExponentialSmoothing;
+    this->smoothing = smoothing;
+    return true;
+  }
+  return false;
+}
+
+TrackState::TrackState(const EstimatorConfig &config) :
+  estimator_(),
+  count_(0),
+  last_(0, 0, 0),
+  prev_(0, 0, 0) {
+  switch (config.kind) {
+    case EstimatorConfig::kKalmanFilter:
+      this->estimator_.emplace<pathest::KalmanFilter>(
+          pathest::KalmanFilter::kSteadyState);
+      break;
+    case EstimatorConfig::kSimpleMovingAverage:
+      this->estimator_.emplace<pathest::SimpleMovingAverage>(config.samples);
+      break;
+    case EstimatorConfig::kExponentialSmoothing:
+      this->estimator_.emplace<pathest::ExponentialSmoothing>(
+          config.smoothing);
+      break;
+  }
+}
+
+bool TrackState::append(const pathest::Location &loc) {
+  if (this->count_ && loc.t() < this->last_.t()) return false;
+  pathest::Location est = std::visit([&loc](auto &estimator) {
+    return estimator.predict(loc);
+  }, this->estimator_);
+  this->prev_ = this->last_;
+  this->last_ = est;
+  ++this->count_;
+  return true;
+}
+
+uint64_t TrackState::count() const { return this->count_; }
+
+const pathest::Location &TrackState::position() const { return this->last_; }
+
+double TrackState::speed() const {
+  double dt = this->last_.t() - this->prev_.t();
+  if (this->count_ < 2 || dt <= 0) return 0;
+  double dx = this->last_.x() - this->prev_.x();
+  double dy = this->last_.y() - this->prev_.y();
+  return sqrt(dx * dx + dy * dy) / dt;
+}
+
+size_t TrackState::state_size() const {
+  return sizeof(SavedTrack) + std::visit([](const auto &estimator) {
+    return estimator.state_size();
+  }, this->estimator_);
+}
+
+void TrackState::save_state(void *buf) const {
+  SavedTrack track;
+  track.count = this->count_;
+  track.last[0] = this->last_.x();
+  track.last[1] = this->last_.y();
+  track.last[2] = this->last_.t();
+  track.prev[0] = this->prev_.x();
+  track.prev[1] = this->prev_.y();
+  track.prev[2] = this->prev_.t();
+  unsigned char *out = static_cast<unsigned char *>(buf);
+  memcpy(out, &track, sizeof(track));
+  std::visit([out](const auto &estimator) {
+    estimator.save_state(out + sizeof(SavedTrack));
+  }, this->estimator_);
+}
+
+bool TrackState::restore_state(const void *buf, const size_t len) {
+  if (!buf || len < sizeof(SavedTrack)) return false;
+  const unsigned char *in = static_cast<const unsigned char *>(buf);
+  bool ok = std::visit([in, len](auto &estimator) {
+    return estimator.restore_state(in + sizeof(SavedTrack),
+                                   len - sizeof(SavedTrack));
+  }, this->estimator_);
+  if (!ok) return false;
+  SavedTrack track;
+  memcpy(&track, in, sizeof(track));
+  this->count_ = track.count;
+  this->last_ = pathest::Location(track.last[0], track.last[1], track.last[2]);
+  this->prev_ = pathest::Location(track.prev[0], track.prev[1], track.prev[2]);
+  return true;
+}
+
+TrackTable::TrackTable(const EstimatorConfig &config,
+                       const size_t num_shards) :
+  config_(config),
+  num_shards_(num_shards ? num_shards : 1),
+  shards_(new Shard[num_shards ? num_shards : 1]) {}
+
+size_t TrackTable::shard(const uint64_t id) const {
+  // Mix the bits, since ids are often sequential.
+  uint64_t h = id;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h % this->num_shards_;
+}
+
+template <typename Record>
+void TrackTable::group(const Record *records, const size_t n,
+                       std::vector<uint64_t> *order) const {
+  order->resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    (*order)[i] = static_cast<uint64_t>(this->shard(records[i].id)) << 32 | i;
+  }
+  // Indices are unique, so the sort keeps the order within each shard.
+  std::sort(order->begin(), order->end());
+}
+
+size_t TrackTable::append(const AppendRecord *records, const size_t n,
+                          std::vector<uint64_t> *order) {
+  this->group(records, n, order);
+  size_t kept = 0;
+  for (size_t begin = 0, end; begin < n; begin = end) {
+    size_t s = (*order)[begin] >> 32;
+    for (end = begin + 1; end < n && ((*order)[end] >> 32) == s; ++end) {}
+    Shard &shard = this->shards_[s];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (size_t k = begin; k < end; ++k) {
+      const AppendRecord &record = records[(*order)[k] & 0xffffffff];
+      TrackState &track =
+        shard.tracks.try_emplace(record.id, this->config_).first->second;
+      if (track.append(pathest::Location(record.x, record.y, record.t))) {
+        ++kept;
+      }
+    }
+  }
+  return kept;
+}
+
+void TrackTable::query(const QueryRecord *records, const size_t n,
+                       QueryResult *results, std::vector<uint64_t> *order) {
+  this->group(records, n, order);
+  for (size_t begin = 0, end; begin < n; begin = end) {
+    size_t s = (*order)[begin] >> 32;
+    for (end = begin + 1; end < n && ((*order)[end] >> 32) == s; ++end) {}
+    const Shard &shard = this->shards_[s];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (size_t k = begin; k < end; ++k) {
+      size_t i = (*order)[k] & 0xffffffff;
+      QueryResult &result = results[i];
+      memset(&result, 0, sizeof(result));
+      result.id = records[i].id;
+      std::unordered_map<uint64_t, TrackState>::const_iterator it =
+        shard.tracks.find(records[i].id);
+      if (it == shard.tracks.end()) continue;
+      const TrackState &track = it->second;
+      result.count = track.count();
+      result.x = track.position().x();
+      result.y = track.position().y();
+      result.t = track.position().t();
+      result.speed = track.speed();
+    }
+  }
+}
+
+size_t TrackTable::size() const {
+  size_t size = 0;
+  for (size_t s = 0; s < this->num_shards_; ++s) {
+    std::lock_guard<std::mutex> guard(this->shards_[s].lock);
+    size += this->shards_[s].tracks.size();
+  }
+  return size;
+}
+
+long TrackTable::load(const char *filename) {
+  pathest::StateMap map;
+  if (!map.open(filename)) return -1;
+  for (size_t s = 0; s < this->num_shards_; ++s) {
+    std::lock_guard<std::mutex> guard(this->shards_[s].lock);
+    this->shards_[s].tracks.clear();
+  }
+  for (size_t i = 0; i < map.size(); ++i) {
+    const pathest::StateEntry &entry = map[i];
+    Shard &shard = this->shards_[this->shard(entry.id)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    TrackState &track =
+      shard.tracks.try_emplace(entry.id, this->config_).first->second;
+    if (!track.restore_state(map.state(entry), entry.size)) {
+      shard.tracks.erase(entry.id);
+      return -1;
+    }
+  }
+  return map.size();
+}
+
+bool TrackTable::save(const char *filename) const {
+  pathest::StateMapWriter writer;
+  if (!writer.open(filename, this->size())) return false;
+  bool ok = true;
+  for (size_t s = 0; s < this->num_shards_ && ok; ++s) {
+    std::lock_guard<std::mutex> guard(this->shards_[s].lock);
+    std::unordered_map<uint64_t, TrackState>::const_iterator it;
+    for (it = this->shards_[s].tracks.begin();
+         it != this->shards_[s].tracks.end() && ok; ++it) {
+      ok = writer.add(it->first, it->second);
+    }
+  }
+  return writer.close() && ok;
+}
@@ -0,0 +1,176 @@
+/// @file server/track_table.h
+/// @brief Sharded table of online estimator state by track id.
+///
+/// The server keeps one online estimator per track, fed with each report as it
+/// arrives, so that queries are answered from the latest estimate without
+/// looking at past reports. The table is split into shards by a hash of the
+/// track id, each behind its own lock, so connections working on different
+/// tracks rarely wait for each other. A batch of reports or queries is grouped
+/// by shard first, so each shard is locked once per batch, and the reports of
+/// one track keep their order.
+///
+/// The whole table can be saved to a state map (see pathest/estimator_state.h)
+/// and restored from one, so a restarted server answers from warm state.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SERVER_TRACK_TABLE_H_
+#define SERVER_TRACK_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "pathest/exponential_smoothing.h"
+#include "pathest/kalman_filter.h"
+#include "pathest/location.h"
+#include "pathest/simple_moving_average.h"
+#include "server/protocol.h"
+
+/// The online estimator run for every track, and its parameters.
+struct EstimatorConfig {
+  enum Kind {
+    kKalmanFilter,  //< Steady-state Kalman filter.
+    kSimpleMovingAverage,  //< Simple moving average over samples.
+    kExponentialSmoothing  //< Exponential smoothing by smoothing.
+  };
+
+  EstimatorConfig() : kind(kKalmanFilter), samples(0), smoothing(0) {}
+
+  /// Largest number of samples of the simple moving average. Every track
+  /// keeps a history of this many locations, so the bound caps the memory of
+  /// each track id that clients send.
+  static const size_t kMaxSamples = 1 << 12;
+
+  Kind kind;
+  size_t samples;  //< Samples of the simple moving average.
+  double smoothing;  //< Smoothing factor of exponential smoothing.
+
+  /// @brief Parse an estimator specification.
+  ///
+  /// One of "kf", "sma:<samples>" or "es:<smoothing factor>", with between 1
+  /// and kMaxSamples samples.
+  ///
+  /// @param spec The specification.
+  /// @returns true if successful, false otherwise.
+  bool parse(const char *spec);
+};
+
+/// Online estimate of one track.
+class TrackState {
+ public:
+  explicit TrackState(const EstimatorConfig &config);
+  ~TrackState() {}
+
+  /// @brief Add a report.
+  ///
+  /// @param loc The report.
+  /// @returns true if kept, false if older than the latest report.
+  bool append(const pathest::Location &loc);
+
+  uint64_t count() const;  //< Number of reports kept.
+  const pathest::Location &position() const;  //< Latest estimate.
+  double speed() const;  //< Speed between the latest two estimates, or zero.
+
+  /// @brief Size in bytes of the saved state.
+  ///
+  /// The state is the report count and latest two estimates, followed by the
+  /// state of the estimator.
+  size_t state_size() const;
+
+  /// @brief Save the state.
+  ///
+  /// @param buf The buffer, of at least state_size() bytes.
+  void save_state(void *buf) const;
+
+  /// @brief Restore a state saved with the same estimator configuration.
+  ///
+  /// @param buf The saved state.
+  /// @param len The size of the saved state in bytes.
+  /// @returns true if successful, false otherwise.
+  bool restore_state(const void *buf, const size_t len);
+
+ private:
+  typedef std::variant<pathest::KalmanFilter, pathest::SimpleMovingAverage,
+                       pathest::ExponentialSmoothing> Estimator;
+
+  Estimator estimator_;  //< Estimator of the track.
+  uint64_t count_;  //< Number of reports kept.
+  pathest::Location last_;  //< Latest estimate.
+  pathest::Location prev_;  //< Estimate before the latest.
+};
+
+class TrackTable {
+ public:
+  /// @brief Create an empty table.
+  ///
+  /// @param config The estimator for every track.
+  /// @param num_shards The number of shards, at least one.
+  TrackTable(const EstimatorConfig &config, const size_t num_shards);
+  ~TrackTable() {}
+
+  TrackTable(const TrackTable &) = delete;
+  TrackTable &operator=(const TrackTable &) = delete;
+
+  static const size_t kDefaultShards = 64;  //< Default number of shards.
+
+  /// @brief Add a batch of reports, creating tracks as needed.
+  ///
+  /// @param records The reports.
+  /// @param n The number of reports.
+  /// @param order Scratch space for grouping the batch by shard.
+  /// @returns the number of reports kept.
+  size_t append(const AppendRecord *records, const size_t n,
+                std::vector<uint64_t> *order);
+
+  /// @brief Get the latest estimates of a batch of tracks.
+  ///
+  /// @param records The tracks.
+  /// @param n The number of tracks.
+  /// @param results The results, one per track, in the same order.
+  /// @param order Scratch space for grouping the batch by shard.
+  void query(const QueryRecord *records, const size_t n,
+             QueryResult *results, std::vector<uint64_t> *order);
+
+  size_t size() const;  //< Number of tracks.
+
+  /// @brief Replace the table with the tracks of a state map.
+  ///
+  /// @param filename The state map file.
+  /// @returns the number of tracks restored, or -1 if the file is not a valid
+  ///   state map or a state does not match the estimator.
+  long load(const char *filename);
+
+  /// @brief Save every track to a state map.
+  ///
+  /// Must not run at the same time as append().
+  ///
+  /// @param filename The state map file.
+  /// @returns true if successful, false otherwise.
+  bool save(const char *filename) const;
+
+ private:
+  struct Shard {
+    Shard() : lock(), tracks() {}
+
+    mutable std::mutex lock;  //< Guards tracks.
+    std::unordered_map<uint64_t, TrackState> tracks;  //< Tracks by id.
+  };
+
+  const EstimatorConfig config_;  //< Estimator for every track.
+  const size_t num_shards_;  //< Number of shards.
+  std::unique_ptr<Shard[]> shards_;  //< Shards.
+
+  size_t shard(const uint64_t id) const;  //< Shard of a track.
+
+  /// Sort the indices of a batch by shard, as shard << 32 | index.
+  template <typename Record>
+  void group(const Record *records, const size_t n,
+             std::vector<uint64_t> *order) const;
+};
+
+#endif  // SERVER_TRACK_TABLE_H_
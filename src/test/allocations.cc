@@ -0,0 +1,59 @@
+/// @file test/allocations.cc
+/// @brief Allocation counting for the profile report.
+///
+/// When built with profiling, the global allocation functions are replaced so
+/// that every heap allocation is counted by the profiler. Otherwise this file
+/// is empty.
+///
+//===----------------------------------------------------------------------===//
+
+#include "pathest/profile.h"
+
+#ifdef PATHEST_PROFILE
+
+#include <stdlib.h>
+#include <new>
+
+void *operator new(size_t size) {
+  pathest::profile::count_allocation();
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size) {
+  pathest::profile::count_allocation();
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+// Aligned allocations, e.g. by std::pmr::new_delete_resource(), are counted
+// too.
+void *operator new(size_t size, std::align_val_t align) {
+  pathest::profile::count_allocation();
+  void *ptr = aligned_alloc(static_cast<size_t>(align),
+                            (size + static_cast<size_t>(align) - 1) &
+                            ~(static_cast<size_t>(align) - 1));
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+  return operator new(size, align);
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  free(ptr);
+}
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  free(ptr);
+}
+
+#endif  // PATHEST_PROFILE
@@ -11,12 +11,19 @@
 /// entire data set. An iteration number of 1 would simulate real-time
 /// data analysis.
 ///
+/// The time moving average takes the duration of its window (in the units of
+/// the timestamps) and the number of iterations to run over the entire data
+/// set. Unlike the simple moving average, it is not thrown off by bursts of
+/// closely spaced reports.
+///
 /// Exponential smoothing takes the smoothing factor (a float between 0 and 1)
 /// and the number of iterations to run over the entire data set. An iteration
 /// number of 1 would simulate real-time data analysis.
 ///
 /// Currently the Kalman filter has its initial state hardcoded, but this may
-/// change in the future.
+/// change in the future. The Rauch-Tung-Striebel smoother runs the same filter
+/// forward and then backward over the whole data set, so it does not simulate
+/// real-time analysis.
 ///
 //===----------------------------------------------------------------------===//
 
@@ -24,104 +31,204 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <string.h>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "json/json.h"
+#include "pathest/arena.h"
 #include "pathest/path.h"
+#include "pathest/profile.h"
+#include "test/cache.h"
 #include "test/parse.h"
 #include "test/results.h"
 
-// There are up to 10 digits in a decimal representation of a uint32_t value.
-#define UINT32_MAX_DIGITS 10
-
-// Types for analysis parameters.
-typedef std::pair<int, int> sma_param_t;
-typedef std::pair<int, double> es_param_t;
-typedef std::vector<sma_param_t> sma_params_t;
-typedef std::vector<es_param_t> es_params_t;
-
-typedef struct AnalysisParams {
-  AnalysisParams() :
-    sma_params(std::vector<sma_param_t>()),
-    es_params(std::vector<es_param_t>()), use_kf(false) {}
-  ~AnalysisParams() {}
-
-  sma_params_t sma_params;
-  es_params_t es_params;
-  bool use_kf;
-} analysis_params_t;
-
-// Templates for plot names and titles.
+// Templates for plot names and titles, formatted into buffers of
+// Results::kMaxName and Results::kMaxTitle characters.
 const char *sma_name = "out-sma-%d";
-const size_t sma_name_len = strlen(sma_name) + UINT32_MAX_DIGITS + 1 - 2;
 const char *sma_title =
   "Simple moving average with %d iteration(s) and %d sample(s)";
-const size_t sma_title_len =
-  strlen(sma_title) + (2 * UINT32_MAX_DIGITS) + 1 - 4;
 
 const char *es_name = "out-es-%d";
-const size_t es_name_len = strlen(es_name) + UINT32_MAX_DIGITS + 1 - 2;
 const char *es_title =
   "Exponential smoothing with %d iteration(s) and smoothing factor %.4f";
-const size_t es_title_len = strlen(es_title) + UINT32_MAX_DIGITS + 6 + 1 - 6;
+
+const char *tma_name = "out-tma-%d";
+const char *tma_title =
+  "Time moving average with %d iteration(s) and duration %g";
 
 const char *kf_name = "out-kf";
 const char *kf_title = "Kalman filter";
 
-// Fill an existing params struct with the contents of a given file.
-bool parse_params(const char *, analysis_params_t *);
+const char *rts_name = "out-rts";
+const char *rts_title = "Rauch-Tung-Striebel smoother";
 
 void perform_analysis(const char *config, const pathest::Path &input,
-                      const Results &res) {
+                      const Results &res, AnalysisArenas *arenas) {
   analysis_params_t params;
   if (parse_params(config, &params)) {
-    uint32_t count;
-    pathest::Path est_data;
-
-    // Simple moving average analysis.
-    count = 0;
-    for (sma_params_t::const_iterator it = params.sma_params.begin();
-         it != params.sma_params.end(); ++it) {
-      est_data = input;
-      int iterations = it->first;
-      int samples = it->second;
-      for (int i = 0; i < iterations; ++i) {
-        est_data = est_data.sma_path(samples);
-      }
-      std::vector<char> name(sma_name_len);
-      std::vector<char> title(sma_title_len);
-      snprintf(&name[0], sma_name_len, sma_name, count);
-      snprintf(&title[0], sma_title_len, sma_title, iterations, samples);
-      res.write(&name[0], &title[0], est_data);
-      ++count;
-    }
+    perform_analysis(params, input, res, arenas);
+  }
+}
 
-    // Exponential smoothing analysis.
-    count = 0;
-    for (es_params_t::const_iterator it = params.es_params.begin();
-         it != params.es_params.end(); ++it) {
-      est_data = input;
-      int iterations = it->first;
-      double smoothing = it->second;
-      for (int i = 0; i < iterations; ++i) {
-        est_data = est_data.es_path(smoothing);
-      }
-      std::vector<char> name(es_name_len);
-      std::vector<char> title(es_title_len);
-      snprintf(&name[0], es_name_len, es_name, count);
-      snprintf(&title[0], es_title_len, es_title, iterations, smoothing);
-      res.write(&name[0], &title[0], est_data);
-      ++count;
+namespace {
+
+// Longest normalized parameter string of a cache key, e.g. "es %d %.17g".
+const size_t cache_params_len = 64;
+
+// What an estimate of the current input needs to use the cache.
+struct CacheContext {
+  ResultCache *cache;  // Cache of estimates, or NULL.
+  uint64_t input_hash;  // Hash of the input locations.
+  uint64_t ref_hash;  // Hash of the reference locations, or 0.
+};
+
+// The arenas of an analysis, taken in turn, with the ticket of the last write
+// of an estimate in each.
+struct ArenaTurns {
+  AnalysisArenas *arenas;
+  uint64_t tickets[AnalysisArenas::kArenas];
+  size_t next;  // Index of the arena to take next.
+};
+
+// Take the next arena, once the write of the estimate that last used it has
+// run, and reset it.
+size_t take_arena(const Results &res, ArenaTurns *turns) {
+  size_t turn = turns->next;
+  turns->next = (turn + 1) % AnalysisArenas::kArenas;
+  res.wait(turns->tickets[turn]);
+  turns->arenas->arenas[turn].reset();
+  return turn;
+}
+
+// Compute one estimate of the input, or read it from the cache, and write the
+// results. The estimate function is called with a copy of the input in the
+// next arena and estimates it in place. The estimate is handed to the writer
+// and stays in the arena until it is written.
+template <typename Estimate>
+void analyze(const pathest::Path &input, const Results &res,
+             ArenaTurns *turns, const CacheContext &ctx, const char *params,
+             const char *name, const char *title, Estimate estimate) {
+  size_t turn = take_arena(res, turns);
+  pathest::Arena *arena = &turns->arenas->arenas[turn];
+  if (!ctx.cache) {
+    pathest::Path est_data(input, arena);
+    estimate(&est_data);
+    res.write(name, title, std::move(est_data));
+    turns->tickets[turn] = res.last_write();
+    return;
+  }
+  uint64_t key = ResultCache::key(ctx.input_hash, ctx.ref_hash, params);
+  Results::Metrics metrics;
+  {
+    pathest::Path est_data(arena);
+    if (ctx.cache->load(key, input.size(), &est_data, &metrics)) {
+      res.write(name, title, std::move(est_data), metrics);
+      turns->tickets[turn] = res.last_write();
+      return;
     }
+  }
+  arena->reset();
+  pathest::Path est_data(input, arena);
+  estimate(&est_data);
+  metrics = res.metrics(est_data);
+  ctx.cache->store(key, est_data, metrics);
+  res.write(name, title, std::move(est_data), metrics);
+  turns->tickets[turn] = res.last_write();
+}
+
+}  // namespace
 
-    // Kalman filter analysis.
-    if (params.use_kf) {
-      est_data = input.kf_path();
-      res.write(kf_name, kf_title, est_data);
+void perform_analysis(const analysis_params_t &params,
+                      const pathest::Path &input, const Results &res,
+                      AnalysisArenas *arenas, ResultCache *cache) {
+  PATHEST_PROFILE_SCOPE_ITEMS("analysis", input.size());
+  std::unique_ptr<AnalysisArenas> local_arenas;
+  if (!arenas) {
+    local_arenas.reset(new AnalysisArenas());
+    arenas = local_arenas.get();
+  }
+  ArenaTurns turns = {arenas, {}, 0};
+  uint32_t count;
+
+  CacheContext ctx = {cache, 0, 0};
+  if (cache) {
+    ctx.input_hash = ResultCache::hash(input);
+    if (!res.reference().empty()) {
+      ctx.ref_hash = ResultCache::hash(res.reference());
     }
   }
+  char key_params[cache_params_len];
+  char name[Results::kMaxName];
+  char title[Results::kMaxTitle];
+
+  // Simple moving average analysis.
+  count = 0;
+  for (sma_params_t::const_iterator it = params.sma_params.begin();
+       it != params.sma_params.end(); ++it) {
+    int iterations = it->first;
+    int samples = it->second;
+    snprintf(name, sizeof(name), sma_name, count);
+    snprintf(title, sizeof(title), sma_title, iterations, samples);
+    snprintf(key_params, sizeof(key_params), "sma %d %d", iterations, samples);
+    analyze(input, res, &turns, ctx, key_params, name, title,
+            [iterations, samples](pathest::Path *est_data) {
+      for (int i = 0; i < iterations; ++i) est_data->sma_in_place(samples);
+    });
+    ++count;
+  }
+
+  // Exponential smoothing analysis.
+  count = 0;
+  for (es_params_t::const_iterator it = params.es_params.begin();
+       it != params.es_params.end(); ++it) {
+    int iterations = it->first;
+    double smoothing = it->second;
+    snprintf(name, sizeof(name), es_name, count);
+    snprintf(title, sizeof(title), es_title, iterations, smoothing);
+    snprintf(key_params, sizeof(key_params), "es %d %.17g", iterations,
+             smoothing);
+    analyze(input, res, &turns, ctx, key_params, name, title,
+            [iterations, smoothing](pathest::Path *est_data) {
+      for (int i = 0; i < iterations; ++i) est_data->es_in_place(smoothing);
+    });
+    ++count;
+  }
+
+  // Time moving average analysis.
+  count = 0;
+  for (tma_params_t::const_iterator it = params.tma_params.begin();
+       it != params.tma_params.end(); ++it) {
+    int iterations = it->first;
+    double duration = it->second;
+    snprintf(name, sizeof(name), tma_name, count);
+    snprintf(title, sizeof(title), tma_title, iterations, duration);
+    snprintf(key_params, sizeof(key_params), "tma %d %.17g", iterations,
+             duration);
+    analyze(input, res, &turns, ctx, key_params, name, title,
+            [iterations, duration](pathest::Path *est_data) {
+      for (int i = 0; i < iterations; ++i) est_data->tma_in_place(duration);
+    });
+    ++count;
+  }
+
+  // Kalman filter analysis.
+  if (params.use_kf) {
+    analyze(input, res, &turns, ctx, "kf", kf_name, kf_title,
+            [](pathest::Path *est_data) { est_data->kf_in_place(); });
+  }
+
+  // Rauch-Tung-Striebel smoother analysis.
+  if (params.use_rts) {
+    analyze(input, res, &turns, ctx, "rts", rts_name, rts_title,
+            [](pathest::Path *est_data) { est_data->rts_in_place(); });
+  }
+
+  // Estimates stay in the arenas until they are written.
+  res.wait(res.last_write());
+  for (size_t i = 0; i < AnalysisArenas::kArenas; ++i) {
+    arenas->arenas[i].reset();
+  }
 }
 
 bool parse_params(const char *filename, analysis_params_t *params) {
@@ -130,10 +237,13 @@ bool parse_params(const char *filename, analysis_params_t *params) {
 
   Json::Value sma = root["sma"];
   Json::Value es = root["es"];
+  Json::Value tma = root["tma"];
   Json::Value kf = root.get("kf", false);
+  Json::Value rts = root.get("rts", false);
 
   // Kalman filter parameters.
   if (kf.isBool()) params->use_kf = kf.asBool();
+  if (rts.isBool()) params->use_rts = rts.asBool();
 
   // Simple moving average parameters.
   if (sma.isArray()) {
@@ -167,5 +277,20 @@ bool parse_params(const char *filename, analysis_params_t *params) {
     }
   }
 
+  // Time moving average parameters.
+  if (tma.isArray()) {
+    for (unsigned i = 0; i < tma.size(); ++i) {
+      Json::Value iterations = tma[i]["iterations"];
+      Json::Value duration = tma[i]["duration"];
+      if (iterations.isInt() && duration.isNumeric()) {
+        int iter = iterations.asInt();
+        double dur = duration.asDouble();
+        if (iter > 0 && dur > 0) {
+          params->tma_params.push_back(tma_param_t(iter, dur));
+        }
+      }
+    }
+  }
+
   return true;
 }
@@ -5,15 +5,84 @@
 #ifndef TEST_ANALYSIS_H_
 #define TEST_ANALYSIS_H_
 
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+#include "pathest/arena.h"
 #include "pathest/path.h"
+#include "test/cache.h"
 #include "test/results.h"
 
+// Types for analysis parameters.
+typedef std::pair<int, int> sma_param_t;
+typedef std::pair<int, double> es_param_t;
+typedef std::pair<int, double> tma_param_t;
+typedef std::vector<sma_param_t> sma_params_t;
+typedef std::vector<es_param_t> es_params_t;
+typedef std::vector<tma_param_t> tma_params_t;
+
+typedef struct AnalysisParams {
+  AnalysisParams() :
+    sma_params(std::vector<sma_param_t>()),
+    es_params(std::vector<es_param_t>()),
+    tma_params(std::vector<tma_param_t>()), use_kf(false), use_rts(false) {}
+  ~AnalysisParams() {}
+
+  sma_params_t sma_params;
+  es_params_t es_params;
+  tma_params_t tma_params;
+  bool use_kf;
+  bool use_rts;
+} analysis_params_t;
+
+/// @brief Arenas for estimated paths.
+///
+/// Configurations take the arenas in turn, and an arena is only reset once the
+/// write of the estimate that last used it has run. Each estimate is written
+/// from the arena it was computed in, without a copy, while the next one is
+/// computed in the other arena.
+struct AnalysisArenas {
+  static const size_t kArenas = 2;
+  pathest::Arena arenas[kArenas];
+};
+
+/// @brief Fill an existing params struct with the contents of a config file.
+///
+/// @param config Configuration file path.
+/// @param params Params struct to fill.
+/// @returns true if successful, false otherwise.
+bool parse_params(const char *config, analysis_params_t *params);
+
 /// @brief Perform analysis on the input data based on the given config file.
 ///
+/// Estimated paths are allocated from the given arenas, each of which is reset
+/// before a configuration is analyzed in it. Passing the same arenas to every
+/// run lets repeated runs reuse their memory instead of allocating. Returns
+/// once every estimate has been written.
+///
 /// @param config Configuration file path.
 /// @param input Path object to analyze.
 /// @param res Results object.
+/// @param arenas Arenas for estimated paths, or NULL to use temporary ones.
 void perform_analysis(const char *config, const pathest::Path &input,
-                      const Results &res);
+                      const Results &res, AnalysisArenas *arenas = NULL);
+
+/// @brief Perform analysis on the input data with already parsed parameters.
+///
+/// Lets many inputs share one parse of the config file. Safe to call from
+/// multiple threads at once, given different arenas. With a cache, estimates
+/// of the same input, reference and parameters are read back from earlier
+/// runs, and the others are computed and added to it.
+///
+/// @param params Analysis parameters.
+/// @param input Path object to analyze.
+/// @param res Results object.
+/// @param arenas Arenas for estimated paths, or NULL to use temporary ones.
+/// @param cache Cache of estimates, or NULL to compute every estimate.
+void perform_analysis(const analysis_params_t &params,
+                      const pathest::Path &input, const Results &res,
+                      AnalysisArenas *arenas = NULL,
+                      ResultCache *cache = NULL);
 
 #endif  // TEST_ANALYSIS_H_
@@ -0,0 +1,157 @@
+/// @file test/cache.cc
+/// @brief Class for keeping estimates on disk between runs.
+//===----------------------------------------------------------------------===//
+
+#include "test/cache.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <utility>
+
+#include "pathest/location.h"
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+#include "pathest/profile.h"
+#include "pathest/track_io.h"
+#include "test/results.h"
+
+namespace {
+
+const char metrics_magic[4] = {'P', 'M', 'E', 'T'};
+
+// Changes whenever estimators change their output, so that old entries miss.
+const uint64_t cache_version = 1;
+
+// MurmurHash64A by Austin Appleby.
+uint64_t murmur64(const void *data, const size_t len, const uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  uint64_t h = seed ^ (len * m);
+  size_t blocks = len / 8;
+  for (size_t i = 0; i < blocks; ++i) {
+    uint64_t k;
+    memcpy(&k, bytes + 8 * i, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  size_t tail = len % 8;
+  if (tail) {
+    for (size_t i = tail; i > 0; --i) {
+      h ^= static_cast<uint64_t>(bytes[8 * blocks + i - 1]) << (8 * (i - 1));
+    }
+    h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+}  // namespace
+
+ResultCache::ResultCache(const char *dir) :
+  dir_(dir), ok_(false), hits_(0), misses_(0), temp_(0) {
+  struct stat st;
+  if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+    fprintf(stderr, "Warning: unable to create cache directory: %s\n", dir);
+  } else if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "Warning: not a directory: %s\n", dir);
+  } else {
+    this->ok_ = true;
+  }
+}
+
+uint64_t ResultCache::hash(pathest::PathView path, const uint64_t seed) {
+  PATHEST_PROFILE_SCOPE_ITEMS("hash", path.size());
+  return murmur64(path.data(), path.size() * sizeof(pathest::Location), seed);
+}
+
+uint64_t ResultCache::key(const uint64_t input_hash, const uint64_t ref_hash,
+                          const char *params) {
+  uint64_t seed[3] = {input_hash, ref_hash, cache_version};
+  return murmur64(params, strlen(params), murmur64(seed, sizeof(seed), 0));
+}
+
+bool ResultCache::ok() const { return this->ok_; }
+size_t ResultCache::hits() const { return this->hits_; }
+size_t ResultCache::misses() const { return this->misses_; }
+
+std::string ResultCache::entry_name(const uint64_t key) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(key));
+  return this->dir_ + "/" + name + ".bin";
+}
+
+bool ResultCache::load(const uint64_t key, const size_t count,
+                       pathest::Path *path, Results::Metrics *metrics) {
+  if (!this->ok_) return false;
+  PATHEST_PROFILE_SCOPE_ITEMS("cache_load", count);
+  std::string name = this->entry_name(key);
+  FILE *fp = fopen(name.c_str(), "rb");
+  if (!fp) {
+    ++this->misses_;
+    return false;
+  }
+  pathest::Path entry(path->resource());
+  entry.reserve(count);
+  char magic[sizeof(metrics_magic)];
+  uint32_t has_ref;
+  double values[4];
+  bool ok = pathest::read_binary(fp, &entry) && entry.size() == count &&
+    fread(magic, sizeof(magic), 1, fp) == 1 &&
+    !memcmp(magic, metrics_magic, sizeof(magic)) &&
+    fread(&has_ref, sizeof(has_ref), 1, fp) == 1 &&
+    fread(values, sizeof(double), 4, fp) == 4;
+  fclose(fp);
+  if (!ok) {
+    ++this->misses_;
+    return false;
+  }
+  if (path->empty()) {
+    *path = std::move(entry);
+  } else {
+    for (size_t i = 0; i < entry.size(); ++i) path->insert(entry.data()[i]);
+  }
+  metrics->has_ref = has_ref;
+  metrics->mae = values[0];
+  metrics->rmse = values[1];
+  metrics->mase = values[2];
+  metrics->avg_speed = values[3];
+  ++this->hits_;
+  return true;
+}
+
+bool ResultCache::store(const uint64_t key, pathest::PathView path,
+                        const Results::Metrics &metrics) {
+  if (!this->ok_) return false;
+  PATHEST_PROFILE_SCOPE_ITEMS("cache_store", path.size());
+  std::string name = this->entry_name(key);
+  std::string temp = name + ".tmp." + std::to_string(getpid()) + "." +
+    std::to_string(this->temp_++);
+  FILE *fp = fopen(temp.c_str(), "wb");
+  if (!fp) return false;
+  uint32_t has_ref = metrics.has_ref;
+  double values[4] = {metrics.mae, metrics.rmse, metrics.mase,
+                      metrics.avg_speed};
+  bool ok = pathest::write_binary(fp, path) &&
+    fwrite(metrics_magic, sizeof(metrics_magic), 1, fp) == 1 &&
+    fwrite(&has_ref, sizeof(has_ref), 1, fp) == 1 &&
+    fwrite(values, sizeof(double), 4, fp) == 4;
+  if (fclose(fp) != 0) ok = false;
+  if (!ok || rename(temp.c_str(), name.c_str()) < 0) {
+    remove(temp.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,91 @@
+/// @file test/cache.h
+/// @brief Class for keeping estimates on disk between runs.
+///
+/// Each entry is one estimated path, keyed by a hash of the input locations,
+/// the reference locations and the normalized estimator parameters, so that a
+/// rerun on unchanged data and config reads its estimates back instead of
+/// computing them. An entry is a binary track file (see pathest/track_io.h)
+/// named by its key, followed by the metrics of the estimate:
+///
+///   char     magic[4]   "PMET"
+///   uint32_t has_ref    Whether the errors were measured against a reference.
+///   double   mae, rmse, mase, avg_speed
+///
+/// Entries are written to a temporary file and renamed into place, so runs
+/// sharing a cache directory never see a partial entry. Entries that are
+/// missing, truncated or of the wrong size are misses, and are overwritten.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TEST_CACHE_H_
+#define TEST_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include "pathest/path.h"
+#include "pathest/path_view.h"
+#include "test/results.h"
+
+class ResultCache {
+ public:
+  /// @brief Use a cache directory, creating it if it does not exist.
+  ///
+  /// @param dir The cache directory.
+  explicit ResultCache(const char *dir);
+  ~ResultCache() {}
+
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+
+  /// @brief Hash locations, with MurmurHash64A over their bytes.
+  ///
+  /// @param path The locations.
+  /// @param seed The seed of the hash.
+  static uint64_t hash(pathest::PathView path, const uint64_t seed = 0);
+
+  /// @brief Get the key of an estimate.
+  ///
+  /// @param input_hash The hash of the input locations.
+  /// @param ref_hash The hash of the reference locations.
+  /// @param params The normalized estimator parameters, e.g. "es 2 0.25".
+  static uint64_t key(const uint64_t input_hash, const uint64_t ref_hash,
+                      const char *params);
+
+  bool ok() const;  //< Whether the directory is usable.
+
+  /// @brief Read an entry.
+  ///
+  /// Locations are appended to the given path, which is left unchanged on a
+  /// miss.
+  ///
+  /// @param key The key of the entry.
+  /// @param count The expected number of locations.
+  /// @param path The path to append to.
+  /// @param metrics The metrics to fill.
+  /// @returns true on a hit, false on a miss.
+  bool load(const uint64_t key, const size_t count, pathest::Path *path,
+            Results::Metrics *metrics);
+
+  /// @brief Write an entry, replacing any with the same key.
+  ///
+  /// @returns true if successful, false otherwise.
+  bool store(const uint64_t key, pathest::PathView path,
+             const Results::Metrics &metrics);
+
+  size_t hits() const;  //< Number of loads that hit.
+  size_t misses() const;  //< Number of loads that missed.
+
+ private:
+  std::string dir_;  //< Cache directory.
+  bool ok_;  //< Whether the directory is usable.
+  std::atomic<size_t> hits_;  //< Number of loads that hit.
+  std::atomic<size_t> misses_;  //< Number of loads that missed.
+  std::atomic<size_t> temp_;  //< Counter for unique temporary file names.
+
+  std::string entry_name(const uint64_t key) const;  //< File of an entry.
+};
+
+#endif  // TEST_CACHE_H_
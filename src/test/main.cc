@@ -1,100 +1,589 @@
 /// @file test/main.cc
 /// @brief Main program for path estimation test.
+///
+/// Work is pipelined across threads: results are written on a background
+/// thread (see AsyncWriter) while the next estimate is computed, and tracks of
+/// an archive are read ahead on another thread while the current one is
+/// analyzed. Bounded queues between the stages keep at most a few tracks and
+/// results in memory. Tracks are read into a fixed set of slots, each with its
+/// own arena, and estimated in arenas shared by every track, so once the
+/// arenas have grown to fit the largest track, analyzing another one does not
+/// allocate.
+///
+/// Pack mode (-p) reads input files into a track archive instead of analyzing
+/// them: files of reports with track ids, such as one file per day holding
+/// every train, and single-track files named by track number (see
+/// add_tracks()).
+///
+/// Batch mode (-b) analyzes a directory or a list of input files in one
+/// process, with the config parsed once and inputs spread over a pool of
+/// threads (-j). Each input gets its own output directory, named after the
+/// input file without its extension, and is paired with a reference file in
+/// the same way as test/driver.py: X.txt with X.ref, or X.bin with X.ref.bin,
+/// if it exists.
+///
 //===----------------------------------------------------------------------===//
 
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "json/json.h"
+#include "pathest/arena.h"
+#include "pathest/parallel.h"
 #include "pathest/path.h"
+#include "pathest/profile.h"
+#include "pathest/track_archive.h"
 #include "test/analysis.h"
+#include "test/cache.h"
 #include "test/parse.h"
+#include "test/queue.h"
 #include "test/results.h"
+#include "test/writer.h"
+
+// Number of archive tracks read ahead of the one being analyzed.
+const size_t read_ahead = 2;
+
+// Number of slots for archive tracks: those read ahead, the one being read
+// and the one being analyzed.
+const size_t track_slots = read_ahead + 2;
+
+// A slot for a track read from an archive, waiting to be analyzed. The paths
+// of the track are allocated from the arena of the slot.
+struct Track {
+  Track() : arena(), id(0), input(&arena), ref(&arena), has_ref(false) {}
+
+  Track(const Track &) = delete;
+  Track &operator=(const Track &) = delete;
+
+  // Drop the paths of the previous track and reset the arena for the next.
+  void clear() {
+    this->input = pathest::Path(&this->arena);
+    this->ref = pathest::Path(&this->arena);
+    this->arena.reset();
+  }
+
+  pathest::Arena arena;
+  uint64_t id;
+  pathest::Path input;
+  pathest::Path ref;
+  bool has_ref;  // Whether the reference archive has the track.
+};
+
+// An input file of a batch.
+struct BatchInput {
+  BatchInput() : input(), ref(), name() {}
+
+  std::string input;
+  std::string ref;  // Reference file, or empty if there is none.
+  std::string name;  // Name of the output directory.
+};
 
 // Fill an existing data object with the contents of a given file.
 bool parse_data(const char *, pathest::Path *);
 
-int main(int argc, const char *argv[]) {
-  if (argc < 4) {
-    fprintf(stderr, "Usage: %s <analysis config> <input file>"
-            " <output directory> <optional reference file>\n", argv[0]);
+// Add the reports in a JSON input file to an existing data object.
+bool parse_json_data(const char *, pathest::Path *);
+
+// Check that data has enough spread to analyze.
+bool check_data(const pathest::Path &);
+
+// Analyze one track and write the results to an existing directory.
+void estimate(const analysis_params_t &, const pathest::Path &,
+              const pathest::Path *, const char *, AsyncWriter *,
+              ResultCache *, AnalysisArenas * = NULL, bool = true);
+
+// Analyze one input file, with an optional reference file.
+int estimate_file(const analysis_params_t &, const char *, const char *,
+                  const char *, AsyncWriter *, ResultCache *);
+
+// Analyze one track of an archive into its own directory.
+int estimate_track(const analysis_params_t &, const Track &, const bool,
+                   const char *, AsyncWriter *, ResultCache *,
+                   AnalysisArenas *);
+
+// Analyze the selected tracks of an archive, each into its own directory.
+int estimate_archive(const analysis_params_t &, const char *, const char *,
+                     const char *, const char *, AsyncWriter *, ResultCache *);
+
+// Analyze a directory or list of input files, each into its own directory.
+int estimate_batch(const analysis_params_t &, const char *, const char *,
+                   unsigned, AsyncWriter *, ResultCache *);
+
+// Fill a list of batch inputs from a directory or a list file.
+bool list_batch(const char *, std::vector<BatchInput> *);
+
+// Write the tracks of input files to a track archive.
+int pack_archive(const char *, const int, char *const *);
+
+void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-c cache directory] [-t track ids]"
+          " <analysis config> <input file> <output directory>"
+          " <optional reference file>\n"
+          "       %s -b [-j threads] [-c cache directory] <analysis config>"
+          " <input directory or list file> <output directory>\n"
+          "       %s -p <archive> <input file>...\n", name, name, name);
+}
+
+int main(int argc, char *argv[]) {
+  const char *ids = NULL;
+  const char *cache_dir = NULL;
+  const char *pack = NULL;
+  bool batch = false;
+  unsigned threads = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:bj:c:p:")) != -1) {
+    switch (opt) {
+      case 't': ids = optarg; break;
+      case 'p': pack = optarg; break;
+      case 'c': cache_dir = optarg; break;
+      case 'b': batch = true; break;
+      case 'j': threads = strtoul(optarg, NULL, 10); break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (pack) {
+    if (argc - optind < 1 || batch || ids || cache_dir) {
+      usage(argv[0]);
+      return -1;
+    }
+    return pack_archive(pack, argc - optind, argv + optind);
+  }
+  if (argc - optind < 3 || (batch && (ids || argc - optind > 3))) {
+    usage(argv[0]);
     return -1;
   }
+  const char *config = argv[optind];
+  const char *input = argv[optind + 1];
+  const char *out_dir = argv[optind + 2];
+  const char *ref = argc - optind > 3 ? argv[optind + 3] : NULL;
 
+  // Check the output directory.
+  struct stat st;
+  if (stat(out_dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "No such directory: %s\n", out_dir);
+    return -1;
+  }
+
+  // Parse the config once for every input. An invalid config writes only the
+  // input and reference data.
+  analysis_params_t params;
+  parse_params(config, &params);
+
+  // Estimates are read from and added to the cache, if one is given.
+  std::unique_ptr<ResultCache> cache;
+  if (cache_dir) {
+    cache.reset(new ResultCache(cache_dir));
+    if (!cache->ok()) cache.reset();
+  }
+
+  AsyncWriter writer;
+  int status = 0;
+  if (batch) {
+    status = estimate_batch(params, input, out_dir, threads, &writer,
+                            cache.get());
+  } else if (is_archive_file(input)) {
+    status = estimate_archive(params, input, out_dir, ref, ids, &writer,
+                              cache.get());
+  } else if (ids) {
+    fprintf(stderr, "Track ids given, but %s is not a track archive\n", input);
+    return -1;
+  } else {
+    status = estimate_file(params, input, out_dir, ref, &writer, cache.get());
+  }
+  if (cache) {
+    fprintf(stdout, "Cache: %zu hit(s), %zu miss(es)\n", cache->hits(),
+            cache->misses());
+  }
+  return status;
+}
+
+int estimate_file(const analysis_params_t &params, const char *input,
+                  const char *out_dir, const char *ref, AsyncWriter *writer,
+                  ResultCache *cache) {
   // Gather input data.
   pathest::Path report_data;
-  if (!parse_data(argv[2], &report_data)) {
-    fprintf(stderr, "Failed to read input data from %s\n", argv[2]);
+  if (!parse_data(input, &report_data)) {
+    fprintf(stderr, "Failed to read input data from %s\n", input);
     return -1;
   }
 
-  // Check the output directory.
-  struct stat st;
-  if (stat(argv[3], &st) < 0 || !S_ISDIR(st.st_mode)) {
-    fprintf(stderr, "No such directory: %s\n", argv[3]);
+  // Check for optional reference file. Continue if there is an error.
+  pathest::Path reference_data;
+  bool has_ref = false;
+  if (ref) {
+    has_ref = parse_data(ref, &reference_data);
+    if (!has_ref) fprintf(stderr, "Warning: unable to read reference data\n");
+  }
+
+  estimate(params, report_data, has_ref ? &reference_data : NULL, out_dir,
+           writer, cache);
+  return 0;
+}
+
+void estimate(const analysis_params_t &params,
+              const pathest::Path &report_data,
+              const pathest::Path *reference_data, const char *out_dir,
+              AsyncWriter *writer, ResultCache *cache, AnalysisArenas *arenas,
+              bool profile) {
+  Results res(out_dir, report_data, writer);
+  if (reference_data) res.add_reference(*reference_data);
+  res.write("input", "Input data", report_data);  // Write the input data.
+  perform_analysis(params, report_data, res, arenas, cache);  // And write.
+#ifdef PATHEST_PROFILE
+  if (profile) res.write_profile();
+#else
+  (void) profile;
+#endif
+}
+
+int estimate_archive(const analysis_params_t &params, const char *input,
+                     const char *out_dir, const char *ref, const char *ids,
+                     AsyncWriter *writer, ResultCache *cache) {
+  pathest::Archive archive;
+  if (!archive.open(input)) {
+    fprintf(stderr, "Can't read track archive: %s\n", input);
     return -1;
   }
-  Results res(argv[3], report_data);
 
-  // Check for optional reference file. Continue if there is an error.
-  if (argc > 4) {
-    pathest::Path reference_data;
-    if (parse_data(argv[4], &reference_data)) {
-      res.add_reference(reference_data);
-    } else {
-      fprintf(stderr, "Warning: unable to read reference data\n");
+  // The reference archive is optional. Continue if there is an error.
+  pathest::Archive ref_archive;
+  bool has_ref = false;
+  if (ref) {
+    has_ref = ref_archive.open(ref);
+    if (!has_ref) fprintf(stderr, "Warning: unable to read reference data\n");
+  }
+
+  // Select tracks: a comma-separated list of ids, or every track.
+  std::vector<const pathest::ArchiveEntry *> tracks;
+  if (ids) {
+    tracks.reserve(std::count(ids, ids + strlen(ids), ',') + 1);
+    const char *pos = ids;
+    while (*pos) {
+      char *end;
+      errno = 0;
+      uint64_t id = strtoull(pos, &end, 10);
+      if (end == pos || errno || (*end && *end != ',')) {
+        fprintf(stderr, "Invalid track ids: %s\n", ids);
+        return -1;
+      }
+      const pathest::ArchiveEntry *entry = archive.find(id);
+      if (!entry) {
+        fprintf(stderr, "No such track in %s: %llu\n", input,
+                static_cast<unsigned long long>(id));
+        return -1;
+      }
+      tracks.push_back(entry);
+      pos = *end ? end + 1 : end;
     }
+  } else {
+    tracks.reserve(archive.size());
+    for (size_t i = 0; i < archive.size(); ++i) tracks.push_back(&archive[i]);
   }
 
-  res.write("input", "Input data", report_data);  // Write the input data.
-  perform_analysis(argv[1], report_data, res);  // Compute and write results.
+  // Read tracks on another thread, a few ahead of the analysis, into slots
+  // that come back to the reader once analyzed.
+  Track slots[track_slots];
+  BoundedQueue<Track *> free_slots(track_slots);
+  for (size_t i = 0; i < track_slots; ++i) free_slots.push(&slots[i]);
+  BoundedQueue<Track *> queue(read_ahead);
+  std::thread reader([&] {
+    Track *track;
+    for (size_t i = 0; i < tracks.size() && free_slots.pop(&track); ++i) {
+      track->clear();
+      track->id = tracks[i]->id;
+      {
+        PATHEST_PROFILE_SCOPE("parse");
+        track->input =
+          pathest::Path(archive.track(*tracks[i]), &track->arena);
+        PATHEST_PROFILE_COUNT("points", track->input.size());
+      }
+      if (has_ref) track->has_ref = ref_archive.read(track->id, &track->ref);
+      if (!queue.push(track)) break;
+    }
+    queue.close();
+  });
+
+  // A track that can't be analyzed fails the run, but not the other tracks.
+  // Every track is estimated in the same arenas.
+  int status = 0;
+  AnalysisArenas arenas;
+  Track *track;
+  while (queue.pop(&track)) {
+    if (estimate_track(params, *track, has_ref, out_dir, writer, cache,
+                       &arenas) < 0) {
+      status = -1;
+    }
+    free_slots.push(track);  // Every write of the track has run.
+  }
+  reader.join();
+  return status;
+}
+
+int estimate_track(const analysis_params_t &params, const Track &track,
+                   const bool has_ref, const char *out_dir,
+                   AsyncWriter *writer, ResultCache *cache,
+                   AnalysisArenas *arenas) {
+  unsigned long long id = track.id;
+  char dir[PATH_MAX];
+  int len = snprintf(dir, sizeof(dir), "%s/%llu", out_dir, id);
+  if (len < 0 || static_cast<size_t>(len) >= sizeof(dir) ||
+      (mkdir(dir, 0777) < 0 && errno != EEXIST)) {
+    fprintf(stderr, "Unable to create directory: %s\n", dir);
+    return -1;
+  }
+  if (!check_data(track.input)) {
+    fprintf(stderr, "Failed to read input data for track %llu\n", id);
+    return -1;
+  }
+  bool track_ref = false;
+  if (has_ref) {
+    track_ref = track.has_ref && check_data(track.ref);
+    if (!track_ref) {
+      fprintf(stderr, "Warning: unable to read reference data for track"
+              " %llu\n", id);
+    }
+  }
+  estimate(params, track.input, track_ref ? &track.ref : NULL, dir, writer,
+           cache, arenas);
   return 0;
 }
 
-bool parse_data(const char *filename, pathest::Path *data) {
-  Json::Value root;
-  if (!get_json(filename, &root)) return false;
+int estimate_batch(const analysis_params_t &params, const char *input,
+                   const char *out_dir, unsigned threads,
+                   AsyncWriter *writer, ResultCache *cache) {
+  std::vector<BatchInput> inputs;
+  if (!list_batch(input, &inputs)) return -1;
 
-  // Get properties.
-  Json::Value target = root["target"];
-  Json::Value reports = root["reports"];
-  if (!target.isString()) {
-    fprintf(stderr, "\"target\" string not found in JSON input\n");
-    return false;
-  } else if (target.asString().compare("train")) {
-    fprintf(stderr, "Unexpected \"target\" value in JSON input\n");
-    return false;
-  } else if (!reports.isArray()) {
-    fprintf(stderr, "\"reports\" list not found in JSON input\n");
+  // Workers take inputs in order, each with its own arenas, and share the
+  // writer thread.
+  if (!threads) threads = pathest::default_threads();
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> failed(0);
+  std::chrono::steady_clock::time_point begin =
+    std::chrono::steady_clock::now();
+  pathest::parallel_for(threads, threads, [&](size_t, size_t, size_t) {
+    AnalysisArenas arenas;
+    for (size_t i = next++; i < inputs.size(); i = next++) {
+      const BatchInput &in = inputs[i];
+      std::string dir = std::string(out_dir) + "/" + in.name;
+      if (mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create directory: %s\n", dir.c_str());
+        ++failed;
+        continue;
+      }
+      pathest::Path report_data;
+      if (!parse_data(in.input.c_str(), &report_data)) {
+        fprintf(stderr, "Failed to read input data from %s\n",
+                in.input.c_str());
+        ++failed;
+        continue;
+      }
+      pathest::Path reference_data;
+      bool has_ref = false;
+      if (!in.ref.empty()) {
+        has_ref = parse_data(in.ref.c_str(), &reference_data);
+        if (!has_ref) {
+          fprintf(stderr, "Warning: unable to read reference data from %s\n",
+                  in.ref.c_str());
+        }
+      }
+      estimate(params, report_data, has_ref ? &reference_data : NULL,
+               dir.c_str(), writer, cache, &arenas, false);
+    }
+  });
+  writer->flush();
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - begin;
+#ifdef PATHEST_PROFILE
+  Results::write_profile(out_dir);
+#endif
+
+  fprintf(stdout, "Processed %zu input(s), %zu failed, in %.3f s\n",
+          inputs.size(), failed.load(), elapsed.count());
+  return failed ? -1 : 0;
+}
+
+bool list_batch(const char *input, std::vector<BatchInput> *inputs) {
+  struct stat st;
+  if (stat(input, &st) < 0) {
+    fprintf(stderr, "Can't find file: %s\n", input);
     return false;
   }
 
-  // Add data.
-  for (unsigned i = 0; i < reports.size(); ++i) {
-    if (reports[i].isObject()) {
-      Json::Value x = reports[i]["x"];
-      Json::Value y = reports[i]["y"];
-      Json::Value t = reports[i]["timestamp"];
-      if (x.isDouble() && y.isDouble() && t.isDouble()) {
-        data->insert(x.asDouble(), y.asDouble(), t.asDouble());
+  // Gather input files, from a directory or one per line of a list file.
+  std::vector<std::string> files;
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(input);
+    if (!dir) {
+      fprintf(stderr, "Unable to open directory: %s\n", input);
+      return false;
+    }
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+      std::string path = std::string(input) + "/" + entry->d_name;
+      struct stat entry_st;
+      if (stat(path.c_str(), &entry_st) == 0 && S_ISREG(entry_st.st_mode)) {
+        files.push_back(path);
       }
     }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+  } else {
+    std::vector<char> buf;
+    if (!read_file(input, &buf)) return false;
+    const char *p = &buf[0];
+    while (*p) {
+      size_t len = strcspn(p, "\r\n");
+      if (len && *p != '#') files.push_back(std::string(p, len));
+      p += len;
+      p += strspn(p, "\r\n");
+    }
+  }
+
+  // Keep inputs, pairing each with its reference. References in a directory
+  // are not inputs themselves.
+  const std::string txt = ".txt";
+  const std::string bin = ".bin";
+  const std::string ref_bin = ".ref.bin";
+  std::set<std::string> names;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string &file = files[i];
+    size_t slash = file.rfind('/');
+    std::string base = slash == std::string::npos ? file
+      : file.substr(slash + 1);
+    BatchInput in;
+    in.input = file;
+    if (base.size() > ref_bin.size() &&
+        !base.compare(base.size() - ref_bin.size(), ref_bin.size(), ref_bin)) {
+      continue;
+    } else if (base.size() > bin.size() &&
+               !base.compare(base.size() - bin.size(), bin.size(), bin)) {
+      in.name = base.substr(0, base.size() - bin.size());
+      in.ref = file.substr(0, file.size() - bin.size()) + ref_bin;
+    } else if (base.size() > txt.size() &&
+               !base.compare(base.size() - txt.size(), txt.size(), txt)) {
+      in.name = base.substr(0, base.size() - txt.size());
+      in.ref = file.substr(0, file.size() - txt.size()) + ".ref";
+    } else if (S_ISDIR(st.st_mode)) {
+      continue;
+    } else {
+      fprintf(stderr, "Expected a .txt or .bin input file: %s\n",
+              file.c_str());
+      return false;
+    }
+    struct stat ref_st;
+    if (stat(in.ref.c_str(), &ref_st) < 0) in.ref.clear();
+    if (!names.insert(in.name).second) {
+      fprintf(stderr, "Two inputs have the same output name: %s\n",
+              in.name.c_str());
+      return false;
+    }
+    inputs->push_back(in);
+  }
+  return true;
+}
+
+int pack_archive(const char *archive, const int num_inputs,
+                 char *const *inputs) {
+  TrackMap tracks;
+  for (int i = 0; i < num_inputs; ++i) {
+    if (!add_tracks(inputs[i], &tracks)) {
+      fprintf(stderr, "Failed to read input data from %s\n", inputs[i]);
+      return -1;
+    }
   }
 
-  // Verify data.
-  if (data->empty()) {
+  pathest::ArchiveWriter writer;
+  if (!writer.open(archive, tracks.size())) {
+    fprintf(stderr, "Unable to open file: %s\n", archive);
+    return -1;
+  }
+  bool ok = true;
+  for (TrackMap::const_iterator it = tracks.begin();
+       it != tracks.end() && ok; ++it) {
+    ok = writer.add(it->first, it->second);
+  }
+  if (!writer.close() || !ok) {
+    fprintf(stderr, "Unable to write file: %s\n", archive);
+    return -1;
+  }
+  fprintf(stdout, "Wrote %zu track(s) from %d file(s) to %s\n", tracks.size(),
+          num_inputs, archive);
+  return 0;
+}
+
+bool parse_data(const char *filename, pathest::Path *data) {
+  PATHEST_PROFILE_SCOPE("parse");
+  if (is_binary_file(filename)) {
+    if (!get_binary(filename, data)) return false;
+  } else if (!parse_json_data(filename, data)) {
+    return false;
+  }
+
+  PATHEST_PROFILE_COUNT("points", data->size());
+  return check_data(*data);
+}
+
+bool check_data(const pathest::Path &data) {
+  if (data.empty()) {
     fprintf(stderr, "Invalid data: empty data set\n");
     return false;
-  } else if (data->min_t() == data->max_t()) {
+  } else if (data.min_t() == data.max_t()) {
     fprintf(stderr, "Invalid data: identical timestamps\n");
     return false;
-  } else if (data->min_x() == data->max_x()) {
+  } else if (data.min_x() == data.max_x()) {
     fprintf(stderr, "Invalid data: identical x values\n");
     return false;
-  } else if (data->min_y() == data->max_y()) {
+  } else if (data.min_y() == data.max_y()) {
     fprintf(stderr, "Invalid data: identical y values\n");
     return false;
   } else {
     return true;
   }
 }
+
+bool parse_json_data(const char *filename, pathest::Path *data) {
+  std::vector<char> buf;
+  if (!read_file(filename, &buf)) return false;
+
+  // Plain report documents take the parallel parser. Anything else goes
+  // through JsonCpp, for the same checks and messages as before.
+  if (parse_reports(&buf[0], buf.size() - 1, data)) return true;
+  Json::Value root;
+  if (!parse_json(buf, &root)) return false;
+
+  const Json::Value *found = find_reports(root);
+  if (!found) return false;
+  const Json::Value &reports = *found;
+
+  // Add data.
+  PATHEST_PROFILE_SCOPE_ITEMS("insert", reports.size());
+  for (unsigned i = 0; i < reports.size(); ++i) {
+    if (reports[i].isObject()) {
+      Json::Value x = reports[i]["x"];
+      Json::Value y = reports[i]["y"];
+      Json::Value t = reports[i]["timestamp"];
+      if (x.isDouble() && y.isDouble() && t.isDouble()) {
+        data->insert(x.asDouble(), y.asDouble(), t.asDouble());
+      }
+    }
+  }
+  return true;
+}
@@ -4,15 +4,196 @@
 
 #include "test/parse.h"
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <algorithm>
+#include <charconv>
 #include <string>
+#include <system_error>
+#include <utility>
 #include <vector>
 
 #include "json/json.h"
+#include "pathest/location.h"
+#include "pathest/parallel.h"
+#include "pathest/path.h"
+#include "pathest/profile.h"
+#include "pathest/track_archive.h"
+#include "pathest/track_io.h"
+
+namespace {
+
+// Bytes per chunk below which parse_reports() does not split its work.
+const size_t kMinParseChunk = 1 << 20;
+
+// Nesting depth of report objects: inside the document and the array.
+const long kReportDepth = 2;
+
+// Structure of one chunk of a document.
+struct ChunkIndex {
+  ChunkIndex() :
+    quotes(0), depth(0), string_depth(0), in_string(false), start_depth(0),
+    reports(), top() {}
+
+  size_t quotes;  // Number of unescaped quotes.
+  long depth;  // Change in depth, if the chunk starts outside a string.
+  long string_depth;  // Change in depth, if the chunk starts inside one.
+  bool in_string;  // Whether the chunk starts inside a string.
+  long start_depth;  // Depth at the start of the chunk.
+  std::vector<size_t> reports;  // Objects opening at kReportDepth.
+  std::vector<size_t> top;  // Brackets at depth 1, i.e. of top-level values.
+};
+
+bool is_space(const char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_digit(const char c) {
+  return c >= '0' && c <= '9';
+}
+
+const char *skip_space(const char *p, const char *end) {
+  while (p < end && is_space(*p)) ++p;
+  return p;
+}
+
+// Whether a character is escaped by the backslashes before it.
+bool is_escaped(const char *buf, size_t i) {
+  size_t slashes = 0;
+  while (i && buf[--i] == '\\') ++slashes;
+  return slashes % 2;
+}
+
+// Read a string without escapes, returning the end or NULL.
+const char *parse_string(const char *p, const char *end, const char **begin) {
+  if (p == end || *p != '"') return NULL;
+  *begin = ++p;
+  while (p < end && *p != '"') {
+    if (*p == '\\' || static_cast<unsigned char>(*p) < 0x20) return NULL;
+    ++p;
+  }
+  return p < end ? p + 1 : NULL;
+}
+
+bool is_key(const char *begin, const char *end, const char *key) {
+  size_t len = strlen(key);
+  return static_cast<size_t>(end - 1 - begin) == len &&
+    !memcmp(begin, key, len);
+}
+
+// Read a number in strict JSON syntax, returning the end or NULL.
+const char *parse_number(const char *p, const char *end, double *value) {
+  const char *begin = p;
+  bool integer = true;
+  if (p < end && *p == '-') ++p;
+  if (p == end || !is_digit(*p)) return NULL;
+  if (*p == '0') {
+    ++p;
+  } else {
+    while (p < end && is_digit(*p)) ++p;
+  }
+  if (p < end && *p == '.') {
+    integer = false;
+    if (++p == end || !is_digit(*p)) return NULL;
+    while (p < end && is_digit(*p)) ++p;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    integer = false;
+    if (++p < end && (*p == '+' || *p == '-')) ++p;
+    if (p == end || !is_digit(*p)) return NULL;
+    while (p < end && is_digit(*p)) ++p;
+  }
+  std::from_chars_result res = std::from_chars(begin, p, *value);
+  if (res.ec != std::errc() || res.ptr != p) return NULL;
+  // JsonCpp reads -0 as the integer 0.
+  if (integer && *value == 0) *value = 0;
+  return p;
+}
+
+// Read one report object. Reports missing a value are skipped, as by the
+// JsonCpp path, and repeated keys take the last value.
+const char *parse_report(const char *p, const char *end,
+                         std::vector<pathest::Location> *out) {
+  double x = 0;
+  double y = 0;
+  double t = 0;
+  bool has_x = false;
+  bool has_y = false;
+  bool has_t = false;
+  p = skip_space(p + 1, end);
+  if (p < end && *p == '}') return p + 1;
+  while (p) {
+    const char *key;
+    p = parse_string(p, end, &key);
+    if (!p) return NULL;
+    const char *key_end = p;
+    p = skip_space(p, end);
+    if (p == end || *p != ':') return NULL;
+    p = skip_space(p + 1, end);
+    if (is_key(key, key_end, "x")) {
+      p = parse_number(p, end, &x);
+      has_x = true;
+    } else if (is_key(key, key_end, "y")) {
+      p = parse_number(p, end, &y);
+      has_y = true;
+    } else if (is_key(key, key_end, "timestamp")) {
+      p = parse_number(p, end, &t);
+      has_t = true;
+    } else {
+      return NULL;
+    }
+    if (!p) return NULL;
+    p = skip_space(p, end);
+    if (p == end) return NULL;
+    if (*p == '}') break;
+    if (*p != ',') return NULL;
+    p = skip_space(p + 1, end);
+  }
+  if (has_x && has_y && has_t) out->push_back(pathest::Location(x, y, t));
+  return p + 1;
+}
+
+// Get the track id that ends the name of a file before its extension.
+bool file_track_id(const char *filename, uint64_t *id) {
+  const char *base = strrchr(filename, '/');
+  base = base ? base + 1 : filename;
+  const char *end = strchr(base, '.');
+  if (!end) end = base + strlen(base);
+  const char *begin = end;
+  while (begin > base && is_digit(begin[-1])) --begin;
+  // Up to 19 digits always fit.
+  if (begin == end || end - begin > 19) return false;
+  *id = strtoull(begin, NULL, 10);
+  return true;
+}
+
+// Add the locations of a path to the track with an id.
+void add_track(const uint64_t id, pathest::Path &&path, TrackMap *tracks) {
+  pathest::Path &track = (*tracks)[id];
+  if (track.empty()) {
+    track = std::move(path);
+  } else {
+    for (pathest::Path::const_iterator it = path.begin(); it != path.end();
+         ++it) {
+      track.insert(*it);
+    }
+  }
+}
+
+}  // namespace
 
 bool get_json(const char *filename, Json::Value *json) {
   if (!filename || !json) return false;
+  std::vector<char> buf;
+  return read_file(filename, &buf) && parse_json(buf, json);
+}
+
+bool read_file(const char *filename, std::vector<char> *buf) {
+  if (!filename || !buf) return false;
 
   struct stat st;
   if (stat(filename, &st) < 0) {
@@ -29,16 +210,325 @@ bool get_json(const char *filename, Json::Value *json) {
     return false;
   }
 
-  std::vector<char> buf(st.st_size + 1);
+  buf->resize(st.st_size + 1);
   size_t len = (size_t) st.st_size;
-  if (fread(&buf[0], sizeof(char), len, fp) != len) {
+  if (fread(&(*buf)[0], sizeof(char), len, fp) != len) {
     fprintf(stderr, "Can't read file: %s\n", filename);
     fclose(fp);
     return false;
   }
   fclose(fp);
-  buf[st.st_size] = '\0';
+  (*buf)[st.st_size] = '\0';
+  return true;
+}
 
+bool parse_json(const std::vector<char> &buf, Json::Value *json) {
+  if (!json) return false;
   Json::Reader reader;
   return reader.parse(std::string(buf.begin(), buf.end()), *json);
 }
+
+const Json::Value *find_reports(const Json::Value &root) {
+  const Json::Value &target = root["target"];
+  const Json::Value &reports = root["reports"];
+  if (!target.isString()) {
+    fprintf(stderr, "\"target\" string not found in JSON input\n");
+    return NULL;
+  } else if (target.asString().compare("train")) {
+    fprintf(stderr, "Unexpected \"target\" value in JSON input\n");
+    return NULL;
+  } else if (!reports.isArray()) {
+    fprintf(stderr, "\"reports\" list not found in JSON input\n");
+    return NULL;
+  }
+  return &reports;
+}
+
+bool parse_reports(const char *buf, const size_t len, pathest::Path *data,
+                   unsigned threads) {
+  if (!buf || !data) return false;
+  PATHEST_PROFILE_SCOPE_ITEMS("index", len);
+  if (!threads) threads = pathest::default_threads();
+  if (threads > len / kMinParseChunk) threads = len / kMinParseChunk;
+  if (!threads) threads = 1;
+  std::vector<ChunkIndex> index(threads);
+
+  // Count quotes and depth changes for both possible starting string states,
+  // since a quote toggles the state and depth only counts outside strings.
+  size_t chunks = pathest::parallel_for(len, threads,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    ChunkIndex &ci = index[chunk];
+    bool escaped = is_escaped(buf, begin);
+    bool in_string = false;
+    for (size_t i = begin; i < end; ++i) {
+      char c = buf[i];
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        ++ci.quotes;
+        in_string = !in_string;
+      } else if (c == '{' || c == '[' || c == '}' || c == ']') {
+        long delta = c == '{' || c == '[' ? 1 : -1;
+        if (in_string) {
+          ci.string_depth += delta;
+        } else {
+          ci.depth += delta;
+        }
+      }
+    }
+  });
+  bool in_string = false;
+  long depth = 0;
+  for (size_t c = 0; c < chunks; ++c) {
+    index[c].in_string = in_string;
+    index[c].start_depth = depth;
+    depth += in_string ? index[c].string_depth : index[c].depth;
+    if (index[c].quotes % 2) in_string = !in_string;
+  }
+
+  // List the positions of report objects and of top-level brackets.
+  pathest::parallel_for(len, threads,
+      [&](const size_t chunk, const size_t begin, const size_t end) {
+    ChunkIndex &ci = index[chunk];
+    bool escaped = is_escaped(buf, begin);
+    bool in_string = ci.in_string;
+    long depth = ci.start_depth;
+    for (size_t i = begin; i < end; ++i) {
+      char c = buf[i];
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        in_string = !in_string;
+      } else if (in_string) {
+        continue;
+      } else if (c == '{' || c == '[') {
+        if (depth == 1) ci.top.push_back(i);
+        if (depth == kReportDepth && c == '{') ci.reports.push_back(i);
+        ++depth;
+      } else if (c == '}' || c == ']') {
+        if (--depth == 1) ci.top.push_back(i);
+      }
+    }
+  });
+  std::vector<size_t> top;
+  std::vector<size_t> reports;
+  for (size_t c = 0; c < chunks; ++c) {
+    top.insert(top.end(), index[c].top.begin(), index[c].top.end());
+    reports.insert(reports.end(), index[c].reports.begin(),
+                   index[c].reports.end());
+  }
+
+  // Walk the top-level object, skipping the reports array by its brackets.
+  const char *end = buf + len;
+  const char *p = skip_space(buf, end);
+  const char *target = NULL;
+  const char *target_end = NULL;
+  size_t reports_begin = 0;
+  size_t reports_end = 0;
+  if (p == end || *p != '{') return false;
+  p = skip_space(p + 1, end);
+  while (true) {
+    const char *key;
+    p = parse_string(p, end, &key);
+    if (!p) return false;
+    const char *key_end = p;
+    p = skip_space(p, end);
+    if (p == end || *p != ':') return false;
+    p = skip_space(p + 1, end);
+    if (is_key(key, key_end, "target")) {
+      p = parse_string(p, end, &target);
+      if (!p) return false;
+      target_end = p;
+    } else if (is_key(key, key_end, "reports") && !reports_end) {
+      if (p == end || *p != '[') return false;
+      std::vector<size_t>::iterator it =
+        std::lower_bound(top.begin(), top.end(), p - buf);
+      if (it == top.end() || *it != static_cast<size_t>(p - buf) ||
+          ++it == top.end() || buf[*it] != ']') {
+        return false;
+      }
+      reports_begin = p - buf + 1;
+      reports_end = *it;
+      p = buf + reports_end + 1;
+    } else {
+      return false;
+    }
+    p = skip_space(p, end);
+    if (p == end) return false;
+    if (*p == '}') break;
+    if (*p != ',') return false;
+    p = skip_space(p + 1, end);
+  }
+  if (skip_space(p + 1, end) != end) return false;
+  if (!target || !is_key(target, target_end, "train") || !reports_end) {
+    return false;
+  }
+  std::vector<size_t>::iterator first =
+    std::lower_bound(reports.begin(), reports.end(), reports_begin);
+  std::vector<size_t>::iterator last =
+    std::lower_bound(first, reports.end(), reports_end);
+  size_t num_reports = last - first;
+  const size_t *starts = num_reports ? &*first : NULL;
+  if (!num_reports) {
+    return skip_space(buf + reports_begin, end) == buf + reports_end;
+  } else if (skip_space(buf + reports_begin, end) != buf + starts[0]) {
+    return false;
+  }
+
+  // Decode reports into one buffer per thread, checking that only a comma
+  // separates each from the next, and sort each buffer.
+  PATHEST_PROFILE_SCOPE_ITEMS("decode", num_reports);
+  std::vector<std::vector<pathest::Location> > decoded(threads);
+  std::vector<char> ok(threads, false);
+  chunks = pathest::parallel_for(num_reports, threads,
+      [&](const size_t chunk, const size_t begin, const size_t end_report) {
+    std::vector<pathest::Location> &out = decoded[chunk];
+    out.reserve(end_report - begin);
+    for (size_t i = begin; i < end_report; ++i) {
+      const char *q = parse_report(buf + starts[i], end, &out);
+      if (!q) return;
+      q = skip_space(q, end);
+      if (i + 1 < num_reports) {
+        if (q == end || *q != ',' ||
+            skip_space(q + 1, end) != buf + starts[i + 1]) {
+          return;
+        }
+      } else if (q != buf + reports_end) {
+        return;
+      }
+    }
+    if (!std::is_sorted(out.begin(), out.end(), pathest::Location::comp_t)) {
+      std::stable_sort(out.begin(), out.end(), pathest::Location::comp_t);
+    }
+    ok[chunk] = true;
+  });
+  for (size_t c = 0; c < chunks; ++c) {
+    if (!ok[c]) return false;
+  }
+
+  // Merge the sorted buffers in rounds of adjacent pairs, earlier first.
+  pathest::Path::storage_type merged(data->resource());
+  std::vector<size_t> offsets(chunks + 1, 0);
+  for (size_t c = 0; c < chunks; ++c) {
+    offsets[c + 1] = offsets[c] + decoded[c].size();
+  }
+  merged.resize(offsets[chunks], pathest::Location(0, 0, 0));
+  pathest::parallel_for(chunks, threads,
+      [&](const size_t, const size_t begin, const size_t end_chunk) {
+    for (size_t c = begin; c < end_chunk; ++c) {
+      std::copy(decoded[c].begin(), decoded[c].end(),
+                merged.begin() + offsets[c]);
+      std::vector<pathest::Location>().swap(decoded[c]);
+    }
+  });
+  for (size_t width = 1; width < chunks; width *= 2) {
+    size_t pairs = (chunks + 2 * width - 1) / (2 * width);
+    pathest::parallel_for(pairs, threads,
+        [&](const size_t, const size_t begin, const size_t end_pair) {
+      for (size_t i = begin; i < end_pair; ++i) {
+        size_t lo = offsets[2 * width * i];
+        size_t mid = offsets[std::min(2 * width * i + width, chunks)];
+        size_t hi = offsets[std::min(2 * width * (i + 1), chunks)];
+        if (mid == lo || mid == hi ||
+            !pathest::Location::comp_t(merged[mid], merged[mid - 1])) {
+          continue;
+        }
+        std::inplace_merge(merged.begin() + lo, merged.begin() + mid,
+                           merged.begin() + hi, pathest::Location::comp_t);
+      }
+    });
+  }
+
+  if (data->empty()) {
+    *data = pathest::Path(std::move(merged));
+  } else {
+    for (size_t i = 0; i < merged.size(); ++i) data->insert(merged[i]);
+  }
+  return true;
+}
+
+bool is_binary_file(const char *filename) {
+  if (!filename) return false;
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) return false;
+  char header[pathest::kTrackHeaderSize];
+  size_t len = fread(header, sizeof(char), sizeof(header), fp);
+  fclose(fp);
+  return pathest::is_binary_track(header, len);
+}
+
+bool is_archive_file(const char *filename) {
+  if (!filename) return false;
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) return false;
+  char header[pathest::kArchiveHeaderSize];
+  size_t len = fread(header, sizeof(char), sizeof(header), fp);
+  fclose(fp);
+  return pathest::is_track_archive(header, len);
+}
+
+bool get_binary(const char *filename, pathest::Path *data) {
+  if (!filename || !data) return false;
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open file: %s\n", filename);
+    return false;
+  }
+  bool ok = pathest::read_binary(fp, data);
+  fclose(fp);
+  if (!ok) fprintf(stderr, "Can't read binary track file: %s\n", filename);
+  return ok;
+}
+
+bool add_tracks(const char *filename, TrackMap *tracks) {
+  if (!filename || !tracks) return false;
+  pathest::Path path;
+  if (is_binary_file(filename)) {
+    if (!get_binary(filename, &path)) return false;
+  } else {
+    std::vector<char> buf;
+    if (!read_file(filename, &buf)) return false;
+    if (!parse_reports(&buf[0], buf.size() - 1, &path)) {
+      // Reports with ids, or any other form, go through JsonCpp.
+      Json::Value root;
+      if (!parse_json(buf, &root)) {
+        fprintf(stderr, "Can't parse JSON input: %s\n", filename);
+        return false;
+      }
+      const Json::Value *reports = find_reports(root);
+      if (!reports) return false;
+      bool has_ids = false;
+      for (unsigned i = 0; i < reports->size() && !has_ids; ++i) {
+        has_ids = (*reports)[i].isObject() && (*reports)[i].isMember("id");
+      }
+      PATHEST_PROFILE_SCOPE_ITEMS("insert", reports->size());
+      for (unsigned i = 0; i < reports->size(); ++i) {
+        const Json::Value &report = (*reports)[i];
+        if (!report.isObject()) continue;
+        const Json::Value &x = report["x"];
+        const Json::Value &y = report["y"];
+        const Json::Value &t = report["timestamp"];
+        if (!x.isDouble() || !y.isDouble() || !t.isDouble()) continue;
+        if (!has_ids) {
+          path.insert(x.asDouble(), y.asDouble(), t.asDouble());
+        } else if (report["id"].isUInt64()) {
+          (*tracks)[report["id"].asUInt64()].insert(x.asDouble(), y.asDouble(),
+                                                    t.asDouble());
+        }
+      }
+      if (has_ids) return true;
+    }
+  }
+
+  uint64_t id;
+  if (!file_track_id(filename, &id)) {
+    fprintf(stderr, "No track id in file name: %s\n", filename);
+    return false;
+  }
+  add_track(id, std::move(path), tracks);
+  return true;
+}
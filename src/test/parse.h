@@ -1,11 +1,22 @@
 /// @file test/parse.h
 /// @brief Helper functions for parsing JSON from a text file.
+///
+/// Binary track files and track archives written by the generate program are
+/// also accepted, and input files holding many tracks can be gathered by id
+/// to be written to a track archive.
+///
 //===----------------------------------------------------------------------===//
 
 #ifndef TEST_PARSE_H_
 #define TEST_PARSE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+
 #include "json/json.h"
+#include "pathest/path.h"
 
 /// @brief Get a Json object initialized from the contents of a given file.
 ///
@@ -14,4 +25,91 @@
 /// @returns true if successful, false otherwise.
 bool get_json(const char *filename, Json::Value *json);
 
+/// @brief Read the contents of a given file.
+///
+/// The contents are followed by a terminating null character.
+///
+/// @param filename Path to a regular file.
+/// @param buf Buffer to fill.
+/// @returns true if successful, false otherwise.
+bool read_file(const char *filename, std::vector<char> *buf);
+
+/// @brief Get a Json object initialized from a buffer filled by read_file().
+///
+/// @param buf Buffer with a terminating null character.
+/// @param json New Json object.
+/// @returns true if successful, false otherwise.
+bool parse_json(const std::vector<char> &buf, Json::Value *json);
+
+/// Tracks by id, as gathered by add_tracks().
+typedef std::map<uint64_t, pathest::Path> TrackMap;
+
+/// @brief Find the reports of a JSON report document.
+///
+/// Checks for a "train" target and a "reports" list, and prints what is wrong
+/// otherwise.
+///
+/// @param root The document.
+/// @returns the list of reports if found, NULL otherwise.
+const Json::Value *find_reports(const Json::Value &root);
+
+/// @brief Add the reports in a JSON report document to a path, in parallel.
+///
+/// Parses in two phases. The first indexes the structure of the document: each
+/// thread counts the unescaped quotes and nesting depth in its chunk, which
+/// gives every chunk its starting string state and depth, and then lists the
+/// objects that open at the depth of report objects. The second decodes the
+/// reports between those positions, each thread into its own buffer, and the
+/// buffers are sorted and merged stably, so that equal timestamps keep their
+/// order in the file as with Path::insert().
+///
+/// Only the common form is recognized: an object with "target" and "reports"
+/// keys only, a "train" target, and report objects with "x", "y" and
+/// "timestamp" keys only, each a number or missing. Anything else, including
+/// any malformed document, is left for a full JSON parser, so that it is
+/// accepted or rejected with the same checks and messages. The path is not
+/// modified unless the document is recognized.
+///
+/// @param buf The document.
+/// @param len The length of the document, in bytes.
+/// @param data Path object to add to.
+/// @param threads The number of threads, or 0 for the default.
+/// @returns true if the document was recognized and added, false otherwise.
+bool parse_reports(const char *buf, const size_t len, pathest::Path *data,
+                   unsigned threads = 0);
+
+/// @brief Check whether a file is in the binary track format.
+///
+/// @param filename Path to a file.
+/// @returns true if the file starts with a binary track header.
+bool is_binary_file(const char *filename);
+
+/// @brief Check whether a file is a track archive.
+///
+/// @param filename Path to a file.
+/// @returns true if the file starts with a track archive header.
+bool is_archive_file(const char *filename);
+
+/// @brief Add the locations from a binary track file to a path.
+///
+/// @param filename Path to binary track file.
+/// @param data Path object to add to.
+/// @returns true if successful, false otherwise.
+bool get_binary(const char *filename, pathest::Path *data);
+
+/// @brief Add the tracks in an input file to a map of tracks by id.
+///
+/// A JSON report document whose reports carry an "id" key, such as a file of
+/// one day's reports from every train, adds one track per id, and reports
+/// without an id are skipped. Any other input file, JSON or binary, is a
+/// single track whose id is the number that ends the file name before its
+/// extension, as in input-17.txt or input-17.ref.bin from the generate
+/// program. Locations of a track found in several files are merged in time
+/// order.
+///
+/// @param filename Path to an input file.
+/// @param tracks The tracks to add to.
+/// @returns true if successful, false otherwise.
+bool add_tracks(const char *filename, TrackMap *tracks);
+
 #endif  // TEST_PARSE_H_
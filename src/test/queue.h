@@ -0,0 +1,84 @@
+/// @file test/queue.h
+/// @brief Bounded queue for passing work between threads.
+///
+/// A producer blocks while the queue is full, so a fast stage can only get a
+/// fixed number of items ahead of a slow one and memory stays bounded. Items
+/// are kept in a ring allocated when the queue is created, so passing them
+/// does not allocate. Closing the queue lets consumers drain what is left and
+/// then stop.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TEST_QUEUE_H_
+#define TEST_QUEUE_H_
+
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(const size_t capacity) :
+    lock_(), not_empty_(), not_full_(), items_(capacity ? capacity : 1),
+    head_(0), size_(0), closed_(false) {}
+  ~BoundedQueue() {}
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  /// @brief Add an item, waiting while the queue is full.
+  ///
+  /// @returns true if added, false if the queue is closed.
+  bool push(T item) {
+    std::unique_lock<std::mutex> guard(this->lock_);
+    this->not_full_.wait(guard, [this] {
+      return this->closed_ || this->size_ < this->items_.size();
+    });
+    if (this->closed_) return false;
+    this->items_[(this->head_ + this->size_) % this->items_.size()] =
+      std::move(item);
+    ++this->size_;
+    this->not_empty_.notify_one();
+    return true;
+  }
+
+  /// @brief Remove the oldest item, waiting while the queue is empty.
+  ///
+  /// @returns true if an item was removed, false if the queue is closed and
+  ///   empty.
+  bool pop(T *item) {
+    std::unique_lock<std::mutex> guard(this->lock_);
+    this->not_empty_.wait(guard, [this] {
+      return this->closed_ || this->size_;
+    });
+    if (!this->size_) return false;
+    *item = std::move(this->items_[this->head_]);
+    this->items_[this->head_] = T();  // Release what the item held.
+    this->head_ = (this->head_ + 1) % this->items_.size();
+    --this->size_;
+    this->not_full_.notify_one();
+    return true;
+  }
+
+  /// Stop accepting items and wake every waiting thread.
+  void close() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->closed_ = true;
+    this->not_empty_.notify_all();
+    this->not_full_.notify_all();
+  }
+
+ private:
+  std::mutex lock_;  //< Guards the members below.
+  std::condition_variable not_empty_;  //< Signaled when an item is added.
+  std::condition_variable not_full_;  //< Signaled when an item is removed.
+  std::vector<T> items_;  //< Ring of items, as many as the capacity.
+  size_t head_;  //< Position of the oldest item.
+  size_t size_;  //< Number of items.
+  bool closed_;  //< Whether the queue accepts no more items.
+};
+
+#endif  // TEST_QUEUE_H_
@@ -6,17 +6,19 @@
 #include "test/results.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
-#include <string.h>
-#include <string>
-#include <vector>
+#include <utility>
 
-#include "json/json.h"
 #include "plplot/plplot.h"
 #include "plplot/plstream.h"
 #include "pathest/location.h"
 #include "pathest/path.h"
+#include "pathest/path_view.h"
+#include "pathest/profile.h"
+#include "pathest/track_io.h"
+#include "test/writer.h"
 
 // PLplot constants.
 #define WHITE 15           // Plot environment color white.
@@ -34,40 +36,154 @@ const double hue[2] = {240.0, 0.0};
 const double light[2] = {0.6, 0.6};
 const double sat[2] = {0.8, 0.8};
 
+// Target written to estimate files, as before they were streamed.
+const char *json_target = "trains";
+
 // Note: no effect if '/' is appended to a directory ending in '/' (POSIX).
 const char *report_name = "report";
+const char *profile_name = "profile";
+const char *json_path_fmt = "%s/%s.json";
 const char *txt_path_fmt = "%s/%s.txt";
 const char *svg_path_fmt = "%s/%s.svg";
-const size_t txt_path_len = strlen(txt_path_fmt) + 1 - 4;
-const size_t svg_path_len = strlen(svg_path_fmt) + 1 - 4;
 
-Results::Results(const char *dir, const pathest::Path &input) :
-  out_dir_(std::string(dir, strlen(dir))),
-  ref_data_(pathest::Path()),
+namespace {
+
+// Format the path of an output file, false if it is too long.
+bool output_path(char (&path)[PATH_MAX], const char *fmt, const char *dir,
+                 const char *name) {
+  int len = snprintf(path, sizeof(path), fmt, dir, name);
+  if (len < 0 || static_cast<size_t>(len) >= sizeof(path)) {
+    fprintf(stderr, "Warning: path too long in directory: %s\n", dir);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+Results::Results(const char *dir, const pathest::Path &input,
+                 AsyncWriter *writer) :
+  out_dir_(),
+  ref_data_(NULL),
+  writer_(writer),
+  last_write_(0),
+  slots_(),
+  next_slot_(0),
   x_min_(input.min_x()), x_max_(input.max_x()),
   y_min_(input.min_y()), y_max_(input.max_y()) {
+  snprintf(this->out_dir_, sizeof(this->out_dir_), "%s", dir);
   this->init_report();
 }
 
+Results::~Results() {
+  // Pending writes refer to this object.
+  if (this->writer_) this->writer_->wait(this->last_write_);
+}
+
 void Results::add_reference(const pathest::Path &ref) {
 #ifdef DEBUG
   // Invariant: do not set reference to more than one data set.
-  assert(this->ref_data_.empty());
+  assert(!this->ref_data_);
 #endif
   if (ref.empty()) fprintf(stderr, "Warning: using empty reference data\n");
-  for (pathest::Path::const_iterator it = ref.begin(); it != ref.end(); ++it) {
-    this->ref_data_.insert(it->x(), it->y(), it->t());
-  }
-  this->write("reference", "Reference data", this->ref_data_);
+  this->ref_data_ = &ref;  // Already sorted, so use it as it is.
+  this->write("reference", "Reference data", ref);
 }
 
 void Results::write(const char *name, const char *title,
                     const pathest::Path &output) const {
+  this->write_async(name, title, &output, pathest::Path(), NULL);
+}
+
+void Results::write(const char *name, const char *title,
+                    const pathest::Path &output, const Metrics &metrics)
+  const {
+  this->write_async(name, title, &output, pathest::Path(), &metrics);
+}
+
+void Results::write(const char *name, const char *title,
+                    pathest::Path &&output) const {
+  this->write_async(name, title, NULL, std::move(output), NULL);
+}
+
+void Results::write(const char *name, const char *title,
+                    pathest::Path &&output, const Metrics &metrics) const {
+  this->write_async(name, title, NULL, std::move(output), &metrics);
+}
+
+uint64_t Results::last_write() const { return this->last_write_; }
+
+void Results::wait(const uint64_t ticket) const {
+  if (this->writer_ && ticket) this->writer_->wait(ticket);
+}
+
+void Results::write_async(const char *name, const char *title,
+                          const pathest::Path *borrowed, pathest::Path &&owned,
+                          const Metrics *metrics) const {
+  const pathest::Path &output = borrowed ? *borrowed : owned;
+  if (!this->writer_) {
+    this->write_now(name, title, output, metrics);
+    return;
+  }
+  // The writer thread only reads the path, so that the caller may too.
+  output.build_index();
+
+  // Take the next slot once the write that last used it has run. The path
+  // handed over keeps its memory resource, so moving it does not allocate.
+  PendingWrite &slot = this->slots_[this->next_slot_];
+  this->next_slot_ = (this->next_slot_ + 1) % kWriteSlots;
+  this->wait(slot.ticket);
+  slot.results = this;
+  snprintf(slot.name, sizeof(slot.name), "%s", name);
+  snprintf(slot.title, sizeof(slot.title), "%s", title);
+  slot.borrowed = borrowed;
+  if (!borrowed) slot.owned.emplace(std::move(owned));
+  slot.has_metrics = metrics != NULL;
+  if (metrics) slot.metrics = *metrics;
+  slot.ticket = this->writer_->submit(run_write, &slot);
+  this->last_write_ = slot.ticket;
+}
+
+void Results::run_write(void *arg) {
+  PendingWrite *slot = static_cast<PendingWrite *>(arg);
+  slot->results->write_now(slot->name, slot->title,
+                           slot->borrowed ? *slot->borrowed : *slot->owned,
+                           slot->has_metrics ? &slot->metrics : NULL);
+  slot->owned.reset();  // Done with the path before the caller reuses it.
+}
+
+void Results::write_now(const char *name, const char *title,
+                        const pathest::Path &output, const Metrics *metrics)
+  const {
   this->write_json(name, output);
-  this->write_error(title, output);
+  this->write_error(title, metrics ? *metrics : this->metrics(output));
   this->write_plot(name, title, output);
 }
 
+const pathest::Path &Results::reference() const {
+  static const pathest::Path no_reference;
+  return this->ref_data_ ? *this->ref_data_ : no_reference;
+}
+
+Results::Metrics Results::metrics(const pathest::Path &output) const {
+#ifdef DEBUG
+  // Invariant: output has the same number of data points as reference.
+  if (!this->reference().empty()) {
+    assert(this->reference().size() == output.size());
+  }
+#endif
+  PATHEST_PROFILE_SCOPE_ITEMS("metrics", output.size());
+  Metrics metrics = Metrics();
+  metrics.has_ref = !this->reference().empty();
+  if (metrics.has_ref) {
+    metrics.mae = this->mean_absolute_error(output);
+    metrics.rmse = this->root_mean_square_error(output);
+    metrics.mase = this->mean_absolute_scaled_error(output);
+  }
+  metrics.avg_speed = output.avg_speed();
+  return metrics;
+}
+
 void Results::write_plot(const char *name, const char *title,
                          const pathest::Path &output) const {
 #ifdef DEBUG
@@ -75,13 +191,12 @@ void Results::write_plot(const char *name, const char *title,
   assert(name != NULL);
   assert(title != NULL);
 #endif
+  PATHEST_PROFILE_SCOPE_ITEMS("plot", output.size());
 
-  size_t plot_path_len = svg_path_len + this->out_dir_.length() + strlen(name);
-  std::vector<char> plot_path(plot_path_len);
-  snprintf(&plot_path[0], plot_path_len, svg_path_fmt, this->out_dir_.c_str(),
-           name);
+  char plot_path[PATH_MAX];
+  if (!output_path(plot_path, svg_path_fmt, this->out_dir_, name)) return;
   plsdev("svg");
-  plsfnam(&plot_path[0]);
+  plsfnam(plot_path);
   plinit();
   plcol0(WHITE);
   plenv(this->x_min_, this->x_max_, this->y_min_, this->y_max_, JUST, AXIS);
@@ -105,7 +220,7 @@ void Results::write_plot(const char *name, const char *title,
     }
   }
   plend();
-  fprintf(stdout, "Wrote plot to %s\n", &plot_path[0]);
+  fprintf(stdout, "Wrote plot to %s\n", plot_path);
 }
 
 void Results::write_json(const char *name, const pathest::Path &output)
@@ -114,96 +229,107 @@ void Results::write_json(const char *name, const pathest::Path &output)
   // Invariant: no invalid parameters.
   assert(name != NULL);
 #endif
-  size_t json_path_len = txt_path_len + this->out_dir_.length() + strlen(name);
-  std::vector<char> json_path(json_path_len);
-  snprintf(&json_path[0], json_path_len, txt_path_fmt, this->out_dir_.c_str(),
-           name);
-
-  Json::Value reports = Json::Value(Json::arrayValue);
-  for (pathest::Path::const_iterator it = output.begin(); it != output.end();
-       ++it) {
-    Json::Value location;
-    location["x"] = it->x();
-    location["y"] = it->y();
-    location["timestamp"] = it->t();
-    reports.append(location);
-  }
+  PATHEST_PROFILE_SCOPE_ITEMS("write_json", output.size());
+  char json_path[PATH_MAX];
+  if (!output_path(json_path, txt_path_fmt, this->out_dir_, name)) return;
 
-  Json::Value root;
-  root["target"] = "trains";
-  root["reports"] = reports;
-
-  FILE *fp = fopen(&json_path[0], "w");
+  // Stream the locations out directly rather than building a document.
+  FILE *fp = fopen(json_path, "w");
   if (fp) {
-    Json::StyledWriter writer;
-    fprintf(fp, writer.write(root).c_str());
+    pathest::write_json(fp, output, json_target);
     fclose(fp);
-    fprintf(stdout, "Wrote data to %s\n", &json_path[0]);
+    fprintf(stdout, "Wrote data to %s\n", json_path);
   } else {
-    fprintf(stderr, "Warning: unable to open file: %s\n", &json_path[0]);
+    fprintf(stderr, "Warning: unable to open file: %s\n", json_path);
   }
 }
 
-void Results::write_error(const char *title, const pathest::Path &output)
-  const {
+void Results::write_error(const char *title, const Metrics &metrics) const {
 #ifdef DEBUG
   // Invariant: no invalid parameters.
   assert(title != NULL);
-  // Invariant: output has the same number of data points as reference.
-  if (!this->ref_data_.empty()) {
-    assert(this->ref_data_.size() == output.size());
-  }
 #endif
-  size_t report_path_len = txt_path_len + this->out_dir_.length()
-    + strlen(report_name);
-  std::vector<char> report_path(report_path_len);
-  snprintf(&report_path[0], report_path_len, txt_path_fmt,
-           this->out_dir_.c_str(), report_name);
-  FILE *fp = fopen(&report_path[0], "a");
+  char report_path[PATH_MAX];
+  if (!output_path(report_path, txt_path_fmt, this->out_dir_, report_name)) {
+    return;
+  }
+  FILE *fp = fopen(report_path, "a");
   if (fp) {
     fprintf(fp, "\n%s\n", title);
-    if (!this->ref_data_.empty()) {
-      fprintf(fp, "MAE: %f\n", this->mean_absolute_error(output));
-      fprintf(fp, "RMSE: %f\n", this->root_mean_square_error(output));
-      fprintf(fp, "MASE: %f\n", this->mean_absolute_scaled_error(output));
+    if (metrics.has_ref) {
+      fprintf(fp, "MAE: %f\n", metrics.mae);
+      fprintf(fp, "RMSE: %f\n", metrics.rmse);
+      fprintf(fp, "MASE: %f\n", metrics.mase);
     }
-    fprintf(fp, "Estimated speed: %f KPH\n", 60 * output.avg_speed());
+    fprintf(fp, "Estimated speed: %f KPH\n", 60 * metrics.avg_speed);
     fclose(fp);
   } else {
-    fprintf(stderr, "Warning: unable to open file: %s\n", &report_path[0]);
+    fprintf(stderr, "Warning: unable to open file: %s\n", report_path);
   }
 }
 
 void Results::init_report() const {
-  size_t report_path_len = txt_path_len + this->out_dir_.length()
-    + strlen(report_name);
-  std::vector<char> report_path(report_path_len);
-  snprintf(&report_path[0], report_path_len, txt_path_fmt,
-           this->out_dir_.c_str(), report_name);
-  FILE *fp = fopen(&report_path[0], "w");
+  char report_path[PATH_MAX];
+  if (!output_path(report_path, txt_path_fmt, this->out_dir_, report_name)) {
+    return;
+  }
+  FILE *fp = fopen(report_path, "w");
   if (fp) {
     fprintf(fp, "Results\n-------\n");
     fclose(fp);
   } else {
-    fprintf(stderr, "Warning: unable to open file: %s\n", &report_path[0]);
+    fprintf(stderr, "Warning: unable to open file: %s\n", report_path);
   }
 }
 
-double Results::mean_absolute_error(const pathest::Path &output) const {
+#ifdef PATHEST_PROFILE
+void Results::write_profile() const {
+  // Include the pending writes.
+  if (this->writer_) this->writer_->wait(this->last_write_);
+  write_profile(this->out_dir_);
+}
+
+void Results::write_profile(const char *dir) {
+  char txt_path[PATH_MAX];
+  if (!output_path(txt_path, txt_path_fmt, dir, profile_name)) return;
+  FILE *fp = fopen(txt_path, "w");
+  if (fp) {
+    pathest::profile::write_text(fp);
+    fclose(fp);
+    fprintf(stdout, "Wrote profile to %s\n", txt_path);
+  } else {
+    fprintf(stderr, "Warning: unable to open file: %s\n", txt_path);
+  }
+
+  char json_path[PATH_MAX];
+  if (!output_path(json_path, json_path_fmt, dir, profile_name)) return;
+  fp = fopen(json_path, "w");
+  if (fp) {
+    pathest::profile::write_json(fp);
+    fclose(fp);
+    fprintf(stdout, "Wrote profile to %s\n", json_path);
+  } else {
+    fprintf(stderr, "Warning: unable to open file: %s\n", json_path);
+  }
+}
+#endif
+
+double Results::mean_absolute_error(pathest::PathView output) const {
+  const pathest::Path &ref_data = this->reference();
 #ifdef DEBUG
   // Invariant: output has the same number of data points as reference.
-  if (!this->ref_data_.empty()) {
-    assert(this->ref_data_.size() == output.size());
+  if (!ref_data.empty()) {
+    assert(ref_data.size() == output.size());
   }
 #endif
-  if (this->ref_data_.empty()) {
+  if (ref_data.empty()) {
     return 0;
   } else {
     double sum = 0.0;
     double num = 0.0;
-    pathest::Path::const_iterator out_it = output.begin();
-    pathest::Path::const_iterator ref_it = this->ref_data_.begin();
-    while (out_it != output.end() && ref_it != this->ref_data_.end()) {
+    pathest::PathView::const_iterator out_it = output.begin();
+    pathest::Path::const_iterator ref_it = ref_data.begin();
+    while (out_it != output.end() && ref_it != ref_data.end()) {
       double x_squared = pow(out_it->x() - ref_it->x(), 2);
       double y_squared = pow(out_it->y() - ref_it->y(), 2);
 #ifdef DEBUG
@@ -222,21 +348,22 @@ double Results::mean_absolute_error(const pathest::Path &output) const {
   }
 }
 
-double Results::root_mean_square_error(const pathest::Path &output) const {
+double Results::root_mean_square_error(pathest::PathView output) const {
+  const pathest::Path &ref_data = this->reference();
 #ifdef DEBUG
   // Invariant: output has the same number of data points as reference.
-  if (!this->ref_data_.empty()) {
-    assert(this->ref_data_.size() == output.size());
+  if (!ref_data.empty()) {
+    assert(ref_data.size() == output.size());
   }
 #endif
-  if (this->ref_data_.empty()) {
+  if (ref_data.empty()) {
     return 0;
   } else {
     double sum = 0.0;
     double num = 0.0;
-    pathest::Path::const_iterator out_it = output.begin();
-    pathest::Path::const_iterator ref_it = this->ref_data_.begin();
-    while (out_it != output.end() && ref_it != this->ref_data_.end()) {
+    pathest::PathView::const_iterator out_it = output.begin();
+    pathest::Path::const_iterator ref_it = ref_data.begin();
+    while (out_it != output.end() && ref_it != ref_data.end()) {
       double dx = out_it->x() - ref_it->x();
       double dy = out_it->y() - ref_it->y();
       double error_squared = dx * dx + dy * dy;
@@ -253,24 +380,24 @@ double Results::root_mean_square_error(const pathest::Path &output) const {
   }
 }
 
-double Results::mean_absolute_scaled_error(const pathest::Path &output)
-  const {
+double Results::mean_absolute_scaled_error(pathest::PathView output) const {
+  const pathest::Path &ref_data = this->reference();
 #ifdef DEBUG
   // Invariant: output has the same number of data points as reference.
-  if (!this->ref_data_.empty()) {
-    assert(this->ref_data_.size() == output.size());
+  if (!ref_data.empty()) {
+    assert(ref_data.size() == output.size());
   }
 #endif
-  if (this->ref_data_.size() < 2) {
+  if (ref_data.size() < 2) {
     return 0;
   } else {
     double sum = 0.0;
     double num = 0.0;
-    pathest::Path::const_iterator it = this->ref_data_.begin();
+    pathest::Path::const_iterator it = ref_data.begin();
     double prev_x = it->x();
     double prev_y = it->y();
     ++it;
-    while (it != this->ref_data_.end()) {
+    while (it != ref_data.end()) {
       double curr_x = it->x();
       double curr_y = it->y();
       double dx = curr_x - prev_x;
@@ -292,9 +419,9 @@ double Results::mean_absolute_scaled_error(const pathest::Path &output)
 
     sum = 0.0;
     num = 0.0;
-    pathest::Path::const_iterator out_it = output.begin();
-    pathest::Path::const_iterator ref_it = this->ref_data_.begin();
-    while (out_it != output.end() && ref_it != this->ref_data_.end()) {
+    pathest::PathView::const_iterator out_it = output.begin();
+    pathest::Path::const_iterator ref_it = ref_data.begin();
+    while (out_it != output.end() && ref_it != ref_data.end()) {
       double dx = out_it->x() - ref_it->x();
       double dy = out_it->y() - ref_it->y();
 #ifdef DEBUG
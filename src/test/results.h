@@ -5,25 +5,101 @@
 /// results (json file, plot image file, and summary in the results file) for
 /// each attempt to smooth the path.
 ///
+/// Given an AsyncWriter, results are written on its thread, so the caller can
+/// go on to the next estimate. Paths are written from where they are rather
+/// than copied: a path given by reference, like the reference data, must
+/// outlive the results object, which waits for its own writes to finish
+/// before it is destroyed, and a path handed over by move must keep its
+/// locations, e.g. in an arena, until its write has run (see last_write() and
+/// wait()).
+///
+/// Pending writes are kept in a fixed set of slots of the results object, with
+/// their names and titles, and output file paths are formatted into fixed
+/// buffers, so writing results does not allocate.
+///
 //===----------------------------------------------------------------------===//
 
 #ifndef TEST_RESULTS_H_
 #define TEST_RESULTS_H_
 
-#include <string>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <optional>
 
 #include "pathest/path.h"
+#include "pathest/path_view.h"
+#include "test/writer.h"
 
 class Results {
  public:
-  Results(const char *, const pathest::Path &);
+  // Error metrics and speed of an estimate, as written to the report.
+  struct Metrics {
+    bool has_ref;  // Whether the errors were measured against a reference.
+    double mae;
+    double rmse;
+    double mase;
+    double avg_speed;
+  };
+
+  static const size_t kMaxName = 64;  // Longest name, with the terminator.
+  static const size_t kMaxTitle = 128;  // Longest title, with the terminator.
+
+  Results(const char *, const pathest::Path &, AsyncWriter *writer = NULL);
+  ~Results();
+
+  Results(const Results &) = delete;
+  Results &operator=(const Results &) = delete;
 
+  // Use reference data, which must outlive the results object.
   void add_reference(const pathest::Path &);
   void write(const char *, const char *, const pathest::Path &) const;
+  // Write with metrics that were already measured, e.g. kept in a cache.
+  void write(const char *, const char *, const pathest::Path &,
+             const Metrics &) const;
+  // Write a path that is handed over, e.g. an estimate in an arena.
+  void write(const char *, const char *, pathest::Path &&) const;
+  void write(const char *, const char *, pathest::Path &&,
+             const Metrics &) const;
+  uint64_t last_write() const;  // Ticket of the last write, or 0.
+  void wait(const uint64_t) const;  // Wait until a write has run.
+  Metrics metrics(const pathest::Path &) const;
+  const pathest::Path &reference() const;
+
+#ifdef PATHEST_PROFILE
+  // Write the per-stage timing breakdown as profile.txt and profile.json.
+  void write_profile() const;
+  static void write_profile(const char *);  // Write to a given directory.
+#endif
 
  private:
-  std::string out_dir_;
-  pathest::Path ref_data_;
+  // A write given to the writer thread, with what it uses that the caller
+  // may not keep.
+  struct PendingWrite {
+    PendingWrite() :
+      results(NULL), name(), title(), borrowed(NULL), owned(),
+      has_metrics(false), metrics(), ticket(0) {}
+    PendingWrite(const PendingWrite &) = delete;
+    PendingWrite &operator=(const PendingWrite &) = delete;
+
+    const Results *results;
+    char name[kMaxName];
+    char title[kMaxTitle];
+    const pathest::Path *borrowed;  // Path written by reference, or NULL.
+    std::optional<pathest::Path> owned;  // Path handed over by move.
+    bool has_metrics;
+    Metrics metrics;
+    uint64_t ticket;  // Ticket of the write, or 0 if the slot was never used.
+  };
+
+  static const size_t kWriteSlots = 8;  // Writes pending at once.
+
+  char out_dir_[PATH_MAX];
+  const pathest::Path *ref_data_;  // Reference data, or NULL.
+  AsyncWriter *writer_;  // Writer thread for results, or NULL to write here.
+  mutable uint64_t last_write_;  // Ticket of the last write given to writer_.
+  mutable PendingWrite slots_[kWriteSlots];
+  mutable size_t next_slot_;  // Slot of the next write.
 
   // Coordinate bounds of the input data.
   double x_min_;
@@ -32,12 +108,17 @@ class Results {
   double y_max_;
 
   void init_report() const;
+  void write_async(const char *, const char *, const pathest::Path *,
+                   pathest::Path &&, const Metrics *) const;
+  static void run_write(void *);  // Run a pending write.
+  void write_now(const char *, const char *, const pathest::Path &,
+                 const Metrics *) const;
   void write_json(const char *, const pathest::Path &) const;
-  void write_error(const char *, const pathest::Path &) const;
+  void write_error(const char *, const Metrics &) const;
   void write_plot(const char *, const char *, const pathest::Path &) const;
-  double mean_absolute_error(const pathest::Path &) const;
-  double root_mean_square_error(const pathest::Path &) const;
-  double mean_absolute_scaled_error(const pathest::Path &) const;
+  double mean_absolute_error(pathest::PathView) const;
+  double root_mean_square_error(pathest::PathView) const;
+  double mean_absolute_scaled_error(pathest::PathView) const;
 };
 
 #endif  // TEST_RESULTS_H_
@@ -0,0 +1,57 @@
+/// @file test/writer.cc
+/// @brief Class for writing results on a background thread.
+//===----------------------------------------------------------------------===//
+
+#include "test/writer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <thread>
+
+AsyncWriter::AsyncWriter(const size_t capacity) :
+  jobs_(capacity), submit_lock_(), lock_(), done_changed_(), submitted_(0),
+  done_(0), thread_(&AsyncWriter::run, this) {}
+
+AsyncWriter::~AsyncWriter() {
+  this->jobs_.close();
+  this->thread_.join();
+}
+
+uint64_t AsyncWriter::submit(void (*run)(void *), void *arg) {
+  std::lock_guard<std::mutex> submit_guard(this->submit_lock_);
+  uint64_t ticket;
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    ticket = ++this->submitted_;
+  }
+  Job job = {run, arg};
+  this->jobs_.push(job);
+  return ticket;
+}
+
+void AsyncWriter::wait(const uint64_t ticket) {
+  std::unique_lock<std::mutex> guard(this->lock_);
+  this->done_changed_.wait(guard, [this, ticket] {
+    return this->done_ >= ticket;
+  });
+}
+
+void AsyncWriter::flush() {
+  uint64_t ticket;
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    ticket = this->submitted_;
+  }
+  this->wait(ticket);
+}
+
+void AsyncWriter::run() {
+  Job job = {NULL, NULL};
+  while (this->jobs_.pop(&job)) {
+    job.run(job.arg);
+    std::lock_guard<std::mutex> guard(this->lock_);
+    ++this->done_;
+    this->done_changed_.notify_all();
+  }
+}
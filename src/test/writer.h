@@ -0,0 +1,74 @@
+/// @file test/writer.h
+/// @brief Class for writing results on a background thread.
+///
+/// Writing a result (JSON data, a report entry and an SVG plot) takes about as
+/// long as computing it, so the test program hands writes to an AsyncWriter
+/// and goes on to the next estimate. All writes run on the one writer thread,
+/// in the order they were submitted: PLplot keeps global state and is not
+/// thread-safe, and the report is appended to in order.
+///
+/// Any number of threads may submit writes. Each write gets a ticket, so a
+/// thread can wait for its own writes without waiting for those of others.
+/// A write is a function and an argument, typically storage of the submitter
+/// that is reused once the write has run, so submitting does not allocate.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef TEST_WRITER_H_
+#define TEST_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "test/queue.h"
+
+class AsyncWriter {
+ public:
+  /// @brief Start the writer thread.
+  ///
+  /// @param capacity The number of writes that may wait to run before submit()
+  ///   blocks, which bounds the memory held by pending results.
+  explicit AsyncWriter(const size_t capacity = kDefaultCapacity);
+  ~AsyncWriter();  //< Runs the pending writes and stops the thread.
+
+  AsyncWriter(const AsyncWriter &) = delete;
+  AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+  static const size_t kDefaultCapacity = 4;  //< Default pending writes.
+
+  /// @brief Queue a write, waiting while too many are pending.
+  ///
+  /// @param run The write, called on the writer thread with arg.
+  /// @param arg The argument of the write, which must stay valid and unchanged
+  ///   until the write has run.
+  /// @returns the ticket of the write, for wait().
+  uint64_t submit(void (*run)(void *), void *arg);
+
+  /// @brief Wait until a write and every write submitted before it have run.
+  ///
+  /// @param ticket The ticket of the write.
+  void wait(const uint64_t ticket);
+
+  void flush();  //< Wait until every submitted write has run.
+
+ private:
+  struct Job {
+    void (*run)(void *);  //< The write.
+    void *arg;  //< Its argument.
+  };
+
+  BoundedQueue<Job> jobs_;  //< Writes not yet started.
+  std::mutex submit_lock_;  //< Keeps tickets in the order of the queue.
+  std::mutex lock_;  //< Guards submitted_ and done_.
+  std::condition_variable done_changed_;  //< Signaled when a write finishes.
+  uint64_t submitted_;  //< Number of writes submitted, the last ticket.
+  uint64_t done_;  //< Number of writes finished.
+  std::thread thread_;  //< Writer thread, started last.
+
+  void run();  //< Body of the writer thread.
+};
+
+#endif  // TEST_WRITER_H_